@@ -0,0 +1,439 @@
+/*
+ * @file    bench.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Benchmark driver: runs the workloads and compares them to a baseline
+ */
+
+// ----- includes
+#include "fsm.h"
+#include "tokenizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// ----- types
+namespace {
+
+using Clock_T = std::chrono::steady_clock;
+
+// a workload, either a Forth program or an in process micro benchmark
+struct Workload {
+    std::string name {};
+    std::string path {};            // program run by the interpreter
+    std::string expect {};          // expected output of the program
+    double ops {0};                 // operations done by one run
+    bool (*builtin)(std::size_t&) {nullptr};
+};
+
+// measures of a workload
+struct Result {
+    double median_ms {0};
+    double ops_per_s {0};
+    long peak_rss_kb {0};
+};
+
+// options of the driver
+struct Options {
+    std::string forth {"bin/slForth"};
+    std::string dir {"bench"};
+    std::string baseline {"bench/baseline.json"};
+    std::vector<std::string> args {};
+    std::vector<std::string> only {};
+    int runs {7};
+    double tolerance {0.20};
+    bool update {false};
+};
+
+// ----- constants
+constexpr std::size_t kParseDefinitions {20000};
+constexpr std::size_t kTokenizerPasses {20};
+constexpr std::size_t kFsmUpdates {2000000};
+
+// ----- workloads
+
+// scratch file of the parse workload, out of the tree
+std::string parseFilePath()
+{
+    return (std::filesystem::temp_directory_path() /
+            ("slforth_bench_parse_" + std::to_string(::getpid()) + ".fs")).string();
+}
+
+/* generate the large file loaded by the parse workload
+ * Args:
+ *  path : the file to write
+ * Returns:
+ *  The number of tokens of the file
+ */
+std::size_t generateParseFile(const std::string& path)
+{
+    std::ofstream file {path};
+    std::size_t tokens {0};
+
+    for (std::size_t i = 0; i < kParseDefinitions; ++i) {
+        // a definition, a comment and a top level line using it
+        file << ": W" << i << " ( n -- n ) DUP " << i % 97 << " + SWAP DROP " << i % 7 << " * ;\n";
+        file << "\\ word " << i << " of the parse benchmark\n";
+        file << i << " W" << i << " DROP\n";
+        tokens += 15 + 1 + 3;
+    }
+    file << "1 . CR\n";
+
+    return tokens + 3;
+}
+
+// tokenizer micro benchmark: scan a large buffer several times
+bool tokenizerBench(std::size_t& ops)
+{
+    std::string buffer;
+    for (std::size_t i = 0; i < kParseDefinitions; ++i)
+        buffer += ": W" + std::to_string(i) + " ( n -- n ) DUP 1 + SWAP DROP 3 * ;\n";
+
+    Tokenizer tokenizer;
+    std::size_t tokens {0};
+    for (std::size_t pass = 0; pass < kTokenizerPasses; ++pass) {
+        tokenizer.parse(buffer);
+        while (tokenizer.next())
+            ++tokens;
+    }
+
+    ops = tokens;
+    return tokens == kTokenizerPasses * kParseDefinitions * 15;
+}
+
+// state machine micro benchmark: cycle through the states of a small FSM
+bool fsmBench(std::size_t& ops)
+{
+    FSM::UserQueue_T queue;
+    FSM::Engine engine {queue};
+
+    int idle = engine.add(FSM::State{"idle", FSM::StateType::BEGIN_STATE, "", ""});
+    int word = engine.add(FSM::State{"word", FSM::StateType::NORMAL_STATE, "", ""});
+    int number = engine.add(FSM::State{"number", FSM::StateType::NORMAL_STATE, "", ""});
+    int letter = engine.add(FSM::Event{"letter"});
+    int digit = engine.add(FSM::Event{"digit"});
+    int space = engine.add(FSM::Event{"space"});
+
+    engine.add(FSM::Transition{idle, letter, word});
+    engine.add(FSM::Transition{idle, digit, number});
+    engine.add(FSM::Transition{idle, space, idle});
+    engine.add(FSM::Transition{word, letter, word});
+    engine.add(FSM::Transition{word, digit, word});
+    engine.add(FSM::Transition{word, space, idle});
+    engine.add(FSM::Transition{number, digit, number});
+    engine.add(FSM::Transition{number, letter, word});
+    engine.add(FSM::Transition{number, space, idle});
+
+    const int events[] = {letter, letter, digit, space, digit, digit, space, digit, letter, space};
+    std::size_t accepted {0};
+    engine.start();
+    for (std::size_t i = 0; i < kFsmUpdates; ++i)
+        accepted += engine.update(events[i % std::size(events)]) ? 1 : 0;
+
+    ops = kFsmUpdates;
+    return accepted == kFsmUpdates;
+}
+
+/* read the workloads of the benchmark directory. The header of a program
+ * gives its operation count and expected output, the last lines of the
+ * output when it is too long for the header:
+ *  \ ops: <count>
+ *  \ expect: <output>
+ * Args:
+ *  options : the options of the driver
+ * Returns:
+ *  The workloads, sorted by name
+ */
+std::vector<Workload> findWorkloads(const Options& options)
+{
+    std::vector<Workload> workloads;
+
+    for (const auto& entry : std::filesystem::directory_iterator(options.dir)) {
+        if (entry.path().extension() != ".fs")
+            continue;
+
+        Workload workload {entry.path().stem().string(), entry.path().string()};
+        std::ifstream file {workload.path};
+        std::string line;
+        while (std::getline(file, line) && line.starts_with("\\")) {
+            if (auto pos = line.find("ops:"); pos != std::string::npos)
+                workload.ops = std::strtod(line.c_str() + pos + 4, nullptr);
+            if (auto pos = line.find("expect:"); pos != std::string::npos)
+                workload.expect = line.substr(line.find_first_not_of(' ', pos + 7));
+        }
+        workloads.push_back(workload);
+    }
+
+    // the parse workload loads a generated file
+    std::string parse = parseFilePath();
+    Workload workload {"parse", parse, "1"};
+    workload.ops = static_cast<double>(generateParseFile(parse));
+    workloads.push_back(workload);
+
+    workloads.push_back({"tokenizer", "", "", 0, tokenizerBench});
+    workloads.push_back({"fsm", "", "", 0, fsmBench});
+
+    std::sort(workloads.begin(), workloads.end(),
+              [](const Workload& a, const Workload& b) { return a.name < b.name; });
+    return workloads;
+}
+
+// ----- measures
+
+/* run a program once in the interpreter
+ * Args:
+ *  options  : the options of the driver
+ *  workload : the program to run
+ *  output   : receives the standard output of the program
+ *  rss_kb   : receives the peak resident set size of the interpreter
+ * Returns:
+ *  True if the interpreter exited successfully
+ */
+bool runProgram(const Options& options, const Workload& workload, std::string& output, long& rss_kb)
+{
+    int pipefd[2];
+    if (::pipe(pipefd) != 0)
+        return false;
+
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        ::dup2(pipefd[1], STDOUT_FILENO);
+        ::close(pipefd[0]);
+        ::close(pipefd[1]);
+
+        std::vector<char*> argv {const_cast<char*>(options.forth.c_str())};
+        for (const auto& arg : options.args)
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(const_cast<char*>(workload.path.c_str()));
+        argv.push_back(nullptr);
+
+        ::execv(options.forth.c_str(), argv.data());
+        std::_Exit(127);
+    }
+
+    ::close(pipefd[1]);
+    char buffer[4096];
+    ssize_t size;
+    while ((size = ::read(pipefd[0], buffer, sizeof(buffer))) > 0)
+        output.append(buffer, static_cast<std::size_t>(size));
+    ::close(pipefd[0]);
+
+    int status {0};
+    struct rusage usage {};
+    if (::wait4(pid, &status, 0, &usage) != pid)
+        return false;
+
+    rss_kb = usage.ru_maxrss;
+    return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+/* measure a workload
+ * Args:
+ *  options  : the options of the driver
+ *  workload : the workload to measure
+ *  result   : receives the measures
+ * Returns:
+ *  True if every run succeeded with the expected output
+ */
+bool measure(const Options& options, Workload& workload, Result& result)
+{
+    std::vector<double> times;
+
+    for (int run = 0; run < options.runs; ++run) {
+        std::string output;
+        long rss_kb {0};
+        bool ok {false};
+
+        auto start = Clock_T::now();
+        if (workload.builtin != nullptr) {
+            std::size_t ops {0};
+            ok = workload.builtin(ops);
+            workload.ops = static_cast<double>(ops);
+
+            struct rusage usage {};
+            ::getrusage(RUSAGE_SELF, &usage);
+            rss_kb = usage.ru_maxrss;
+        } else {
+            ok = runProgram(options, workload, output, rss_kb);
+
+            // compare the end of the output, without the trailing spaces
+            output.erase(output.find_last_not_of(" \n") + 1);
+            if (ok && !workload.expect.empty() && (output != workload.expect) &&
+                !output.ends_with("\n" + workload.expect)) {
+                output.erase(0, output.find_last_of('\n') + 1);
+                std::cerr << workload.name << ": expected [" << workload.expect << "], got [" << output << "]\n";
+                ok = false;
+            }
+        }
+        auto stop = Clock_T::now();
+
+        if (!ok)
+            return false;
+
+        times.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+        result.peak_rss_kb = std::max(result.peak_rss_kb, rss_kb);
+    }
+
+    std::sort(times.begin(), times.end());
+    result.median_ms = times[times.size() / 2];
+    result.ops_per_s = (result.median_ms > 0) ? workload.ops * 1000.0 / result.median_ms : 0;
+    return true;
+}
+
+// ----- baseline
+
+/* read the median times of a baseline file, written by --update as
+ *  { "name": { "median_ms": ..., ... }, ... }
+ * Args:
+ *  path : the baseline file
+ * Returns:
+ *  The median time of every workload of the baseline
+ */
+std::map<std::string, double> readBaseline(const std::string& path)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream file {path};
+    std::stringstream content;
+    content << file.rdbuf();
+    std::string text = content.str();
+
+    // one workload per line
+    std::istringstream lines {text};
+    std::string line;
+    while (std::getline(lines, line)) {
+        auto open = line.find('"');
+        auto close = line.find('"', open + 1);
+        auto median = line.find("\"median_ms\":");
+        if ((open == std::string::npos) || (close == std::string::npos) || (median == std::string::npos))
+            continue;
+        baseline[line.substr(open + 1, close - open - 1)] = std::strtod(line.c_str() + median + 12, nullptr);
+    }
+
+    return baseline;
+}
+
+/* write the measures as the new baseline
+ * Args:
+ *  path    : the baseline file
+ *  results : the measures of every workload
+ */
+void writeBaseline(const std::string& path, const std::map<std::string, Result>& results)
+{
+    std::ofstream file {path};
+    file << "{\n";
+
+    std::size_t count {0};
+    for (const auto& [name, result] : results) {
+        file << "  \"" << name << "\": { "
+             << "\"median_ms\": " << std::fixed << std::setprecision(2) << result.median_ms << ", "
+             << "\"ops_per_s\": " << std::setprecision(0) << result.ops_per_s << ", "
+             << "\"peak_rss_kb\": " << result.peak_rss_kb << " }"
+             << ((++count < results.size()) ? ",\n" : "\n");
+    }
+
+    file << "}\n";
+}
+
+// command line usage
+void usage()
+{
+    std::cerr << "usage: bench [--forth BIN] [--dir DIR] [--baseline FILE] [--runs N]\n"
+              << "             [--tolerance FRACTION] [--update] [--arg ARG]... [WORKLOAD]...\n";
+}
+
+}
+
+
+// ----- main
+int main(int argc, char* argv[]) {
+    Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg {argv[i]};
+        bool has_value = (i + 1 < argc);
+
+        if ((arg == "--forth") && has_value) {
+            options.forth = argv[++i];
+        } else if ((arg == "--dir") && has_value) {
+            options.dir = argv[++i];
+        } else if ((arg == "--baseline") && has_value) {
+            options.baseline = argv[++i];
+        } else if ((arg == "--runs") && has_value) {
+            options.runs = std::max(1, std::atoi(argv[++i]));
+        } else if ((arg == "--tolerance") && has_value) {
+            options.tolerance = std::strtod(argv[++i], nullptr);
+        } else if ((arg == "--arg") && has_value) {
+            options.args.push_back(argv[++i]);
+        } else if (arg == "--update") {
+            options.update = true;
+        } else if (arg.starts_with("--")) {
+            usage();
+            return 2;
+        } else {
+            options.only.push_back(arg);
+        }
+    }
+
+    std::map<std::string, double> baseline = readBaseline(options.baseline);
+    std::map<std::string, Result> results;
+    int regressions {0};
+    int failures {0};
+
+    std::cout << std::left << std::setw(12) << "workload" << std::right
+              << std::setw(12) << "median ms" << std::setw(16) << "ops/s"
+              << std::setw(12) << "peak RSS" << std::setw(12) << "baseline" << "\n";
+
+    for (auto& workload : findWorkloads(options)) {
+        if (!options.only.empty() &&
+            (std::find(options.only.begin(), options.only.end(), workload.name) == options.only.end()))
+            continue;
+
+        Result result;
+        if (!measure(options, workload, result)) {
+            std::cout << std::left << std::setw(12) << workload.name << "  FAILED\n";
+            ++failures;
+            continue;
+        }
+        results[workload.name] = result;
+
+        std::cout << std::left << std::setw(12) << workload.name << std::right << std::fixed
+                  << std::setw(12) << std::setprecision(2) << result.median_ms
+                  << std::setw(16) << std::setprecision(0) << result.ops_per_s
+                  << std::setw(9) << result.peak_rss_kb << " kB";
+
+        // slower than the baseline by more than the tolerance
+        if (auto base = baseline.find(workload.name); base != baseline.end()) {
+            double change = (result.median_ms - base->second) / base->second;
+            std::cout << std::setw(10) << std::showpos << std::setprecision(1) << change * 100 << "%"
+                      << std::noshowpos;
+            if (change > options.tolerance) {
+                std::cout << "  REGRESSION";
+                ++regressions;
+            }
+        }
+        std::cout << "\n";
+    }
+    std::filesystem::remove(parseFilePath());
+
+    if (options.update) {
+        writeBaseline(options.baseline, results);
+        std::cout << "baseline written to " << options.baseline << "\n";
+        return (failures > 0) ? 1 : 0;
+    }
+
+    return ((failures > 0) || (regressions > 0)) ? 1 : 0;
+}
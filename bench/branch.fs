@@ -0,0 +1,9 @@
+\ heavy IF branching: one classification per op
+\ ops: 3000000
+\ expect: 7400000
+: CLASSIFY ( n -- k )
+    DUP 3 MOD 0= IF DROP 1 ELSE
+    DUP 5 MOD 0= IF DROP 2 ELSE
+    7 AND 3 > IF 3 ELSE 4 THEN THEN THEN ;
+: BRANCHY ( -- sum ) 0 3000000 0 DO I CLASSIFY + LOOP ;
+BRANCHY . CR
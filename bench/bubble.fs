@@ -0,0 +1,11 @@
+\ bubble sort of a reversed array in the data space: one compare per op
+\ ops: 4995000
+\ expect: 1 1000
+1000 CONSTANT N
+CREATE DATA N CELLS ALLOT
+: ITEM ( i -- addr ) CELLS DATA + ;
+: REVERSE ( -- ) N 0 DO N I - I ITEM ! LOOP ;
+: ORDER ( addr -- ) DUP 1 CELLS + OVER @ OVER @ > IF OVER @ OVER @ SWAP ROT ! SWAP ! ELSE DROP DROP THEN ;
+: SORT ( -- ) N 1 DO N I - 0 DO I ITEM ORDER LOOP LOOP ;
+: PASSES ( -- ) 10 0 DO REVERSE SORT LOOP ;
+PASSES 0 ITEM @ . N 1 - ITEM @ . CR
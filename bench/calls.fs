@@ -0,0 +1,6 @@
+\ deep word call chains: 2000 chains of 1000 nested calls
+\ ops: 2000000
+\ expect: 2000000
+: DEEP ( n -- n ) DUP IF 1 - DEEP 1 + THEN ;
+: CHAINS ( -- sum ) 0 2000 0 DO 1000 DEEP + LOOP ;
+CHAINS . CR
@@ -0,0 +1,5 @@
+\ recursive fib: one call per node of the call tree
+\ ops: 635621
+\ expect: 196418
+: FIB ( n -- f ) DUP 2 < IF EXIT THEN DUP 1 - FIB SWAP 2 - FIB + ;
+27 FIB . CR
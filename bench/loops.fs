@@ -0,0 +1,6 @@
+\ nested counted loops: one inner iteration per op
+\ ops: 9000000
+\ expect: 64736
+: INNER ( acc -- acc ) 3000 0 DO I + 65535 AND LOOP ;
+: NESTED ( -- acc ) 0 3000 0 DO INNER LOOP ;
+NESTED . CR
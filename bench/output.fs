@@ -0,0 +1,6 @@
+\ report output: one number or string printed per op
+\ ops: 1200000
+\ expect: row 99999 : 0 99999 199998 299997 399996 499995 599994 699993 799992 899991
+: ROW ( n -- ) ." row " DUP . ." : " 10 0 DO DUP I * . LOOP CR DROP ;
+: REPORT ( -- ) 100000 0 DO I ROW LOOP ;
+REPORT
@@ -0,0 +1,11 @@
+\ sieve of Eratosthenes in the data space: one flag store or test per op
+\ ops: 3011600
+\ expect: 1028
+8192 CONSTANT SIZE
+CREATE FLAGS SIZE CELLS ALLOT
+: FLAG ( i -- addr ) CELLS FLAGS + ;
+: CLEAR ( -- ) SIZE 0 DO 1 I FLAG ! LOOP ;
+: STRIKE ( i -- ) DUP DUP * SIZE < IF SIZE OVER DUP * DO 0 I FLAG ! DUP +LOOP THEN DROP ;
+: SIEVE ( -- n ) CLEAR 0 SIZE 2 DO I FLAG @ IF 1 + I STRIKE THEN LOOP ;
+: PASSES ( -- n ) 0 100 0 DO DROP SIEVE LOOP ;
+PASSES . CR
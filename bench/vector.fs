@@ -0,0 +1,9 @@
+\ vector words over the data space: one cell per op
+\ ops: 655360000
+\ expect: 196608 1 589824
+65536 CONSTANT N
+CREATE A N CELLS ALLOT
+CREATE B N CELLS ALLOT
+: PASS ( -- ) A N 2 VFILL B N 1 VFILL A B A N VADD A N VSUM DROP A B N VDOT DROP ;
+: PASSES ( -- ) 2000 0 DO PASS LOOP ;
+PASSES A N VSUM . B N VMAX . A A A N VMUL A N VSUM . CR
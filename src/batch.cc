@@ -0,0 +1,221 @@
+/*
+ * @file    batch.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Parallel runner of many independent scripts
+ */
+
+// ----- includes
+#include "batch.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+#include <thread>
+
+// ----- helpers
+namespace {
+
+// period of the checks of the time limit
+constexpr std::chrono::milliseconds kWatchPeriod {100};
+
+}
+
+
+// ----- public implementation
+
+/* constructor
+ * Args:
+ *  snapshot : the state every script starts from
+ *  jobs     : the number of worker threads
+ */
+BatchRunner::BatchRunner(ForthVM::SnapshotPtr_T snapshot, std::size_t jobs) :
+    snapshot_ {std::move(snapshot)},
+    jobs_ {std::max<std::size_t>(jobs, 1)}
+{
+}
+
+/* destructor
+ */
+/*virtual*/ BatchRunner::~BatchRunner()
+{
+}
+
+/* list the scripts of a batch
+ * Args:
+ *  source : a directory, whose .fs files are run in name order, or a file
+ *           listing one script per line
+ * Returns:
+ *  The paths of the scripts
+ */
+std::vector<std::string> BatchRunner::listScripts(const std::string& source)
+{
+    std::vector<std::string> scripts;
+
+    std::error_code error;
+    if (std::filesystem::is_directory(source, error)) {
+        for (const auto& entry : std::filesystem::directory_iterator(source, error)) {
+            if (entry.is_regular_file(error) && (entry.path().extension() == ".fs"))
+                scripts.push_back(entry.path().string());
+        }
+        std::sort(scripts.begin(), scripts.end());
+        return scripts;
+    }
+
+    MappedFile file {source};
+    if (!file.isOpen()) {
+        std::cerr << "Error: unable to load the batch [" << source << "]\n";
+        return scripts;
+    }
+
+    std::istringstream lines {std::string(file.data())};
+    for (std::string line; std::getline(lines, line); ) {
+        if (!line.empty())
+            scripts.push_back(line);
+    }
+
+    return scripts;
+}
+
+/* set the number of calls after which a word is translated to native code,
+ * in every worker
+ * Args:
+ *  threshold : the number of calls, 0 to keep every word in the interpreter
+ */
+void BatchRunner::setJitThreshold(std::size_t threshold)
+{
+    jit_threshold_ = threshold;
+}
+
+/* set the time a script may run before it is interrupted
+ * Args:
+ *  limit : the time limit, 0 to let the scripts run as long as they need
+ */
+void BatchRunner::setTimeLimit(std::chrono::milliseconds limit)
+{
+    time_limit_ = limit;
+}
+
+/* run the scripts, and write their output as soon as the scripts before
+ * them are done
+ * Args:
+ *  scripts : the paths of the scripts
+ *  out     : the stream receiving the output of the scripts
+ *  err     : the stream receiving their errors
+ */
+void BatchRunner::run(const std::vector<std::string>& scripts, std::ostream& out, std::ostream& err)
+{
+    std::size_t workers = std::min(jobs_, std::max<std::size_t>(scripts.size(), 1));
+
+    results_.assign(scripts.size(), {});
+    running_.assign(workers, {});
+    queues_.clear();
+    for (std::size_t i = 0; i < workers; ++i)
+        queues_.push_back(std::make_unique<Queue>());
+
+    // dealt in turn, so that the first scripts are the first ones to run
+    for (std::size_t i = 0; i < scripts.size(); ++i)
+        queues_[i % workers]->scripts.push_back(i);
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < workers; ++i)
+        threads.emplace_back(&BatchRunner::work, this, i, std::cref(scripts));
+
+    for (Result& result : results_) {
+        // the wait wakes up regularly to check the time limit
+        std::unique_lock lock {results_mutex_};
+        if (time_limit_.count() > 0) {
+            while (!ready_.wait_for(lock, kWatchPeriod, [&result]() { return result.done; }))
+                interrupt();
+        } else {
+            ready_.wait(lock, [&result]() { return result.done; });
+        }
+        lock.unlock();
+
+        out << result.out;
+        err << result.err;
+        out.flush();
+        result = {};
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+}
+
+
+// ----- private implementation
+
+/* take the next script of a worker, or steal one from another worker
+ * Args:
+ *  worker : the index of the worker
+ * Returns:
+ *  The index of the script, none when every queue is empty
+ */
+std::optional<std::size_t> BatchRunner::take(std::size_t worker)
+{
+    {
+        Queue& own = *queues_[worker];
+        std::lock_guard lock {own.mutex};
+        if (!own.scripts.empty()) {
+            std::size_t script = own.scripts.front();
+            own.scripts.pop_front();
+            return script;
+        }
+    }
+
+    for (std::size_t i = 1; i < queues_.size(); ++i) {
+        Queue& victim = *queues_[(worker + i) % queues_.size()];
+        std::lock_guard lock {victim.mutex};
+        if (!victim.scripts.empty()) {
+            std::size_t script = victim.scripts.back();
+            victim.scripts.pop_back();
+            return script;
+        }
+    }
+
+    return std::nullopt;
+}
+
+/* worker thread: run scripts until there is none left
+ * Args:
+ *  worker  : the index of the worker
+ *  scripts : the paths of the scripts
+ */
+void BatchRunner::work(std::size_t worker, const std::vector<std::string>& scripts)
+{
+    ForthVM forth {snapshot_->prelude, snapshot_->capacity};
+    if (jit_threshold_)
+        forth.setJitThreshold(*jit_threshold_);
+
+    while (auto script = take(worker)) {
+        std::ostringstream out;
+        std::ostringstream err;
+
+        // an interrupt aimed at the previous script is dropped
+        {
+            std::lock_guard lock {results_mutex_};
+            running_[worker] = {&forth, std::chrono::steady_clock::now()};
+            forth.clearInterrupt();
+        }
+
+        forth.restore(*snapshot_);
+        forth.setOutput(out, err);
+        forth.load(scripts[*script]);
+
+        std::lock_guard lock {results_mutex_};
+        running_[worker] = {};
+        results_[*script] = {out.str(), err.str(), true};
+        ready_.notify_all();
+    }
+}
+
+// interrupt the scripts running past the time limit, under results_mutex_
+void BatchRunner::interrupt()
+{
+    auto now = std::chrono::steady_clock::now();
+    for (Running& running : running_) {
+        if ((running.forth != nullptr) && running.since && (now - *running.since > time_limit_))
+            running.forth->interrupt();
+    }
+}
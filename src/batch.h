@@ -0,0 +1,89 @@
+/*
+ * @file    batch.h
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Interface / Parallel runner of many independent scripts
+ */
+
+// ----- header guards
+#ifndef FORTH_BATCH_H_
+#define FORTH_BATCH_H_
+
+// ----- includes
+#include "forth_vm.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// ----- class
+// every worker thread owns a virtual machine built on the shared snapshot,
+// and restored between its scripts. The scripts are dealt to the workers,
+// which steal from the others once their own queue is empty. A script
+// running past the time limit, if any, is interrupted.
+class BatchRunner
+{
+public:
+    BatchRunner(ForthVM::SnapshotPtr_T, std::size_t);
+    virtual ~BatchRunner();
+
+    // no copy or move semantics
+    BatchRunner(const BatchRunner&) = delete;
+    BatchRunner& operator=(const BatchRunner&) = delete;
+    BatchRunner(BatchRunner&&) = delete;
+    BatchRunner& operator=(BatchRunner&&) = delete;
+
+    static std::vector<std::string> listScripts(const std::string&);
+
+    void setJitThreshold(std::size_t);
+    void setTimeLimit(std::chrono::milliseconds);
+    void run(const std::vector<std::string>&, std::ostream&, std::ostream&);
+
+private:
+    // scripts waiting for a worker, taken from the front by their owner and
+    // from the back by the thieves
+    struct Queue {
+        std::mutex mutex {};
+        std::deque<std::size_t> scripts {};
+    };
+
+    // captured output of a script
+    struct Result {
+        std::string out {};
+        std::string err {};
+        bool done {false};
+    };
+
+    // virtual machine of a worker, and the start of its current script
+    struct Running {
+        ForthVM* forth {nullptr};
+        std::optional<std::chrono::steady_clock::time_point> since {};
+    };
+
+    std::optional<std::size_t> take(std::size_t);
+    void work(std::size_t, const std::vector<std::string>&);
+    void interrupt();
+
+private:
+    ForthVM::SnapshotPtr_T snapshot_ {};
+    std::size_t jobs_ {1};
+    std::optional<std::size_t> jit_threshold_ {};
+    std::chrono::milliseconds time_limit_ {0};
+
+    std::vector<std::unique_ptr<Queue>> queues_ {};
+
+    // results, emitted in the order of the scripts, and the scripts running
+    std::vector<Result> results_ {};
+    std::vector<Running> running_ {};   // one per worker
+    std::mutex results_mutex_ {};
+    std::condition_variable ready_ {};
+};
+
+#endif // FORTH_BATCH_H_
@@ -0,0 +1,38 @@
+/*
+ * @file    cell.h
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Interface / Forth cell type
+ */
+
+// ----- header guards
+#ifndef FORTH_CELL_H_
+#define FORTH_CELL_H_
+
+// ----- includes
+#include <cstdint>
+
+// ----- cell width
+// the cells are 32 bits wide, unless the build defines FORTH_CELL_BITS=64
+#ifndef FORTH_CELL_BITS
+#define FORTH_CELL_BITS     32
+#endif
+
+// ----- types
+// a cell is the unit of the stacks and of the code space, and a double cell
+// holds the full result of a product of two cells
+#if FORTH_CELL_BITS == 64
+using Cell = std::int64_t;
+using UCell = std::uint64_t;
+__extension__ using DoubleCell = __int128;
+__extension__ using UDoubleCell = unsigned __int128;
+#elif FORTH_CELL_BITS == 32
+using Cell = std::int32_t;
+using UCell = std::uint32_t;
+using DoubleCell = std::int64_t;
+using UDoubleCell = std::uint64_t;
+#else
+#error "FORTH_CELL_BITS must be 32 or 64"
+#endif
+
+#endif // FORTH_CELL_H_
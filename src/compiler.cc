@@ -0,0 +1,547 @@
+/*
+ * @file    compiler.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Forth Virtual Machine compiler passes
+ */
+
+// ----- includes
+#include "forth_vm.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+// ----- constants
+namespace {
+
+// depth of an instruction not reached yet by the stack effect analysis
+constexpr int kUnreached {INT_MIN};
+
+// largest word copied into its callers, in instructions
+constexpr std::size_t kInlineSize {8};
+
+}
+
+
+// ----- private implementation
+
+/* finalize the definition compiled at the end of the code space: infer
+ * its stack effect, guard its stack accesses and register the word
+ */
+void ForthVM::finalizeDefinition()
+{
+    std::vector<Cell> unoptimized(code_.begin() + static_cast<std::ptrdiff_t>(fnstart_), code_.end());
+    std::vector<std::size_t> inlined;
+    std::vector<Instruction> source = decode(code_.data() + fnstart_, code_.size() - fnstart_);
+
+    // a word leaving cells on the return stack would return to one of them
+    if (!checkReturnStack(source)) {
+        error() << "Error: unbalanced return stack in definition of [" << fnname_ << "]!\n";
+        code_.resize(fnstart_);
+        return;
+    }
+
+    std::vector<Instruction> expanded = inlineCalls(source, inlined);
+    std::size_t index = wordCount();
+
+    // the effect is inferred before the optimizer folds the constant
+    // conditions, so the branches it drops are still checked. A recursive
+    // word is first analysed without its recursive paths, then checked
+    // again with the effect found for the other paths.
+    bool balanced {true};
+    StackEffect effect = inferEffect(expanded, nullptr, balanced);
+    if (effect.known) {
+        StackEffect recursive = inferEffect(expanded, &effect, balanced);
+        if (!(recursive == effect))
+            effect = {};
+    }
+
+    // the optimizer drops the instructions only reading the stack, as in
+    // 0 + or SWAP SWAP, also from the words inlined here before, and the
+    // copies of the inlined words lose their guard: the guard still checks
+    // the depth the source needs
+    std::vector<Instruction> code = optimize(std::move(expanded));
+    if (effect.known) {
+        bool ignored {true};
+        StackEffect needed = inferEffect(source, &effect, ignored);
+        if (needed.known && (needed.in > effect.in)) {
+            effect.out += needed.in - effect.in;
+            effect.in = needed.in;
+        }
+    }
+
+    // the code after DOES> is entered from the words created, every one of
+    // its stack accesses is checked
+    if (std::any_of(code.begin(), code.end(), [](const Instruction& i) { return i.op == Opcode::Does; }))
+        effect = {};
+
+    if (!balanced) {
+        error() << "Warning: the branches of [" << fnname_ << "] leave different stack depths, "
+                  << "its stack accesses will be checked\n";
+    }
+
+    code_.resize(fnstart_);
+    encode(insertGuards(code, effect));
+
+    userfn_[fnname_] = index;
+    dictionary_.push_back({fnname_, fnstart_, code_.size() - fnstart_, effect,
+                           std::move(unoptimized), std::move(inlined)});
+    runtime_.emplace_back();
+}
+
+/* copy the body of the small words called by a definition in place of
+ * the calls. The copies keep the definitions current at compile time, so
+ * redefining a word later does not change its callers, as for a call.
+ * Args:
+ *  code    : the instructions of the definition
+ *  inlined : receives the indexes of the words copied
+ * Returns:
+ *  The instructions with the calls replaced
+ */
+std::vector<ForthVM::Instruction> ForthVM::inlineCalls(const std::vector<Instruction>& code,
+                                                       std::vector<std::size_t>& inlined) const
+{
+    std::vector<Instruction> expanded;
+    std::vector<std::size_t> index(code.size() + 1, 0);
+    std::vector<bool> copied;
+
+    for (std::size_t i = 0; i < code.size(); ++i) {
+        index[i] = expanded.size();
+
+        auto callee = static_cast<std::size_t>(code[i].operand);
+        if ((code[i].op != Opcode::Call) || !isInlinable(callee)) {
+            expanded.push_back(code[i]);
+            copied.push_back(false);
+            continue;
+        }
+
+        // the body, without the entry guard and the final EXIT
+        const Word& definition = word(callee);
+        std::vector<Instruction> body = decode(code_.data() + definition.address, definition.size);
+        std::size_t first = (body.front().op == Opcode::Guard) ? 1 : 0;
+        std::size_t base = expanded.size();
+
+        for (std::size_t k = first; k + 1 < body.size(); ++k) {
+            Instruction instruction = body[k];
+            if (isBranch(instruction.op))
+                instruction.target = base + instruction.target - first;
+            expanded.push_back(instruction);
+            copied.push_back(true);
+        }
+
+        if (std::find(inlined.begin(), inlined.end(), callee) == inlined.end())
+            inlined.push_back(callee);
+    }
+    index[code.size()] = expanded.size();
+
+    for (std::size_t k = 0; k < expanded.size(); ++k) {
+        if (!copied[k] && isBranch(expanded[k].op))
+            expanded[k].target = index[expanded[k].target];
+    }
+
+    return expanded;
+}
+
+/* check if a word can be copied into its callers
+ * Args:
+ *  index : the index of the word in the dictionary
+ * Returns:
+ *  True if the word is small, with a known stack effect, a single EXIT at
+ *  its end, and does not use the return stack
+ */
+bool ForthVM::isInlinable(std::size_t index) const
+{
+    // the word being defined
+    if (index >= wordCount())
+        return false;
+
+    const Word& definition = word(index);
+    if (!definition.effect.known)
+        return false;
+
+    std::vector<Instruction> body = decode(code_.data() + definition.address, definition.size);
+    std::size_t first = (body.front().op == Opcode::Guard) ? 1 : 0;
+    if ((body.size() - first > kInlineSize + 1) || (body.back().op != Opcode::Exit))
+        return false;
+
+    for (std::size_t k = first; k + 1 < body.size(); ++k) {
+        switch (body[k].op) {
+            case Opcode::Exit:
+            case Opcode::Guard:
+            case Opcode::ToR:
+            case Opcode::RFrom:
+            case Opcode::RFetch:
+            case Opcode::Do:
+            case Opcode::QDo:
+            case Opcode::Unloop:
+            case Opcode::I:
+            case Opcode::J:
+                return false;
+            case Opcode::Call:
+                if (static_cast<std::size_t>(body[k].operand) == index)
+                    return false;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return true;
+}
+
+/* decode a part of the code space into instructions
+ * Args:
+ *  cells : the first instruction
+ *  size  : the number of cells to decode
+ * Returns:
+ *  The instructions, with the branch offsets turned into instruction indexes
+ */
+std::vector<ForthVM::Instruction> ForthVM::decode(const Cell* cells, std::size_t size) const
+{
+    std::vector<Instruction> code;
+    std::vector<std::size_t> index(size + 1, 0);
+
+    for (std::size_t ip = 0; ip < size; ) {
+        index[ip] = code.size();
+
+        auto op = static_cast<Opcode>(cells[ip++]);
+        Instruction instruction {op};
+
+        // keep the cell of the branch destination for now
+        if (op == Opcode::FLiteral) {
+            std::memcpy(&instruction.real, cells + ip, sizeof(double));
+            ip += kRealCells;
+        } else if (hasOperand(op)) {
+            instruction.operand = cells[ip];
+            if (isBranch(op))
+                instruction.target = ip + static_cast<std::size_t>(cells[ip]);
+            ++ip;
+        }
+
+        code.push_back(instruction);
+    }
+    index[size] = code.size();
+
+    for (auto& instruction : code) {
+        if (isBranch(instruction.op))
+            instruction.target = index[instruction.target];
+    }
+
+    return code;
+}
+
+/* encode instructions at the end of the code space
+ * Args:
+ *  code : the instructions to encode
+ */
+void ForthVM::encode(const std::vector<Instruction>& code)
+{
+    // address of every instruction, and of the end of the code
+    std::vector<std::size_t> address(code.size() + 1, 0);
+    std::size_t ip = code_.size();
+    for (std::size_t i = 0; i < code.size(); ++i) {
+        address[i] = ip;
+        ip += 1 + operandCells(code[i].op);
+    }
+    address[code.size()] = ip;
+
+    for (std::size_t i = 0; i < code.size(); ++i) {
+        const Instruction& instruction = code[i];
+
+        if (isBranch(instruction.op)) {
+            std::size_t operand = address[i] + 1;
+            emit(instruction.op, static_cast<Cell>(address[instruction.target] - operand));
+        } else if (instruction.op == Opcode::FLiteral) {
+            emitReal(instruction.real);
+        } else if (hasOperand(instruction.op)) {
+            emit(instruction.op, instruction.operand);
+        } else {
+            emit(instruction.op);
+        }
+    }
+}
+
+/* infer the stack effect of a definition
+ * Args:
+ *  code      : the instructions of the definition
+ *  recursive : the effect assumed for the recursive calls, nullptr to
+ *              ignore the paths going through them
+ *  balanced  : set to false if two branches merge with different depths
+ * Returns:
+ *  The stack effect, unknown if the depth is not the same on every path
+ */
+ForthVM::StackEffect ForthVM::inferEffect(const std::vector<Instruction>& code,
+                                          const StackEffect* recursive, bool& balanced) const
+{
+    // depth of the stack before each instruction, relative to the entry
+    std::vector<int> depth(code.size() + 1, kUnreached);
+    std::vector<std::size_t> pending {0};
+    depth[0] = 0;
+
+    int needed {0};
+    int exit {kUnreached};
+    bool known {true};
+
+    // propagate a depth to the next instruction on a path
+    auto reach = [&](std::size_t from, std::size_t to, int d) {
+        if (depth[to] == kUnreached) {
+            depth[to] = d;
+            pending.push_back(to);
+        } else if (depth[to] != d) {
+            // loops may legitimately grow the stack, not IF/ELSE branches
+            if (to > from)
+                balanced = false;
+            known = false;
+        }
+    };
+
+    while (!pending.empty() && known) {
+        std::size_t i = pending.back(); pending.pop_back();
+        const Instruction& instruction = code[i];
+        int d = depth[i];
+
+        // effect of the instruction
+        OpcodeEffect effect = effectOf(instruction.op);
+        if (instruction.op == Opcode::Call) {
+            auto callee = static_cast<std::size_t>(instruction.operand);
+            if (callee == wordCount()) {
+                if (recursive == nullptr)
+                    continue;
+                effect = {recursive->in, recursive->out};
+            } else if (word(callee).effect.known) {
+                effect = {word(callee).effect.in, word(callee).effect.out};
+            } else {
+                return {};
+            }
+        } else if (instruction.op == Opcode::Execute) {
+            // the word called is only known at run time
+            return {};
+        }
+
+        needed = std::max(needed, effect.in - d);
+        int next = d - effect.in + effect.out;
+
+        switch (instruction.op) {
+            case Opcode::Exit:
+                if ((exit != kUnreached) && (exit != next))
+                    return {};
+                exit = next;
+                break;
+            case Opcode::Branch:
+            case Opcode::Leave:
+                reach(i, instruction.target, next);
+                break;
+            case Opcode::ZeroBranch:
+            case Opcode::NonZeroBranch:
+            case Opcode::DupZeroBranch:
+            case Opcode::QDo:
+            case Opcode::Loop:
+            case Opcode::PlusLoop:
+                reach(i, instruction.target, next);
+                reach(i, i + 1, next);
+                break;
+            default:
+                reach(i, i + 1, next);
+                break;
+        }
+    }
+
+    if (!known || (exit == kUnreached))
+        return {};
+
+    return {true, needed, needed + exit};
+}
+
+/* check the use of the return stack by a definition: the loops and >R
+ * push cells that the same definition pops, on every path
+ * Args:
+ *  code : the instructions of the definition
+ * Returns:
+ *  False if a path pops or reads cells it did not push, if two paths merge
+ *  with different depths, or if EXIT is reached inside a loop or with
+ *  cells left by >R
+ */
+bool ForthVM::checkReturnStack(const std::vector<Instruction>& code) const
+{
+    // cells pushed by the definition before each instruction
+    std::vector<int> depth(code.size(), kUnreached);
+    std::vector<std::size_t> pending;
+    bool valid {true};
+
+    auto reach = [&](std::size_t to, int d) {
+        if ((to >= code.size()) || (d < 0)) {
+            valid = false;
+        } else if (depth[to] == kUnreached) {
+            depth[to] = d;
+            pending.push_back(to);
+        } else if (depth[to] != d) {
+            valid = false;
+        }
+    };
+
+    reach(0, 0);
+    while (valid && !pending.empty()) {
+        std::size_t i = pending.back(); pending.pop_back();
+        const Instruction& instruction = code[i];
+        int d = depth[i];
+
+        switch (instruction.op) {
+            case Opcode::Exit:
+                valid = (d == 0);
+                break;
+            case Opcode::ToR:
+                reach(i + 1, d + 1);
+                break;
+            case Opcode::RFrom:
+                reach(i + 1, d - 1);
+                break;
+            case Opcode::RFetch:
+            case Opcode::I:
+            case Opcode::IAdd:
+            case Opcode::IndexCell:
+                valid = (d >= 1);
+                reach(i + 1, d);
+                break;
+            case Opcode::J:
+                valid = (d >= 3);
+                reach(i + 1, d);
+                break;
+            case Opcode::Do:
+                reach(i + 1, d + 2);
+                break;
+            case Opcode::QDo:
+                reach(instruction.target, d);
+                reach(i + 1, d + 2);
+                break;
+            case Opcode::Loop:
+            case Opcode::PlusLoop:
+                reach(instruction.target, d);
+                reach(i + 1, d - 2);
+                break;
+            case Opcode::Leave:
+                reach(instruction.target, d - 2);
+                break;
+            case Opcode::Unloop:
+                reach(i + 1, d - 2);
+                break;
+            case Opcode::Branch:
+                reach(instruction.target, d);
+                break;
+            case Opcode::ZeroBranch:
+            case Opcode::NonZeroBranch:
+            case Opcode::DupZeroBranch:
+                reach(instruction.target, d);
+                reach(i + 1, d);
+                break;
+            case Opcode::Does:
+                // entered from the words created, with nothing pushed
+                reach(instruction.target, 0);
+                reach(i + 1, d);
+                break;
+            default:
+                reach(i + 1, d);
+                break;
+        }
+    }
+
+    return valid;
+}
+
+/* insert the stack depth checks in a definition
+ * Args:
+ *  code   : the instructions of the definition
+ *  effect : the stack effect of the definition
+ * Returns:
+ *  The instructions with a single guard at the entry when the effect is
+ *  known, or a guard before every instruction taking values otherwise
+ */
+std::vector<ForthVM::Instruction> ForthVM::insertGuards(const std::vector<Instruction>& code,
+                                                        const StackEffect& effect) const
+{
+    std::vector<Instruction> guarded;
+    std::vector<std::size_t> index(code.size() + 1, 0);
+
+    if (effect.known && (effect.in > 0))
+        guarded.push_back({Opcode::Guard, effect.in});
+
+    for (std::size_t i = 0; i < code.size(); ++i) {
+        // the branches to an instruction land on its guard
+        index[i] = guarded.size();
+
+        int in = effectOf(code[i].op).in;
+        if (!effect.known && (in > 0))
+            guarded.push_back({Opcode::Guard, in});
+
+        guarded.push_back(code[i]);
+    }
+    index[code.size()] = guarded.size();
+
+    for (auto& instruction : guarded) {
+        if (isBranch(instruction.op))
+            instruction.target = index[instruction.target];
+    }
+
+    return guarded;
+}
+
+/* print a user defined word, before and after its optimization
+ * Args:
+ *  name : the name of the word
+ */
+void ForthVM::see(std::string_view name) const
+{
+    auto index = findWord(name);
+    if (!index) {
+        *err_ << "Unknown word [" << name << "]!\n";
+        return;
+    }
+
+    const Word& definition = word(*index);
+    *out_ << ": " << definition.name;
+    if (definition.effect.known)
+        *out_ << " ( " << definition.effect.in << " -- " << definition.effect.out << " )";
+    if (runtime_[*index].native.entry != nullptr)
+        *out_ << " native";
+    *out_ << "\n";
+
+    if (!definition.inlined.empty()) {
+        *out_ << "  inlined:";
+        for (auto callee : definition.inlined)
+            *out_ << " " << word(callee).name;
+        *out_ << "\n";
+    }
+
+    *out_ << "  compiled:\n";
+    disassemble(definition.unoptimized.data(), definition.unoptimized.size());
+    *out_ << "  optimized:\n";
+    disassemble(code_.data() + definition.address, definition.size);
+}
+
+/* print threaded code, one instruction per line
+ * Args:
+ *  code : the first instruction
+ *  size : the number of cells
+ */
+void ForthVM::disassemble(const Cell* code, std::size_t size) const
+{
+    for (std::size_t ip = 0; ip < size; ) {
+        auto op = static_cast<Opcode>(code[ip]);
+        *out_ << "    " << ip << "\t" << nameOf(op);
+
+        if (op == Opcode::Call) {
+            *out_ << " " << word(static_cast<std::size_t>(code[ip + 1])).name;
+        } else if (isBranch(op)) {
+            *out_ << " -> " << static_cast<std::ptrdiff_t>(ip + 1) + code[ip + 1];
+        } else if (op == Opcode::FLiteral) {
+            double value;
+            std::memcpy(&value, code + ip + 1, sizeof(double));
+            *out_ << " " << value;
+        } else if (hasOperand(op)) {
+            *out_ << " " << code[ip + 1];
+        }
+        *out_ << "\n";
+
+        ip += 1 + operandCells(op);
+    }
+}
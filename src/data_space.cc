@@ -0,0 +1,135 @@
+/*
+ * @file    data_space.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Contiguous data space of the virtual machine
+ */
+
+// ----- includes
+#include "data_space.h"
+
+#include <algorithm>
+#include <new>
+
+#include <sys/mman.h>
+
+
+// ----- public implementation
+
+/* constructor, the pages are only backed by memory once written
+ * Args:
+ *  size : the size of the space in bytes, rounded up to whole pages
+ */
+DataSpace::DataSpace(std::size_t size) :
+    capacity_ {std::max<std::size_t>((size + (std::size_t {1} << kPageBits) - 1) >> kPageBits, 1) << kPageBits},
+    dirty_(capacity_ >> kPageBits, 0)
+{
+    void* region = ::mmap(nullptr, capacity(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+        throw std::bad_alloc();
+    data_ = static_cast<std::uint8_t*>(region);
+}
+
+/* destructor
+ */
+/*virtual*/ DataSpace::~DataSpace()
+{
+    ::munmap(data_, capacity());
+}
+
+/* reserve space, or release it with a negative size
+ * Args:
+ *  bytes : the number of bytes
+ * Returns:
+ *  False if the space would go out of the arena
+ */
+bool DataSpace::allot(Cell bytes)
+{
+    // the size released is negated in unsigned cells, the smallest one
+    // included
+    if ((bytes < 0) ? (std::uint64_t {0} - static_cast<std::uint64_t>(bytes) > here_)
+                    : (static_cast<std::size_t>(bytes) > capacity() - here_))
+        return false;
+
+    here_ = static_cast<std::size_t>(static_cast<std::int64_t>(here_) + bytes);
+    high_ = std::max(high_, here_);
+    return true;
+}
+
+// align the next allotment on a cell
+void DataSpace::align()
+{
+    here_ = std::min((here_ + sizeof(Cell) - 1) / sizeof(Cell) * sizeof(Cell), capacity());
+    high_ = std::max(high_, here_);
+}
+
+/* get an array about to be written
+ * Args:
+ *  address : the address of the first byte
+ *  size    : the number of bytes
+ * Returns:
+ *  The first byte of the array
+ */
+std::uint8_t* DataSpace::writable(Cell address, std::size_t size)
+{
+    auto a = static_cast<std::make_unsigned_t<Cell>>(address);
+    if (size > 0) {
+        std::size_t last = a + size - 1;
+        for (std::size_t page = a >> kPageBits; page <= (last >> kPageBits); ++page)
+            touch(page << kPageBits);
+    }
+    return data_ + a;
+}
+
+/* copy the allotted space
+ * Returns:
+ *  The bytes from the start of the space to here
+ */
+std::vector<std::uint8_t> DataSpace::contents() const
+{
+    return {data_, data_ + here_};
+}
+
+/* replace the whole space by an image
+ * Args:
+ *  image : the allotted bytes, the rest is cleared
+ */
+void DataSpace::load(const std::vector<std::uint8_t>& image)
+{
+    std::size_t size = std::min(image.size(), capacity());
+    std::memset(data_, 0, high_);
+    std::memcpy(data_, image.data(), size);
+
+    here_ = size;
+    high_ = size;
+    clean();
+}
+
+/* restore the image the space was loaded with, or cleaned at, by copying
+ * back the pages written since
+ * Args:
+ *  image : the allotted bytes, the rest is cleared
+ */
+void DataSpace::restore(const std::vector<std::uint8_t>& image)
+{
+    std::size_t size = std::min(image.size(), capacity());
+    for (auto page : pages_) {
+        std::size_t start = page << kPageBits;
+        std::size_t end = std::min(start + (std::size_t {1} << kPageBits), capacity());
+
+        std::size_t copied = (size > start) ? std::min(end, size) - start : 0;
+        std::memcpy(data_ + start, image.data() + start, copied);
+        std::memset(data_ + start + copied, 0, end - start - copied);
+    }
+
+    here_ = size;
+    clean();
+}
+
+// take the current contents as the image to restore
+void DataSpace::clean()
+{
+    for (auto page : pages_)
+        dirty_[page] = 0;
+    pages_.clear();
+}
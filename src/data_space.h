@@ -0,0 +1,124 @@
+/*
+ * @file    data_space.h
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Interface / Contiguous data space of the virtual machine
+ */
+
+// ----- header guards
+#ifndef FORTH_DATA_SPACE_H_
+#define FORTH_DATA_SPACE_H_
+
+// ----- includes
+#include "cell.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// ----- bounds checks
+// the accesses are checked against the allotted space, unless the build
+// defines FORTH_UNCHECKED
+#ifdef FORTH_UNCHECKED
+#define FORTH_DATA_CHECKS   false
+#else
+#define FORTH_DATA_CHECKS   true
+#endif
+
+// ----- class
+// fixed size arena, mapped once so that its addresses never move. The
+// addresses are byte offsets from its start. The pages written are
+// tracked, to restore the space to an image in the time of the changes.
+class DataSpace
+{
+public:
+    // default size, in cells so that both cell widths hold the same programs
+    static constexpr std::size_t kDefaultCapacity {(std::size_t {1} << 18) * sizeof(Cell)};
+
+    explicit DataSpace(std::size_t = kDefaultCapacity);
+    virtual ~DataSpace();
+
+    // no copy or move semantics
+    DataSpace(const DataSpace&) = delete;
+    DataSpace& operator=(const DataSpace&) = delete;
+    DataSpace(DataSpace&&) = delete;
+    DataSpace& operator=(DataSpace&&) = delete;
+
+    std::size_t capacity() const { return capacity_; }
+
+    std::size_t here() const { return here_; }
+    bool allot(Cell);
+    void align();
+
+    // cell accesses, at any byte address
+    bool valid(Cell address) const {
+        auto a = static_cast<std::make_unsigned_t<Cell>>(address);
+        return !FORTH_DATA_CHECKS || ((a < here_) && (here_ - a >= sizeof(Cell)));
+    }
+    Cell fetch(Cell address) const {
+        Cell value;
+        std::memcpy(&value, data_ + static_cast<std::make_unsigned_t<Cell>>(address), sizeof(Cell));
+        return value;
+    }
+    void store(Cell address, Cell value) {
+        auto a = static_cast<std::make_unsigned_t<Cell>>(address);
+        std::memcpy(data_ + a, &value, sizeof(Cell));
+        touch(a);
+        touch(a + sizeof(Cell) - 1);
+    }
+
+    // arrays of cells, of doubles or of bytes, checked as a whole
+    bool valid(Cell address, Cell count) const {
+        auto a = static_cast<std::make_unsigned_t<Cell>>(address);
+        auto n = static_cast<std::make_unsigned_t<Cell>>(count);
+        return !FORTH_DATA_CHECKS || (n == 0) || ((a < here_) && ((here_ - a) / sizeof(Cell) >= n));
+    }
+    bool validReals(Cell address, Cell count) const {
+        auto a = static_cast<std::make_unsigned_t<Cell>>(address);
+        auto n = static_cast<std::make_unsigned_t<Cell>>(count);
+        return !FORTH_DATA_CHECKS || (n == 0) || ((a < here_) && ((here_ - a) / sizeof(double) >= n));
+    }
+    const std::uint8_t* bytes(Cell address) const {
+        return data_ + static_cast<std::make_unsigned_t<Cell>>(address);
+    }
+    bool validBytes(Cell address, Cell size) const {
+        auto a = static_cast<std::make_unsigned_t<Cell>>(address);
+        auto n = static_cast<std::make_unsigned_t<Cell>>(size);
+        return !FORTH_DATA_CHECKS || (n == 0) || ((a < here_) && (here_ - a >= n));
+    }
+    std::uint8_t* writable(Cell, std::size_t);
+
+    // images of the allotted space
+    std::vector<std::uint8_t> contents() const;
+    void load(const std::vector<std::uint8_t>&);
+    void restore(const std::vector<std::uint8_t>&);
+    void clean();
+    bool changed() const { return !pages_.empty(); }
+
+private:
+    void touch(std::size_t address) {
+        // the unchecked builds may write out of the space, never out of
+        // the table of the pages
+        std::size_t page = address >> kPageBits;
+        if ((page < dirty_.size()) && !dirty_[page]) {
+            dirty_[page] = 1;
+            pages_.push_back(page);
+        }
+    }
+
+private:
+    static constexpr std::size_t kPageBits {12};
+
+    std::size_t capacity_ {0};          // bytes, a whole number of pages
+    std::uint8_t* data_ {nullptr};
+    std::size_t here_ {0};
+    std::size_t high_ {0};              // highest here, the space above is zero
+
+    // pages written since the last image
+    std::vector<std::uint8_t> dirty_ {};
+    std::vector<std::size_t> pages_ {};
+};
+
+#endif // FORTH_DATA_SPACE_H_
@@ -7,59 +7,185 @@
 
 // ----- includes
 #include "forth_vm.h"
+#include "mapped_file.h"
 
-#include <sstream>
-#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 
+// ----- constants
+namespace {
 
-// ----- public implementation
+// calls of a word before it is translated to native code
+constexpr std::size_t kJitThreshold {1000};
+
+// data space of a new virtual machine: BASE, in decimal
+const std::vector<std::uint8_t>& initialData()
+{
+    static const std::vector<std::uint8_t> data = []() {
+        std::vector<std::uint8_t> cells(sizeof(Cell));
+        Cell base {10};
+        std::memcpy(cells.data(), &base, sizeof(Cell));
+        return cells;
+    }();
+    return data;
+}
 
-// constructor
-ForthVM::ForthVM()
-{
-    // arithmetic operators
-    functions_["+"] = [this]() { if (shouldExecute()) binaryOperator(std::plus<>()); };
-    functions_["-"] = [this]() { if (shouldExecute()) binaryOperator(std::minus<>()); };
-    functions_["*"] = [this]() { if (shouldExecute()) binaryOperator(std::multiplies<>()); };
-    functions_["/"] = [this]() { if (shouldExecute()) binaryOperator(std::divides<>()); };
-    functions_["MOD"] = [this]() { if (shouldExecute()) binaryOperator(std::modulus<>()); };
-    functions_["NEGATE"] = [this]() { if (shouldExecute()) unaryOperator(std::negate<>()); };
-
-    // comparison operators
-    functions_[">"] = [this]() { if (shouldExecute()) binaryOperator(std::greater<>()); };
-    functions_["<"] = [this]() { if (shouldExecute()) binaryOperator(std::less<>()); };
-    functions_["="] = [this]() { if (shouldExecute()) binaryOperator(std::equal_to<>()); };
-    functions_["<>"] = [this]() { if (shouldExecute()) binaryOperator(std::not_equal_to<>()); };
-
-    functions_["0="] = [this]() { if (shouldExecute()) zeroCompare(ZeroCompFcn::Equal); };
-    functions_["0<"] = [this]() { if (shouldExecute()) zeroCompare(ZeroCompFcn::Lesser); };
-    functions_["0>"] = [this]() { if (shouldExecute()) zeroCompare(ZeroCompFcn::Greater); };
-    functions_["0<>"] = [this]() { if (shouldExecute()) zeroCompare(ZeroCompFcn::Not_Equal); };
-
-    // stack manipulation
-    functions_["DUP"] = [this]() { if (shouldExecute()) dup(); };
-    functions_["DROP"] = [this]() { if (shouldExecute()) drop(); };
-    functions_["SWAP"] = [this]() { if (shouldExecute()) swap(); };
-
-    // bitwise operators
-    functions_["AND"] = [this]() { if (shouldExecute()) binaryOperator(std::bit_and<>()); };
-    functions_["OR"] = [this]() { if (shouldExecute()) binaryOperator(std::bit_or<>()); };
-    functions_["XOR"] = [this]() { if (shouldExecute()) binaryOperator(std::bit_xor<>()); };
-    functions_["NOT"] = [this]() { if (shouldExecute()) unaryOperator(std::bit_not<>()); };
-
-    // stack display
-    functions_["."] = [this]() { if (shouldExecute()) display(DisplayFcn::Top); };
-    functions_["EMIT"] = [this]() { if (shouldExecute()) display(DisplayFcn::Emit); };
-    functions_["CR"] = [this]() { if (shouldExecute()) std::cout << "\n"; };
+}
+
+// ----- public implementation
 
+/* constructor
+ * Args:
+ *  capacity : the size of the data space in bytes
+ */
+ForthVM::ForthVM(std::size_t capacity) :
+    data_ {capacity}
+{
     // control flow
-    functions_["IF"] = [this]() { processIf(); };
-    functions_["ELSE"] = [this]() { processElse(); };
-    functions_["THEN"] = [this]() { processThen(); };
+    immediates_["IF"] = [this]() { if (definefn_) compileIf(); else processIf(); };
+    immediates_["ELSE"] = [this]() { if (definefn_) compileElse(); else processElse(); };
+    immediates_["THEN"] = [this]() { if (definefn_) compileThen(); else processThen(); };
+    immediates_["EXIT"] = [this]() { if (isCompiling("EXIT")) emit(Opcode::Exit); };
+
+    // loops
+    immediates_["DO"] = [this]() { if (isCompiling("DO")) compileDo(Opcode::Do); };
+    immediates_["?DO"] = [this]() { if (isCompiling("?DO")) compileDo(Opcode::QDo); };
+    immediates_["LOOP"] = [this]() { if (isCompiling("LOOP")) compileLoop(Opcode::Loop); };
+    immediates_["+LOOP"] = [this]() { if (isCompiling("+LOOP")) compileLoop(Opcode::PlusLoop); };
+    immediates_["LEAVE"] = [this]() { if (isCompiling("LEAVE")) compileLeave(); };
+    immediates_["UNLOOP"] = [this]() { if (isCompiling("UNLOOP")) compileLoopWord(Opcode::Unloop, "UNLOOP", 1); };
+    immediates_["I"] = [this]() { if (isCompiling("I")) compileLoopWord(Opcode::I, "I", 1); };
+    immediates_["J"] = [this]() { if (isCompiling("J")) compileLoopWord(Opcode::J, "J", 2); };
+
+    immediates_["BEGIN"] = [this]() { if (isCompiling("BEGIN")) compileBegin(); };
+    immediates_["UNTIL"] = [this]() { if (isCompiling("UNTIL")) compileUntil(Opcode::ZeroBranch); };
+    immediates_["AGAIN"] = [this]() { if (isCompiling("AGAIN")) compileUntil(Opcode::Branch); };
+    immediates_["WHILE"] = [this]() { if (isCompiling("WHILE")) compileWhile(); };
+    immediates_["REPEAT"] = [this]() { if (isCompiling("REPEAT")) compileRepeat(); };
+
+    // return stack
+    immediates_[">R"] = [this]() { if (isCompiling(">R")) emit(Opcode::ToR); };
+    immediates_["R>"] = [this]() { if (isCompiling("R>")) emit(Opcode::RFrom); };
+    immediates_["R@"] = [this]() { if (isCompiling("R@")) emit(Opcode::RFetch); };
 
     // word definition
-    functions_[":"] = [this]() { beginDefinition(); };
-    functions_[";"] = [this]() { endDefinition(); };
+    immediates_[":"] = [this]() {
+        // a definition in a skipped branch is skipped up to its semicolon
+        if (definefn_ || shouldExecute())
+            beginDefinition();
+        else
+            skip_definition_ = true;
+    };
+    immediates_[";"] = [this]() { endDefinition(); };
+
+    // data space
+    immediates_["VARIABLE"] = [this]() { if (auto name = definedName("VARIABLE")) variable(*name); };
+    immediates_["CONSTANT"] = [this]() { if (auto name = definedName("CONSTANT")) constant(*name); };
+    immediates_["CREATE"] = [this]() {
+        if (definefn_)
+            emit(Opcode::Create);
+        else if (auto name = definedName("CREATE"))
+            create(*name);
+    };
+    immediates_["DOES>"] = [this]() {
+        if (isCompiling("DOES>")) {
+            // the words created run the code after the EXIT
+            emit(Opcode::Does, 0);
+            std::size_t operand = code_.size() - 1;
+            emit(Opcode::Exit);
+            resolve(operand);
+        }
+    };
+
+    // strings, kept in the data space once compiled
+    immediates_[".\""] = [this]() {
+        auto text = parseString();
+        if (!text)
+            return;
+        if (!definefn_) {
+            if (shouldExecute())
+                output_.write(*text);
+        } else if (auto address = storeString(*text)) {
+            emit(Opcode::Literal, *address);
+            emit(Opcode::Literal, static_cast<Cell>(text->size()));
+            emit(Opcode::Type);
+        }
+    };
+    immediates_["S\""] = [this]() {
+        auto text = parseString();
+        if (!text || (!definefn_ && !shouldExecute()))
+            return;
+        if (auto address = storeString(*text)) {
+            if (definefn_) {
+                emit(Opcode::Literal, *address);
+                emit(Opcode::Literal, static_cast<Cell>(text->size()));
+            } else {
+                stack_.push_back(*address);
+                stack_.push_back(static_cast<Cell>(text->size()));
+            }
+        }
+    };
+
+    // execution tokens
+    immediates_["'"] = [this]() { if (auto name = tokenizer_.next()) tick(*name); };
+
+    // debugging, tools and files: their name is parsed even in a skipped
+    // branch, so that it is skipped too
+    immediates_["SEE"] = [this]() {
+        if (auto name = tokenizer_.next(); name && shouldExecute()) {
+            output_.flush();
+            see(*name);
+        }
+    };
+
+    // profiling
+    immediates_["PROFILE-ON"] = [this]() {
+        if (shouldExecute() && isAvailable("PROFILE-ON"))
+            profiler_.enable(true);
+    };
+    immediates_["PROFILE-OFF"] = [this]() {
+        if (shouldExecute() && isAvailable("PROFILE-OFF"))
+            profiler_.enable(false);
+    };
+
+    // tracing
+    immediates_["TRACE-DUMP"] = [this]() {
+        if (auto name = tokenizer_.next(); name && shouldExecute() && isAvailable("TRACE-DUMP"))
+            writeTrace(std::string(*name));
+    };
+
+    // images
+    immediates_["SAVE-IMAGE"] = [this]() {
+        if (definefn_)
+            error() << "Error: SAVE-IMAGE is not valid in a definition!\n";
+        else if (auto name = tokenizer_.next(); name && shouldExecute() && isAvailable("SAVE-IMAGE"))
+            saveImage(std::string(*name));
+    };
+
+    // native code, where the generator is available
+    if (Jit::isSupported())
+        jit_threshold_ = kJitThreshold;
+
+    data_.load(initialData());
+}
+
+/* constructor, on top of a prelude shared with other virtual machines
+ * Args:
+ *  prelude  : the words compiled once, read only
+ *  capacity : the size of the data space in bytes, without a prelude
+ */
+ForthVM::ForthVM(PreludePtr_T prelude, std::size_t capacity) :
+    ForthVM(prelude ? prelude->capacity : capacity)
+{
+    prelude_ = std::move(prelude);
+    if (prelude_) {
+        prelude_words_ = prelude_->words.size();
+        prelude_cells_ = prelude_->code.size();
+        code_ = prelude_->code;
+        data_.load(prelude_->data);
+    }
+    runtime_.resize(prelude_words_);
 }
 
 // destructor
@@ -69,51 +195,67 @@ ForthVM::ForthVM()
 
 /* Execute the interpreter on the input line
  * Args:
- *  input (std::string) : the input from the user
+ *  input (std::string_view) : the input from the user
  */
-void ForthVM::run(const std::string& input)
+void ForthVM::run(std::string_view input)
 {
-    std::istringstream stream(input);
-    std::string token;
-    bool in_comment {false};
+    tokenizer_.parse(input);
 
-    while( stream >> token)
+    // a comment, or an abandoned definition, may continue from the
+    // previous input
+    if (in_comment_ && tokenizer_.parseUntil(')'))
+        in_comment_ = false;
+
+    while (auto next = tokenizer_.next())
     {
-        if (in_comment) {
-            // end of a comment
-            if (token.find(')') != std::string::npos) {
-                in_comment = false;
-            }
-            continue;
-        }
+        std::string_view token {*next};
 
-        // start of a comment
+        // start of a comment, up to the closing parenthesis
         if (token == "(") {
-            in_comment = true;
+            in_comment_ = !tokenizer_.parseUntil(')');
             continue;
         }
 
-        // line comment, stop processing here
+        // line comment, skip the rest of the line
         if (token == "\\") {
-            break;
+            tokenizer_.skipLine();
+            continue;
         }
 
-        if ((definefn_) && (token != ";")) {            // user defined function definition
-            if (fnname_.length() == 0) {
-                fnname_ = {token};
-            } else {
-                userfn_[fnname_].push_back(token);
-            }
-        } else if (functions_.contains(token)) {        // reserved keyword
-                functions_[token]();
-        } else if (isNumber(token) && shouldExecute()) {                   // token is a number
-            stack_.push_back(std::stoi(token));
-        } else if (userfn_.contains(token) && shouldExecute()) {           // user defined function
-            runDefinition(token);
-        } else if (shouldExecute()) {
-            std::cerr << "Unknown word [" << token << "]!\n";
+        // rest of an abandoned definition, up to its semicolon
+        if (skip_definition_) {
+            skip_definition_ = (token != ";");
+            continue;
+        }
+
+        if ((definefn_) && (fnname_.length() == 0)) {  // user defined function name
+            fnname_ = std::string(token);
+            fnstart_ = code_.size();
+            continue;
+        }
+
+        if (auto imm = immediates_.find(token); imm != immediates_.end()) {    // immediate word
+            imm->second();
+        } else if (definefn_) {                         // user defined function definition
+            compile(token);
+        } else if (!shouldExecute()) {                  // skipped by a condition
+            continue;
+        } else if (auto fn = functions_.find(token); fn != functions_.end()) {    // reserved keyword
+            executeBuiltin(fn->second);
+        } else if (auto user = findWord(token)) {       // user defined function
+            callWord(*user);
+        } else if (auto number = parseNumber(token)) {  // token is a number
+            stack_.push_back(*number);
+        } else if (auto real = parseReal(token)) {      // token is a float
+            fstack_.push_back(*real);
+        } else {
+            error() << "Unknown word [" << token << "]!\n";
+            FORTH_TRACE_EVENT(trace_, TraceEvent::Error, static_cast<std::uint32_t>(TraceError::UnknownWord),
+                              stack_.size());
         }
     }
+
+    output_.flush();
 }
 
 /* Load a program from a file
@@ -122,92 +264,618 @@ void ForthVM::run(const std::string& input)
  */
 void ForthVM::load(const std::string& filename)
 {
-    // open the file for reading
-    std::ifstream file {filename};
-    if (!file) {
-        std::cerr << "Error: unable to load the file [" << filename << "]\n";
+    // map the whole file in memory
+    MappedFile file {filename};
+    if (!file.isOpen()) {
+        error() << "Error: unable to load the file [" << filename << "]\n";
+        return;
+    }
+
+    // and run it in a single scan, then let the tasks it started end
+    run(file.data());
+    runTasks();
+}
+
+/* Freeze the words defined so far, the prelude included, into a prelude
+ * for other virtual machines
+ * Returns:
+ *  The new prelude
+ */
+ForthVM::PreludePtr_T ForthVM::freeze() const
+{
+    auto prelude = std::make_shared<Prelude>();
+
+    // the word indexes already span both parts, the code space holds both
+    prelude->code = code_;
+    prelude->data = data_.contents();
+    prelude->capacity = data_.capacity();
+    for (std::size_t i = 0; i < wordCount(); ++i)
+        prelude->words.push_back(word(i));
+
+    if (prelude_)
+        prelude->userfn = prelude_->userfn;
+    for (const auto& [name, index] : userfn_)
+        prelude->userfn[name] = index;
+
+    return prelude;
+}
+
+/* Forget everything but the prelude, to run another program: the stacks
+ * and the local words. The prelude words keep their native code.
+ */
+void ForthVM::reset()
+{
+    rewind();
+
+    stack_.clear();
+    fstack_.clear();
+    cond_stack_ = { };
+    cond_skipped_ = 0;
+}
+
+/* Take a snapshot of the virtual machine. Its words are frozen into a
+ * prelude, that the machine runs on from now on, and the stacks copied.
+ * Returns:
+ *  The snapshot, none in the middle of a definition
+ */
+ForthVM::SnapshotPtr_T ForthVM::snapshot()
+{
+    if (definefn_) {
+        error() << "Error: unable to take a snapshot in a definition!\n";
+        return nullptr;
+    }
+
+    auto state = std::make_shared<Snapshot>();
+    bool unchanged = (code_.size() == prelude_cells_) && dictionary_.empty() && !data_.changed() &&
+                     (data_.here() == (prelude_ ? prelude_->data : initialData()).size());
+    state->prelude = unchanged ? prelude_ : freeze();
+    state->capacity = data_.capacity();
+    state->stack = stack_;
+    state->fstack = fstack_;
+    state->cond_stack = cond_stack_;
+    state->cond_skipped = cond_skipped_;
+
+    // the local words keep their index and address in the new prelude, so
+    // their run time state stays valid
+    prelude_ = state->prelude;
+    prelude_words_ = prelude_ ? prelude_->words.size() : 0;
+    prelude_cells_ = code_.size();
+    dictionary_.clear();
+    userfn_.clear();
+    last_created_.reset();
+    data_.clean();
+
+    return state;
+}
+
+/* Restore a snapshot, the cost is the one of the words defined and the
+ * stack cells since then: the words of the snapshot are shared, not copied
+ * Args:
+ *  state (Snapshot) : the snapshot to restore
+ */
+void ForthVM::restore(const Snapshot& state)
+{
+    // on another prelude, none of the native code applies
+    if (state.prelude != prelude_) {
+        jit_.release();
+        runtime_.clear();
+        prelude_ = state.prelude;
+        prelude_words_ = prelude_ ? prelude_->words.size() : 0;
+        prelude_cells_ = prelude_ ? prelude_->code.size() : 0;
+        code_ = prelude_ ? prelude_->code : std::vector<Cell> {};
+        data_.load(prelude_ ? prelude_->data : initialData());
+    }
+
+    rewind();
+
+    stack_ = state.stack;
+    fstack_ = state.fstack;
+    cond_stack_ = state.cond_stack;
+    cond_skipped_ = state.cond_skipped;
+}
+
+/* Get the data stack, from the bottom to the top
+ * Returns:
+ *  The cells of the stack
+ */
+const std::vector<Cell>& ForthVM::stack() const
+{
+    return stack_;
+}
+
+/* Redirect the output of the words and the errors
+ * Args:
+ *  out (std::ostream) : the output of the words
+ *  err (std::ostream) : the error messages
+ */
+void ForthVM::setOutput(std::ostream& out, std::ostream& err)
+{
+    out_ = &out;
+    err_ = &err;
+    output_.setStream(out);
+}
+
+/* Set the number of calls after which a word is translated to native code
+ * Args:
+ *  threshold (std::size_t) : the number of calls, 0 to keep every word
+ *                            in the interpreter
+ */
+void ForthVM::setJitThreshold(std::size_t threshold)
+{
+    jit_threshold_ = Jit::isSupported() ? threshold : 0;
+}
+
+/* Refuse the words reaching the files and the console: SAVE-IMAGE,
+ * TRACE-DUMP, PROFILE-ON/OFF and KEY, and bound the depth of the stacks
+ * and the number of tasks
+ * Args:
+ *  enabled (bool) : true for the programs that are not trusted
+ */
+void ForthVM::setSandbox(bool enabled)
+{
+    sandbox_ = enabled;
+}
+
+/* Stop the program running, from another thread: its loops and calls
+ * fail until clearInterrupt() is called
+ */
+void ForthVM::interrupt()
+{
+    interrupted_.store(true, std::memory_order_relaxed);
+}
+
+// let the next programs run after an interrupt
+void ForthVM::clearInterrupt()
+{
+    interrupted_.store(false, std::memory_order_relaxed);
+}
+
+/* Start or stop the profiling of the executions
+ * Args:
+ *  enabled (bool) : true to record the executions
+ */
+void ForthVM::setProfiling(bool enabled)
+{
+    profiler_.enable(enabled);
+}
+
+/* Print the profile recorded, if any, to the standard error
+ * Args:
+ *  stacks (std::string) : a file receiving the collapsed call stacks for
+ *                         the flame graph tools, empty for none
+ */
+void ForthVM::writeProfile(const std::string& stacks) const
+{
+    if (profiler_.empty())
         return;
+
+    // builtins are named after their word, the other opcodes after themselves
+    std::vector<std::string> opcodes;
+    for (const char* name : kOpcodeNames)
+        opcodes.push_back(std::string("(") + name + ")");
+    for (const auto& [name, op] : builtins())
+        opcodes[static_cast<std::size_t>(op)] = name;
+
+    std::vector<std::string> words;
+    for (std::size_t i = 0; i < wordCount(); ++i)
+        words.push_back(word(i).name);
+
+    profiler_.report(*err_, opcodes, words);
+    if (!stacks.empty() && !profiler_.writeCollapsed(stacks, words))
+        *err_ << "Error: unable to write the profile [" << stacks << "]\n";
+}
+
+/* Write the events traced, in the Chrome trace event format
+ * Args:
+ *  filename (std::string) : the JSON file to write
+ * Returns:
+ *  True if the trace has been written
+ */
+bool ForthVM::writeTrace(const std::string& filename) const
+{
+    if (!TraceBuffer::isEnabled()) {
+        *err_ << "Error: tracing is not compiled in, build with TRACE=1\n";
+        return false;
     }
 
-    // read the file line by line
-    std::string line;
-    while(std::getline(file, line)) {
-        run(line);
+    std::vector<std::string> words;
+    for (std::size_t i = 0; i < wordCount(); ++i)
+        words.push_back(word(i).name);
+
+    if (!trace_.writeChromeTrace(filename, words)) {
+        *err_ << "Error: unable to write the trace [" << filename << "]\n";
+        return false;
     }
+
+    return true;
 }
 
 
 // ----- private implementation
 
+/* table of the builtins run by the inner interpreter, built once and
+ * shared by every virtual machine
+ */
+const WordMap_T<Opcode>& ForthVM::builtins()
+{
+    static const WordMap_T<Opcode> table {
+        // arithmetic operators
+        {"+", Opcode::Add},
+        {"-", Opcode::Sub},
+        {"*", Opcode::Mul},
+        {"/", Opcode::Div},
+        {"MOD", Opcode::Mod},
+        {"NEGATE", Opcode::Negate},
+        {"M*", Opcode::MStar},
+        {"UM*", Opcode::UMStar},
+        {"UM/MOD", Opcode::UMSlashMod},
+        {"*/", Opcode::StarSlash},
+        {"S>D", Opcode::SToD},
+        {"D+", Opcode::DAdd},
+        {"DNEGATE", Opcode::DNegate},
+        {"D.", Opcode::DDot},
+
+        // comparison operators
+        {">", Opcode::Greater},
+        {"<", Opcode::Lesser},
+        {"=", Opcode::Equal},
+        {"<>", Opcode::NotEqual},
+
+        {"0=", Opcode::ZeroEqual},
+        {"0<", Opcode::ZeroLesser},
+        {"0>", Opcode::ZeroGreater},
+        {"0<>", Opcode::ZeroNotEqual},
+
+        // stack manipulation
+        {"DUP", Opcode::Dup},
+        {"DROP", Opcode::Drop},
+        {"SWAP", Opcode::Swap},
+        {"OVER", Opcode::Over},
+        {"ROT", Opcode::Rot},
+
+        // bitwise operators
+        {"AND", Opcode::And},
+        {"OR", Opcode::Or},
+        {"XOR", Opcode::Xor},
+        {"NOT", Opcode::Not},
+
+        // stack display
+        {".", Opcode::Dot},
+        {"EMIT", Opcode::Emit},
+        {"CR", Opcode::Cr},
+        {"TYPE", Opcode::Type},
+        {"FLUSH", Opcode::Flush},
+
+        // tasks
+        {"EXECUTE", Opcode::Execute},
+        {"SPAWN", Opcode::Spawn},
+        {"PAUSE", Opcode::Pause},
+        {"KEY", Opcode::Key},
+
+        // data space
+        {"@", Opcode::Fetch},
+        {"!", Opcode::Store},
+        {"+!", Opcode::PlusStore},
+        {"HERE", Opcode::Here},
+        {"ALLOT", Opcode::Allot},
+        {",", Opcode::Comma},
+        {"CELLS", Opcode::Cells},
+        {"BASE", Opcode::Base},
+        {"HEX", Opcode::Hex},
+        {"DECIMAL", Opcode::Decimal},
+
+        // vector words
+        {"VFILL", Opcode::VFill},
+        {"VADD", Opcode::VAdd},
+        {"VMUL", Opcode::VMul},
+        {"VSUM", Opcode::VSum},
+        {"VMIN", Opcode::VMin},
+        {"VMAX", Opcode::VMax},
+        {"VDOT", Opcode::VDot},
+        {"VCOUNT=", Opcode::VCountEq},
+        {"F+", Opcode::FAdd},
+        {"F-", Opcode::FSub},
+        {"F*", Opcode::FMul},
+        {"F/", Opcode::FDiv},
+        {"F*+", Opcode::FMulAdd},
+        {"FSQRT", Opcode::FSqrt},
+        {"FLOOR", Opcode::FFloor},
+        {"FDUP", Opcode::FDup},
+        {"FDROP", Opcode::FDrop},
+        {"FSWAP", Opcode::FSwap},
+        {"F.", Opcode::FDot},
+        {"S>F", Opcode::SToF},
+        {"F>S", Opcode::FToS},
+        {"F@", Opcode::FFetch},
+        {"F!", Opcode::FStore},
+        {"FLOATS", Opcode::Floats},
+        {"FV*", Opcode::FVMul},
+        {"FVSUM", Opcode::FVSum},
+    };
+
+    return table;
+}
+
+// drop the local words, their data, the definition in progress and the
+// return stack
+void ForthVM::rewind()
+{
+    tokenizer_.parse({});
+    in_comment_ = false;
+    skip_definition_ = false;
+    rstack_.clear();
+
+    code_.resize(prelude_cells_);
+    dictionary_.clear();
+    userfn_.clear();
+    fnname_ = { };
+    fnstart_ = 0;
+    definefn_ = false;
+    control_.clear();
+    leaves_.clear();
+
+    for (std::size_t i = prelude_words_; i < runtime_.size(); ++i) {
+        if (runtime_[i].native.entry != nullptr)
+            jit_.release(runtime_[i].native.entry);
+    }
+    runtime_.resize(prelude_words_);
+
+    // only the pages written since are copied back
+    data_.restore(prelude_ ? prelude_->data : initialData());
+    last_created_.reset();
+
+    tasks_.clear();
+    in_task_ = false;
+    paused_.reset();
+}
+
+/* look a user defined word up, the local words hide the prelude ones
+ * Args:
+ *  name : the name of the word
+ * Returns:
+ *  The index of the word, if any
+ */
+std::optional<std::size_t> ForthVM::findWord(std::string_view name) const
+{
+    if (auto user = userfn_.find(name); user != userfn_.end())
+        return user->second;
+
+    if (prelude_) {
+        if (auto user = prelude_->userfn.find(name); user != prelude_->userfn.end())
+            return user->second;
+    }
+
+    return std::nullopt;
+}
+
 // duplicate the top of the stack
 void ForthVM::dup()
 {
-    if (!stack_.empty())
-        stack_.push_back(stack_.back());
+    stack_.push_back(stack_.back());
 }
 
 // drop the top of the stack
 void ForthVM::drop()
 {
-    if (!stack_.empty())
-        stack_.pop_back();
+    stack_.pop_back();
 }
 
 // swap the top and the level below
 void ForthVM::swap()
 {
     std::size_t s = stack_.size();
-    if (s < 2)
-        return;
     std::swap(stack_[s - 1], stack_[s - 2]);
 }
 
-/* is the string a number
+// copy the second value of the stack on top
+void ForthVM::over()
+{
+    std::size_t s = stack_.size();
+    stack_.push_back(stack_[s - 2]);
+}
+
+// rotate the third value of the stack to the top
+void ForthVM::rot()
+{
+    std::rotate(stack_.end() - 3, stack_.end() - 2, stack_.end());
+}
+
+/* parse a number, in the current base or the base of its prefix: $ for
+ * hexadecimal, # for decimal and % for binary
  * Args:
- *  input (str::string_view) : the input token
- * Returns
- *  True if the string is a number
+ *  token : the input token
+ * Returns:
+ *  The number, none if the whole token is not a number. The values out of
+ *  the signed range wrap around, as $FFFFFFFF for -1.
  */
-bool ForthVM::isNumber(std::string_view token)
+std::optional<Cell> ForthVM::parseNumber(std::string_view token) const
 {
-    if (token.empty())
-        return false;
+    int radix = base();
+    const char* first = token.data();
+    const char* last = token.data() + token.size();
+
+    // the sign goes before or after the prefix
+    bool negative = (first != last) && (*first == '-');
+    if (negative)
+        ++first;
 
-    // check only the first digit (lazy evaluation)
-    if (std::isdigit(token[0]))
-        return true;
+    if (first != last) {
+        switch (*first) {
+            case '$': radix = 16; ++first; break;
+            case '#': radix = 10; ++first; break;
+            case '%': radix = 2; ++first; break;
+            default: break;
+        }
+    }
+
+    if (!negative && (first != last) && (*first == '-')) {
+        negative = true;
+        ++first;
+    }
+
+    // from_chars takes no sign for an unsigned value, nor any prefix
+    std::make_unsigned_t<Cell> value {0};
+    auto [end, error] = std::from_chars(first, last, value, radix);
+    if ((error != std::errc {}) || (end != last) || (first == last))
+        return std::nullopt;
+
+    // the unsigned range is accepted, the negative numbers stop at the
+    // smallest cell
+    constexpr auto kLargestNegative = static_cast<std::make_unsigned_t<Cell>>(std::numeric_limits<Cell>::max()) + 1;
+    if (negative && (value > kLargestNegative))
+        return std::nullopt;
+
+    return static_cast<Cell>(negative ? (0 - value) : value);
+}
+
+/* parse a floating point number, always decimal. A token is a float
+ * when it has an exponent, such as 2E3 or the standard 1e and 1.5e with
+ * an empty exponent, or as a shortcut a decimal point, such as 1.5: there
+ * are no double cell literals.
+ * Args:
+ *  token : the input token
+ * Returns:
+ *  The number, none if the whole token is not a float
+ */
+std::optional<double> ForthVM::parseReal(std::string_view token) const
+{
+    if (token.find_first_of(".eE") == std::string_view::npos)
+        return std::nullopt;
 
-    // special case for negative numbers
-    if ((token[0] == '-') && (token.size() > 1) && (std::isdigit(token[1])))
-        return true;
+    // an empty exponent is a zero exponent
+    std::string padded;
+    if ((token.back() == 'e') || (token.back() == 'E')) {
+        padded = std::string {token} + '0';
+        token = padded;
+    }
+
+    double value {0.0};
+    auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if ((error != std::errc {}) || (end != token.data() + token.size()))
+        return std::nullopt;
+
+    return value;
+}
 
-    return false;
+/* the current base of the numbers
+ * Returns:
+ *  The value of BASE, 10 when it is out of the range 2..36
+ */
+int ForthVM::base() const
+{
+    Cell radix = data_.fetch(kBaseAddress);
+    return ((radix >= 2) && (radix <= 36)) ? radix : 10;
 }
 
 // begin a user defined function definition
 void ForthVM::beginDefinition()
 {
+    // the definition still open is dropped, the new one starts here
+    if (definefn_) {
+        error() << "Error: nested definition in definition of [" << fnname_ << "]!\n";
+        abandonDefinition();
+        skip_definition_ = false;
+    }
+
     definefn_ = true;
     fnname_ = { };
+    control_.clear();
+    leaves_.clear();
 }
 
 // end a user defined function definition
 void ForthVM::endDefinition()
 {
+    if (!control_.empty()) {
+        error() << "Error: unterminated control structure in definition of [" << fnname_ << "]!\n";
+        abandonDefinition();
+
+        // the semicolon closing it has been read already
+        skip_definition_ = false;
+        return;
+    }
+
+    // register the word only once its code is complete
+    if (definefn_ && (fnname_.length() > 0)) {
+        emit(Opcode::Exit);
+        finalizeDefinition();
+    }
+
+    definefn_ = false;
+    fnname_ = { };
+}
+
+// abandon the current definition and discard its code, the rest of it is
+// skipped up to its semicolon
+void ForthVM::abandonDefinition()
+{
+    if (fnname_.length() > 0)
+        code_.resize(fnstart_);
+
+    skip_definition_ = true;
     definefn_ = false;
     fnname_ = { };
+    control_.clear();
+    leaves_.clear();
 }
 
-/* execute a user defined functions
+/* compile a token into the current user defined function
  * Args:
- *  token: the user defined token/function name
+ *  token (std::string_view) : the token to compile
+ * Returns:
+ *  True if the token has been compiled, false if the definition was abandoned
  */
-void ForthVM::runDefinition(const std::string& fnname)
+bool ForthVM::compile(std::string_view token)
 {
-    // go through all the words in the definition and execute them
-    for(const auto& cmd : userfn_[fnname]) {
-        run(cmd);
+    if (auto fn = functions_.find(token); fn != functions_.end()) {     // reserved keyword
+        emit(fn->second);
+    } else if (token == fnname_) {                      // recursive call
+        emit(Opcode::Call, static_cast<Cell>(wordCount()));
+    } else if (auto user = findWord(token)) {           // user defined function
+        emit(Opcode::Call, static_cast<Cell>(*user));
+    } else if (auto number = parseNumber(token)) {      // literal
+        emit(Opcode::Literal, *number);
+    } else if (auto real = parseReal(token)) {          // float literal
+        emitReal(*real);
+    } else {
+        error() << "Unknown word [" << token << "] in definition of [" << fnname_ << "]!\n";
+        abandonDefinition();
+        return false;
     }
+
+    return true;
+}
+
+// append an instruction to the code space
+void ForthVM::emit(Opcode op)
+{
+    code_.push_back(static_cast<Cell>(op));
+}
+
+// append an instruction and its operand to the code space
+void ForthVM::emit(Opcode op, Cell operand)
+{
+    code_.push_back(static_cast<Cell>(op));
+    code_.push_back(operand);
+}
+
+// append a float literal to the code space, its double in the next cells
+void ForthVM::emitReal(double value)
+{
+    Cell cells[kRealCells];
+    std::memcpy(cells, &value, sizeof(double));
+
+    code_.push_back(static_cast<Cell>(Opcode::FLiteral));
+    code_.insert(code_.end(), std::begin(cells), std::end(cells));
+}
+
+/* resolve a forward branch to the end of the code space
+ * Args:
+ *  address : the address of the branch operand
+ */
+void ForthVM::resolve(std::size_t address)
+{
+    code_[address] = static_cast<Cell>(code_.size() - address);
 }
 
 // check if the next instruction should be executed
@@ -219,13 +887,20 @@ bool ForthVM::shouldExecute()
 // process IF
 void ForthVM::processIf()
 {
+    // nested in a skipped branch, only keep track of the nesting
+    if (!shouldExecute()) {
+        cond_skipped_++;
+        return;
+    }
+
     if (stack_.empty()) {
-        std::cerr << "Error: stack is empty!\n";
+        error() << "Error: stack is empty!\n";
+        FORTH_TRACE_EVENT(trace_, TraceEvent::Error, static_cast<std::uint32_t>(TraceError::StackUnderflow), 0);
         return;
     }
 
     // retrieve the top value on the stack
-    int condition = stack_.back(); stack_.pop_back();
+    Cell condition = stack_.back(); stack_.pop_back();
 
     // set the execution and condition stack
     cond_stack_.push(condition == 0);
@@ -234,8 +909,13 @@ void ForthVM::processIf()
 // process Else
 void ForthVM::processElse()
 {
+    if (cond_skipped_ > 0)
+        return;
+
     if (cond_stack_.empty()) {
-        std::cerr << "Error: ELSE without an IF\n";
+        error() << "Error: ELSE without an IF\n";
+        FORTH_TRACE_EVENT(trace_, TraceEvent::Error, static_cast<std::uint32_t>(TraceError::ControlMismatch),
+                          stack_.size());
         return;
     }
     // inverse the condition
@@ -245,57 +925,446 @@ void ForthVM::processElse()
 // process Then
 void ForthVM::processThen()
 {
+    if (cond_skipped_ > 0) {
+        cond_skipped_--;
+        return;
+    }
+
     if (cond_stack_.empty()) {
-        std::cerr << "Error: THEN without an IF\n";
+        error() << "Error: THEN without an IF\n";
+        FORTH_TRACE_EVENT(trace_, TraceEvent::Error, static_cast<std::uint32_t>(TraceError::ControlMismatch),
+                          stack_.size());
         return;
     }
     // remove one level from the stack
     cond_stack_.pop();
 }
 
-// print the top of stack
-void ForthVM::display(ForthVM::DisplayFcn fcn)
+// compile IF as a conditional forward branch
+void ForthVM::compileIf()
+{
+    emit(Opcode::ZeroBranch, 0);
+    control_.push_back({ControlFcn::Orig_If, code_.size() - 1});
+}
+
+// compile ELSE as an unconditional forward branch, and resolve the IF
+void ForthVM::compileElse()
+{
+    if (control_.empty() || (control_.back().kind != ControlFcn::Orig_If)) {
+        error() << "Error: ELSE without an IF in definition of [" << fnname_ << "]!\n";
+        abandonDefinition();
+        return;
+    }
+
+    Control orig = control_.back(); control_.pop_back();
+
+    emit(Opcode::Branch, 0);
+    control_.push_back({ControlFcn::Orig_Else, code_.size() - 1});
+    resolve(orig.address);
+}
+
+// compile THEN by resolving the pending IF or ELSE
+void ForthVM::compileThen()
+{
+    if (control_.empty() ||
+        ((control_.back().kind != ControlFcn::Orig_If) && (control_.back().kind != ControlFcn::Orig_Else))) {
+        error() << "Error: THEN without an IF in definition of [" << fnname_ << "]!\n";
+        abandonDefinition();
+        return;
+    }
+
+    resolve(control_.back().address);
+    control_.pop_back();
+}
+
+/* check that a compile only word is used inside a definition
+ * Args:
+ *  word : the name of the word
+ * Returns:
+ *  True if a definition is being compiled
+ */
+bool ForthVM::isCompiling(std::string_view word)
+{
+    if (!definefn_)
+        error() << "Error: " << word << " is only valid in a definition!\n";
+    return definefn_;
+}
+
+// check a word reaching the files or the console may run
+bool ForthVM::isAvailable(std::string_view word)
+{
+    if (sandbox_)
+        error() << "Error: " << word << " is not available here!\n";
+    return !sandbox_;
+}
+
+/* compile DO or ?DO
+ * Args:
+ *  op : the loop entry instruction
+ */
+void ForthVM::compileDo(Opcode op)
+{
+    std::size_t leaves = leaves_.size();
+
+    // ?DO jumps out of the loop like a LEAVE when there is nothing to do
+    if (op == Opcode::QDo) {
+        emit(op, 0);
+        leaves_.push_back(code_.size() - 1);
+    } else {
+        emit(op);
+    }
+
+    control_.push_back({ControlFcn::Dest_Do, code_.size(), leaves});
+}
+
+/* compile LOOP or +LOOP, and resolve the LEAVEs of the loop
+ * Args:
+ *  op : the loop end instruction
+ */
+void ForthVM::compileLoop(Opcode op)
+{
+    if (control_.empty() || (control_.back().kind != ControlFcn::Dest_Do)) {
+        error() << "Error: LOOP without a DO in definition of [" << fnname_ << "]!\n";
+        abandonDefinition();
+        return;
+    }
+
+    Control dest = control_.back(); control_.pop_back();
+
+    // jump back to the start of the loop body
+    emit(op, 0);
+    code_.back() = static_cast<Cell>(dest.address - (code_.size() - 1));
+
+    // exit of the loop
+    while (leaves_.size() > dest.leaves) {
+        resolve(leaves_.back());
+        leaves_.pop_back();
+    }
+}
+
+// compile LEAVE as a forward branch to the end of the loop
+void ForthVM::compileLeave()
+{
+    bool in_loop = std::any_of(control_.begin(), control_.end(),
+        [](const Control& c) { return c.kind == ControlFcn::Dest_Do; });
+
+    if (!in_loop) {
+        error() << "Error: LEAVE outside of a loop in definition of [" << fnname_ << "]!\n";
+        abandonDefinition();
+        return;
+    }
+
+    emit(Opcode::Leave, 0);
+    leaves_.push_back(code_.size() - 1);
+}
+
+/* compile a word reading the parameters of the enclosing loops
+ * Args:
+ *  op    : the instruction
+ *  word  : the name of the word
+ *  loops : the number of enclosing loops it needs
+ */
+void ForthVM::compileLoopWord(Opcode op, std::string_view word, std::size_t loops)
+{
+    auto enclosing = static_cast<std::size_t>(std::count_if(control_.begin(), control_.end(),
+        [](const Control& c) { return c.kind == ControlFcn::Dest_Do; }));
+
+    if (enclosing < loops) {
+        error() << "Error: " << word << " outside of a loop in definition of [" << fnname_ << "]!\n";
+        abandonDefinition();
+        return;
+    }
+
+    emit(op);
+}
+
+// compile BEGIN by marking the start of the loop
+void ForthVM::compileBegin()
+{
+    control_.push_back({ControlFcn::Dest_Begin, code_.size()});
+}
+
+/* compile UNTIL or AGAIN as a backward branch to the matching BEGIN
+ * Args:
+ *  op : the branch instruction
+ */
+void ForthVM::compileUntil(Opcode op)
 {
-    if (stack_.empty())
+    if (control_.empty() || (control_.back().kind != ControlFcn::Dest_Begin)) {
+        error() << "Error: UNTIL/AGAIN without a BEGIN in definition of [" << fnname_ << "]!\n";
+        abandonDefinition();
         return;
+    }
 
-    int top = stack_.back(); stack_.pop_back();
+    Control dest = control_.back(); control_.pop_back();
+
+    emit(op, 0);
+    code_.back() = static_cast<Cell>(dest.address - (code_.size() - 1));
+}
+
+// compile WHILE as a conditional forward branch out of the BEGIN loop
+void ForthVM::compileWhile()
+{
+    if (control_.empty() || (control_.back().kind != ControlFcn::Dest_Begin)) {
+        error() << "Error: WHILE without a BEGIN in definition of [" << fnname_ << "]!\n";
+        abandonDefinition();
+        return;
+    }
+
+    // the loop start stays on top of the exit
+    Control dest = control_.back(); control_.pop_back();
+
+    emit(Opcode::ZeroBranch, 0);
+    control_.push_back({ControlFcn::Orig_While, code_.size() - 1});
+    control_.push_back(dest);
+}
+
+// compile REPEAT as a backward branch, and resolve the WHILE
+void ForthVM::compileRepeat()
+{
+    if ((control_.size() < 2) ||
+        (control_.back().kind != ControlFcn::Dest_Begin) ||
+        (control_[control_.size() - 2].kind != ControlFcn::Orig_While)) {
+        error() << "Error: REPEAT without a BEGIN..WHILE in definition of [" << fnname_ << "]!\n";
+        abandonDefinition();
+        return;
+    }
+
+    compileUntil(Opcode::Branch);
+    resolve(control_.back().address);
+    control_.pop_back();
+}
+
+// print the top of stack
+void ForthVM::display(ForthVM::DisplayFcn fcn)
+{
+    Cell top = stack_.back(); stack_.pop_back();
 
     switch (fcn)
     {
         case Top:
-            std::cout << top << " ";
+            output_.number(top, base());
             break;
         case Emit:
-            std::cout << static_cast<char>(top);
+            output_.put(static_cast<char>(top));
             break;
     }
 }
 
+/* parse a string literal, up to the closing quote
+ * Returns:
+ *  The text, none if the quote is missing
+ */
+std::optional<std::string_view> ForthVM::parseString()
+{
+    auto text = tokenizer_.parseUntil('"');
+    if (!text) {
+        error() << "Error: unterminated string!\n";
+        if (definefn_)
+            abandonDefinition();
+    }
+    return text;
+}
+
+/* copy a text in the data space
+ * Args:
+ *  text : the text to copy
+ * Returns:
+ *  The address of the copy, none if the data space is full
+ */
+std::optional<Cell> ForthVM::storeString(std::string_view text)
+{
+    auto address = static_cast<Cell>(data_.here());
+    if (!data_.allot(static_cast<Cell>(text.size()))) {
+        error() << "Error: data space exhausted!\n";
+        if (definefn_)
+            abandonDefinition();
+        return std::nullopt;
+    }
+
+    std::memcpy(data_.writable(address, text.size()), text.data(), text.size());
+    return address;
+}
+
+/* stream of the error messages, written after the output so far
+ * Returns:
+ *  The stream
+ */
+std::ostream& ForthVM::error()
+{
+    output_.flush();
+    return *err_;
+}
+
+/* push the execution token of a word, or compile it as a literal in a
+ * definition
+ * Args:
+ *  name : the name of the word
+ */
+void ForthVM::tick(std::string_view name)
+{
+    if (!definefn_ && !shouldExecute())
+        return;
+
+    std::optional<std::size_t> index;
+    if (definefn_ && (name == fnname_))
+        index = wordCount();
+    else
+        index = findWord(name);
+
+    if (!index) {
+        error() << "Unknown word [" << name << "]!\n";
+        if (definefn_)
+            abandonDefinition();
+        return;
+    }
+
+    if (definefn_)
+        emit(Opcode::Literal, static_cast<Cell>(*index));
+    else
+        stack_.push_back(static_cast<Cell>(*index));
+}
+
+/* parse the name following a defining word, used outside of a definition
+ * Args:
+ *  word : the name of the defining word
+ * Returns:
+ *  The name to define, none in a definition or a skipped branch
+ */
+std::optional<std::string_view> ForthVM::definedName(std::string_view word)
+{
+    if (definefn_) {
+        error() << "Error: " << word << " is not valid in a definition!\n";
+        return std::nullopt;
+    }
+
+    auto name = tokenizer_.next();
+    return shouldExecute() ? name : std::nullopt;
+}
+
+/* define a word pushing a value, for the defining words
+ * Args:
+ *  name  : the name of the word
+ *  value : the value it pushes
+ * Returns:
+ *  The index of the word
+ */
+std::size_t ForthVM::createWord(std::string_view name, Cell value)
+{
+    std::size_t index = wordCount();
+    std::size_t address = code_.size();
+    emit(Opcode::Literal, value);
+    emit(Opcode::Exit);
+
+    userfn_[std::string(name)] = index;
+    dictionary_.push_back({std::string(name), address, code_.size() - address, {true, 0, 1},
+                           std::vector<Cell>(code_.begin() + static_cast<std::ptrdiff_t>(address), code_.end()),
+                           {}});
+    runtime_.emplace_back();
+    return index;
+}
+
+/* VARIABLE: define a word pushing the address of a new cell
+ * Args:
+ *  name : the name of the word
+ */
+void ForthVM::variable(std::string_view name)
+{
+    data_.align();
+    auto address = static_cast<Cell>(data_.here());
+    if (!data_.allot(sizeof(Cell))) {
+        error() << "Error: data space exhausted!\n";
+        return;
+    }
+
+    data_.store(address, 0);
+    createWord(name, address);
+}
+
+/* CONSTANT: define a word pushing the top of the stack
+ * Args:
+ *  name : the name of the word
+ */
+void ForthVM::constant(std::string_view name)
+{
+    if (stack_.empty()) {
+        error() << "Error: stack is empty!\n";
+        FORTH_TRACE_EVENT(trace_, TraceEvent::Error, static_cast<std::uint32_t>(TraceError::StackUnderflow), 0);
+        return;
+    }
+
+    Cell value = stack_.back(); stack_.pop_back();
+    createWord(name, value);
+}
+
+/* CREATE: define a word pushing the address of the data space that follows
+ * Args:
+ *  name : the name of the word
+ */
+void ForthVM::create(std::string_view name)
+{
+    data_.align();
+    last_created_ = createWord(name, static_cast<Cell>(data_.here()));
+
+    // room for the branch of DOES>
+    emit(Opcode::Exit);
+}
+
+/* DOES>: the word created last runs the code of its defining word, after
+ * pushing its address
+ * Args:
+ *  target : the address of the code in the defining word
+ * Returns:
+ *  False if no word has been created since the prelude
+ */
+bool ForthVM::does(std::size_t target)
+{
+    if (!last_created_ || (*last_created_ < prelude_words_)) {
+        error() << "Error: DOES> without a CREATE!\n";
+        return false;
+    }
+
+    // Literal address, Exit, Exit becomes Literal address, Branch target
+    Word& definition = dictionary_[*last_created_ - prelude_words_];
+    std::size_t operand = definition.address + 3;
+    code_[operand - 1] = static_cast<Cell>(Opcode::Branch);
+    code_[operand] = static_cast<Cell>(target - operand);
+
+    // it leaves the code of the word, whose effect is unknown
+    definition.size = 4;
+    definition.effect = {};
+    definition.does = true;
+    definition.unoptimized.assign(code_.begin() + static_cast<std::ptrdiff_t>(definition.address),
+                                  code_.begin() + static_cast<std::ptrdiff_t>(operand + 1));
+
+    Runtime& runtime = runtime_[*last_created_];
+    if (runtime.native.entry != nullptr)
+        jit_.release(runtime.native.entry);
+    runtime = {};
+    return true;
+}
+
 /* compare the top of the stack to 0 (zero)
  * Args:
  *  comp : the test to perform
  */
 void ForthVM::zeroCompare(ForthVM::ZeroCompFcn comp)
 {
-    if (stack_.empty())
-        return;
-
-    // retrieve the top of the stack
-    int top = stack_.back(); stack_.pop_back();
+    // compare the top of the stack in place
+    Cell& top = stack_.back();
 
     switch (comp) {
         case ZeroCompFcn::Equal:     // 0=
-            stack_.push_back(top == 0);
+            top = (top == 0);
             break;
         case ZeroCompFcn::Lesser:     // 0<
-            stack_.push_back(top < 0);
+            top = (top < 0);
             break;
         case ZeroCompFcn::Greater:     // 0>
-            stack_.push_back(top > 0);
+            top = (top > 0);
             break;
         case ZeroCompFcn::Not_Equal:     // 0<>
-            stack_.push_back(top != 0);
+            top = (top != 0);
             break;
     }
 }
@@ -10,23 +10,79 @@
 #define FORTH_VM_H_
 
 // ----- includes
-#include <deque>
+#include "data_space.h"
+#include "jit.h"
+#include "opcodes.h"
+#include "output_buffer.h"
+#include "profiler.h"
+#include "tokenizer.h"
+#include "trace.h"
+#include "vector_ops.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <stack>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
+// ----- types
+// hash of the word names, to look them up directly with a token
+struct WordHash
+{
+    using is_transparent = void;
+
+    std::size_t operator()(std::string_view name) const {
+        return std::hash<std::string_view>{}(name);
+    }
+};
+
+template<typename T>
+using WordMap_T = std::unordered_map<std::string, T, WordHash, std::equal_to<>>;
+
 // ----- class
 class ForthVM
 {
+public:     // public types
+    // compiled words shared read only by several virtual machines
+    struct Prelude;
+    using PreludePtr_T = std::shared_ptr<const Prelude>;
+
+    // state to restore a virtual machine to, on top of a prelude
+    struct Snapshot;
+    using SnapshotPtr_T = std::shared_ptr<const Snapshot>;
+
 public:     // public methods
-    ForthVM();
+    explicit ForthVM(std::size_t = DataSpace::kDefaultCapacity);
+    explicit ForthVM(PreludePtr_T, std::size_t = DataSpace::kDefaultCapacity);
     virtual ~ForthVM();
 
-    void run(const std::string&);
+    PreludePtr_T freeze() const;
+    void reset();
+    SnapshotPtr_T snapshot();
+    void restore(const Snapshot&);
+    void runTasks();
+    void setOutput(std::ostream&, std::ostream&);
+    const std::vector<Cell>& stack() const;
+
+    void run(std::string_view);
     void load(const std::string&);
+    void setJitThreshold(std::size_t);
+    void setSandbox(bool);
+    void interrupt();
+    void clearInterrupt();
+    bool saveImage(const std::string&) const;
+    bool loadImage(const std::string&);
+    void setProfiling(bool);
+    void writeProfile(const std::string&) const;
+    bool writeTrace(const std::string&) const;
 
     // no copy or move semantics
     ForthVM(const ForthVM&) = delete;
@@ -47,70 +103,295 @@ private:    // private enums
         Emit,
     };
 
+    // compile time control flow structures
+    enum ControlFcn {
+        Orig_If,
+        Orig_Else,
+        Orig_While,
+        Dest_Begin,
+        Dest_Do,
+    };
+
+private:    // private constants
+    // BASE, the first cell of the data space
+    static constexpr Cell kBaseAddress {0};
+
+    // deepest stacks and most tasks of a sandboxed program
+    static constexpr std::size_t kSandboxDepth {1 << 16};
+    static constexpr std::size_t kSandboxTasks {256};
+
+private:    // private structures
+    // stack effect of a word: cells taken from and left on the data stack
+    struct StackEffect {
+        bool known {false};
+        int in {0};
+        int out {0};
+
+        bool operator==(const StackEffect&) const = default;
+    };
+
+    // user defined word
+    struct Word {
+        std::string name {};
+        std::size_t address {0};    // entry point in the code space
+        std::size_t size {0};       // number of cells of the code
+        StackEffect effect {};
+        std::vector<Cell> unoptimized {};
+        std::vector<std::size_t> inlined {};    // words copied into this one
+        bool does {false};          // created, then patched by DOES>
+    };
+
+    // run time state of a word, owned by each virtual machine
+    struct Runtime {
+        std::size_t calls {0};      // executions, until the word turns native
+        Jit::Native native {};
+    };
+
+    // cooperative task, with its own stacks
+    struct Task {
+        std::vector<Cell> stack {};
+        std::vector<Cell> rstack {};
+        std::vector<double> fstack {};
+        std::size_t ip {0};         // where it resumes
+        Profiler::Suspended calls {};           // open calls while paused
+        std::vector<std::uint32_t> traced {};
+    };
+
+    // decoded instruction, for the compiler passes
+    struct Instruction {
+        Opcode op;
+        Cell operand {0};
+        std::size_t target {0};     // index of the branch destination
+        double real {0.0};          // value of an FLiteral
+    };
+
+    // unresolved control flow structure in a definition
+    struct Control {
+        ControlFcn kind;
+        std::size_t address;        // branch operand to resolve, or loop start
+        std::size_t leaves {0};     // pending LEAVEs when the loop started
+    };
+
 private:    // private methods
+    static const WordMap_T<Opcode>& builtins();
+
+    // words of the prelude followed by the local ones
+    const Word& word(std::size_t) const;
+    std::size_t wordCount() const;
+    std::optional<std::size_t> findWord(std::string_view) const;
+    void rewind();
+
     void dup();
     void swap();
     void drop();
-    bool isNumber(std::string_view);
+    void over();
+    void rot();
+    DoubleCell popDouble();
+    void pushDouble(DoubleCell);
+    std::optional<Cell> parseNumber(std::string_view) const;
+    std::optional<double> parseReal(std::string_view) const;
+    int base() const;
 
     void display(DisplayFcn);
+    std::ostream& error();
+    std::optional<std::string_view> parseString();
+    std::optional<Cell> storeString(std::string_view);
 
-    template<typename T> void binaryOperator(T);
-    template<typename T> void unaryOperator(T);
+    template<typename U = Cell, typename T> void binaryOperator(T);
+    template<typename U = Cell, typename T> void unaryOperator(T);
 
     void beginDefinition();
     void endDefinition();
-    void runDefinition(const std::string&);
+    void abandonDefinition();
+    bool compile(std::string_view);
+    void emit(Opcode);
+    void emit(Opcode, Cell);
+    void emitReal(double);
+    void resolve(std::size_t);
+    void execute(std::size_t, std::size_t);
+    template<bool Profile> void interpret(std::size_t, std::size_t);
+    void callWord(std::size_t);
+    void tierUp(std::size_t);
+    bool runNative(const Word&, const Runtime&);
+    void executeBuiltin(Opcode);
     void zeroCompare(ZeroCompFcn);
+    void tick(std::string_view);
+
+    std::optional<std::string_view> definedName(std::string_view);
+    std::size_t createWord(std::string_view, Cell);
+    void variable(std::string_view);
+    void constant(std::string_view);
+    void create(std::string_view);
+    bool does(std::size_t);
+
+    void schedule();
+    std::optional<Cell> readKey(bool);
+
+    void finalizeDefinition();
+    std::vector<Instruction> decode(const Cell*, std::size_t) const;
+    void encode(const std::vector<Instruction>&);
+    StackEffect inferEffect(const std::vector<Instruction>&, const StackEffect*, bool&) const;
+    bool checkReturnStack(const std::vector<Instruction>&) const;
+    std::vector<Instruction> insertGuards(const std::vector<Instruction>&, const StackEffect&) const;
+    std::vector<Instruction> optimize(std::vector<Instruction>) const;
+    std::vector<Instruction> inlineCalls(const std::vector<Instruction>&, std::vector<std::size_t>&) const;
+    bool isInlinable(std::size_t) const;
+    void see(std::string_view) const;
+    void disassemble(const Cell*, std::size_t) const;
+    bool verifyWord(const std::vector<Cell>&, const std::vector<Word>&, std::size_t) const;
 
     bool shouldExecute();
     void processIf();
     void processElse();
     void processThen();
 
+    void compileIf();
+    void compileElse();
+    void compileThen();
+
+    bool isCompiling(std::string_view);
+    bool isAvailable(std::string_view);
+    void compileDo(Opcode);
+    void compileLoop(Opcode);
+    void compileLeave();
+    void compileLoopWord(Opcode, std::string_view, std::size_t);
+    void compileBegin();
+    void compileUntil(Opcode);
+    void compileWhile();
+    void compileRepeat();
+
 private:    // private members
-    std::vector<int> stack_;
-    std::unordered_map<std::string, std::function<void()>> functions_;
+    Tokenizer tokenizer_ {};
+    bool in_comment_ {false};
+    bool skip_definition_ {false};  // rest of an abandoned definition
+
+    std::vector<Cell> stack_ {};
+    std::vector<Cell> rstack_ {};
+    std::vector<double> fstack_ {};     // floating point stack
 
-    // user defined functions
-    std::unordered_map<std::string, std::deque<std::string>> userfn_;
-    std::string fnname_;
+    // builtins run by the inner interpreter, and words run by the outer one
+    const WordMap_T<Opcode>& functions_ {builtins()};
+    WordMap_T<std::function<void()>> immediates_ {};
+
+    // output of the words, and of the errors
+    std::ostream* out_ {&std::cout};
+    std::ostream* err_ {&std::cerr};
+    OutputBuffer output_ {std::cout};
+
+    // shared prelude, its words come before the local ones and its cells
+    // start the code space
+    PreludePtr_T prelude_ {};
+    std::size_t prelude_words_ {0};
+    std::size_t prelude_cells_ {0};
+
+    // code space and user defined functions
+    std::vector<Cell> code_ {};
+    std::vector<Word> dictionary_ {};
+    std::vector<Runtime> runtime_ {};       // of the prelude and local words
+    WordMap_T<std::size_t> userfn_ {};
+    std::string fnname_ {};
+    std::size_t fnstart_ {0};
     bool definefn_ {false};
+    std::vector<Control> control_ {};
+    std::vector<std::size_t> leaves_ {};
+
+    // set from another thread to stop the program running, polled by the
+    // loops and the calls of the interpreter and of the native code
+    std::atomic<bool> interrupted_ {false};
+
+    // no access to the files nor to the console, for the served programs
+    bool sandbox_ {false};
+
+    // native code of the words called more than the threshold, 0 to disable
+    Jit jit_ {&interrupted_};
+    std::size_t jit_threshold_ {0};
+
+    // execution profile, recorded with --profile or PROFILE-ON
+    Profiler profiler_ {};
+
+    // data space, and the word CREATE defined last for DOES>
+    DataSpace data_ {};
+    std::optional<std::size_t> last_created_ {};
+
+    // kernels of the vector words, the fastest the processor runs
+    const VectorKernels& vector_ {VectorKernels::best()};
 
-    // conditions stack (if..else..then)
-    std::stack<bool> cond_stack_;
+    // events of the tracing builds
+    TraceBuffer trace_ {};
+
+    // tasks other than the main program, run in turn at each PAUSE
+    std::vector<Task> tasks_ {};
+    bool in_task_ {false};
+    std::optional<std::size_t> paused_ {};  // resume address of the task
+
+    // conditions stack (if..else..then) of the interpreter
+    std::stack<bool> cond_stack_ {};
+    std::size_t cond_skipped_ {0};
 };
 
-// ----- templates
-template<typename T>
-void ForthVM::binaryOperator(T op)
+// prelude: a frozen code space, data space and dictionary
+struct ForthVM::Prelude
 {
-    // ensure the stack has at least 2 values
-    if (stack_.size() < 2) {
-        std::cerr << "Error: not enough values on the stack!\n";
-        return;
-    }
+    std::vector<Cell> code {};
+    std::vector<std::uint8_t> data {};
+    std::size_t capacity {DataSpace::kDefaultCapacity};    // of the data space
+    std::vector<Word> words {};
+    WordMap_T<std::size_t> userfn {};
+};
+
+// snapshot: the words frozen in a prelude, and the stacks
+struct ForthVM::Snapshot
+{
+    PreludePtr_T prelude {};
+    std::size_t capacity {DataSpace::kDefaultCapacity};    // of the data space, without a prelude
+    std::vector<Cell> stack {};
+    std::vector<double> fstack {};
+    std::stack<bool> cond_stack {};
+    std::size_t cond_skipped {0};
+};
 
-    // retrieve both values
-    int b = stack_.back(); stack_.pop_back();
-    int a = stack_.back(); stack_.pop_back();
+// ----- inline functions
 
-    stack_.push_back(op(a, b));
+// a word of the prelude or a local word
+inline const ForthVM::Word& ForthVM::word(std::size_t index) const
+{
+    return (index < prelude_words_) ? prelude_->words[index] : dictionary_[index - prelude_words_];
 }
 
-template<typename T>
-void ForthVM::unaryOperator(T op)
+inline std::size_t ForthVM::wordCount() const
 {
-    // ensure the stack has at least 1 value
-    if (stack_.size() < 1) {
-        std::cerr << "Error: not enough values on the stack!\n";
-        return;
-    }
+    return prelude_words_ + dictionary_.size();
+}
+
+// double cell of the stack, its high cell on top
+inline DoubleCell ForthVM::popDouble()
+{
+    auto high = static_cast<UCell>(stack_.back()); stack_.pop_back();
+    auto low = static_cast<UCell>(stack_.back()); stack_.pop_back();
+    return static_cast<DoubleCell>((static_cast<UDoubleCell>(high) << FORTH_CELL_BITS) | low);
+}
 
-    // retrieve the value
-    int a = stack_.back(); stack_.pop_back();
+inline void ForthVM::pushDouble(DoubleCell value)
+{
+    stack_.push_back(static_cast<Cell>(static_cast<UCell>(value)));
+    stack_.push_back(static_cast<Cell>(static_cast<UCell>(static_cast<UDoubleCell>(value) >> FORTH_CELL_BITS)));
+}
 
-    stack_.push_back(op(a));
+// ----- templates
+// the stack depth is checked by the Guard instructions, the operators
+// themselves run unchecked. The operands are converted to U first: the
+// arithmetic operators work on unsigned cells, to wrap around.
+template<typename U, typename T>
+void ForthVM::binaryOperator(T op)
+{
+    auto b = static_cast<U>(stack_.back()); stack_.pop_back();
+    stack_.back() = static_cast<Cell>(op(static_cast<U>(stack_.back()), b));
+}
+
+template<typename U, typename T>
+void ForthVM::unaryOperator(T op)
+{
+    stack_.back() = static_cast<Cell>(op(static_cast<U>(stack_.back())));
 }
 
 #endif // FORTH_VM_H_
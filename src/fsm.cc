@@ -8,9 +8,42 @@
 // ----- includes
 #include "fsm.h"
 
+#include <algorithm>
+#include <bit>
+#include <limits>
+
 // ----- begin namespace
 namespace FSM {
 
+// ----- helpers
+namespace {
+
+// largest index held by the matrix and the hash slots
+constexpr std::size_t kMaxIndex {std::numeric_limits<std::int16_t>::max()};
+
+// the matrix is used when its cells are at most this many times the
+// transitions, or when it is small anyway
+constexpr std::size_t kDenseRatio {16};
+constexpr std::size_t kDenseCells {std::size_t {1} << 16};
+
+// seeds tried for each size of the perfect hash, before doubling it
+constexpr std::uint32_t kHashSeeds {64};
+
+// FNV-1a hash of a name, from a seed, mixed for the low bits
+std::uint32_t hashName(std::string_view name, std::uint32_t seed)
+{
+    std::uint32_t hash {2166136261u ^ seed};
+    for (char c : name)
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+}
+
 // constructor
 Engine::Engine(UserQueue_T& queue) :
     queue_{queue}
@@ -30,6 +63,7 @@ Engine::Engine(UserQueue_T& queue) :
  */
 int Engine::add(State s)
 {
+    finalized_ = false;
     states_.push_back(std::move(s));
     return static_cast<int>(states_.size() - 1);
 }
@@ -42,6 +76,7 @@ int Engine::add(State s)
  */
 int Engine::add(Event e)
 {
+    finalized_ = false;
     events_.push_back(std::move(e));
     return static_cast<int>(events_.size() - 1);
 }
@@ -53,9 +88,75 @@ int Engine::add(Event e)
  */
 void Engine::add(Transition t)
 {
+    finalized_ = false;
     transitions_[t.begin_state][t.event] = t.end_state;
 }
 
+/* freeze the FSM: the transitions go in a matrix of a row per state and a
+ * column per event, and the event names in a perfect hash. Adding to the
+ * FSM afterwards thaws it, it is frozen again at the next update.
+ * The FSM too large or too sparse for the matrix stays on the transition
+ * maps.
+ * Returns:
+ *      True if the transitions are in the matrix, false if on the maps
+ */
+bool Engine::finalize()
+{
+    // a last column of -1 receives the events out of range
+    columns_ = events_.size() + 1;
+    std::size_t cells = states_.size() * columns_;
+    bool dense = (states_.size() <= kMaxIndex) && (events_.size() <= kMaxIndex) &&
+                 (cells <= std::max(kDenseCells, kDenseRatio * static_cast<std::size_t>(transitions())));
+
+    matrix_.clear();
+    if (dense) {
+        matrix_.assign(cells, -1);
+        for (const auto& [begin, map] : transitions_) {
+            for (const auto& [event, end] : map) {
+                if ((begin >= 0) && (begin < states()) && (event >= 0) && (event < events()) &&
+                    (end >= 0) && (end < states()))
+                    matrix_[static_cast<std::size_t>(begin) * columns_ + static_cast<std::size_t>(event)] =
+                        static_cast<std::int16_t>(end);
+            }
+        }
+    }
+
+    actions_.assign(states_.size(), 0);
+    for (std::size_t i = 0; i < states_.size(); ++i) {
+        actions_[i] = static_cast<std::uint8_t>((states_[i].exit.empty() ? 0 : kExit) |
+                                                (states_[i].enter.empty() ? 0 : kEnter) |
+                                                ((states_[i].type == StateType::END_STATE) ? kEnd : 0));
+    }
+
+    // look for a seed without collision, in a table twice as large as the
+    // events at least. A name given to several events is the first one's.
+    slots_.clear();
+    for (std::size_t size = std::bit_ceil(2 * events_.size());
+         slots_.empty() && (events_.size() <= kMaxIndex) && (size <= 4 * kMaxIndex);
+         size *= 2) {
+        for (std::uint32_t seed = 0; seed < kHashSeeds; ++seed) {
+            std::vector<std::int16_t> slots(size, -1);
+            bool collision {false};
+            for (std::size_t i = 0; (i < events_.size()) && !collision; ++i) {
+                auto& slot = slots[hashName(events_[i].name, seed) & (size - 1)];
+                if (slot == -1)
+                    slot = static_cast<std::int16_t>(i);
+                else
+                    collision = (events_[static_cast<std::size_t>(slot)].name != events_[i].name);
+            }
+
+            if (!collision) {
+                slots_ = std::move(slots);
+                seed_ = seed;
+                break;
+            }
+        }
+    }
+
+    finalized_ = true;
+    return dense;
+}
+
 /* get the current state of the FSM
  * Returns:
  *      the name of the current state
@@ -68,6 +169,9 @@ std::string_view Engine::state() const
 // start the FSM
 bool Engine::start()
 {
+    if (!finalized_)
+        finalize();
+
     // go through all the states, and find the one marked BEGIN_STATE
     for (int i = 0; i < static_cast<int>(states_.size()); ++i) {
         if (states_[i].type == StateType::BEGIN_STATE) {
@@ -101,34 +205,21 @@ bool Engine::stop()
  */
 bool Engine::update(int event)
 {
-    // nothing to do if the FSM has ended
-    if (has_ended_)
-        return false;
-
-    // ensure the event exists in our list
-    if (event >= static_cast<int>(events_.size()))
+    // nothing to do if the FSM has ended, or has not started
+    if (has_ended_ || (current_ < 0))
         return false;
-
-    // ensure the event exists for the current state
-    const auto& map = transitions_.at(current_);
-    if (!map.contains(event))
+    if (!finalized_)
+        finalize();
+
+    // the events out of range, the negative ones included, read the last
+    // column of the row
+    int next = matrix_.empty() ? follow(event)
+                               : matrix_[static_cast<std::size_t>(current_) * columns_ +
+                                         std::min<std::size_t>(static_cast<unsigned>(event), columns_ - 1)];
+    if (next < 0)
         return false;
 
-    // inform user we exit from current state
-    if (states_[current_].exit != "")
-        queue_.push(states_[current_].exit);
-
-    // move to the end state of the transition
-    current_ = map.at(event);
-
-    // inform the user we enter to current state
-    if (states_[current_].enter != "")
-        queue_.push(states_[current_].enter);
-
-    // check if the state is an end state
-    if (states_[current_].type == StateType::END_STATE)
-        has_ended_ = true;
-
+    move(next);
     return true;
 }
 
@@ -152,6 +243,55 @@ bool Engine::update(std::string event)
     return update(index);
 }
 
+/* update the FSM with a batch of events, up to the first one refused or
+ * to an end state
+ * Args:
+ *      events : the events to consider for the transitions, in order
+ * Returns:
+ *      The number of events accepted
+ */
+std::size_t Engine::run(std::span<const int> events)
+{
+    if (has_ended_ || (current_ < 0))
+        return 0;
+    if (!finalized_)
+        finalize();
+
+    // on the maps, one event at a time
+    std::size_t count {0};
+    if (matrix_.empty()) {
+        for (int event : events) {
+            if (!update(event))
+                break;
+            ++count;
+        }
+        return count;
+    }
+
+    // the states without actions only move along the matrix
+    const std::int16_t* matrix = matrix_.data();
+    std::size_t columns = columns_;
+    auto current = static_cast<std::size_t>(current_);
+
+    for (int event : events) {
+        int next = matrix[current * columns + std::min<std::size_t>(static_cast<unsigned>(event), columns - 1)];
+        if (next < 0)
+            break;
+
+        ++count;
+        if ((actions_[current] | actions_[static_cast<std::size_t>(next)]) != 0) {
+            current_ = static_cast<int>(current);
+            move(next);
+            if (has_ended_)
+                return count;
+        }
+        current = static_cast<std::size_t>(next);
+    }
+
+    current_ = static_cast<int>(current);
+    return count;
+}
+
 /* check if a transition from the current State, to the one specified is possible
  * Args:
  *      state : the target state to check
@@ -160,8 +300,27 @@ bool Engine::update(std::string event)
  */
 bool Engine::can(int s) const
 {
+    // no transition before the start, nor toward the empty cells of the matrix
+    if ((current_ < 0) || (s < 0))
+        return false;
+
+    // look in the row of the current state, when the FSM is frozen in the
+    // matrix
+    if (finalized_ && !matrix_.empty()) {
+        const std::int16_t* row = matrix_.data() + static_cast<std::size_t>(current_) * columns_;
+        for (std::size_t i = 0; i < columns_; ++i) {
+            if (row[i] == s)
+                return true;
+        }
+        return false;
+    }
+
     // check if the state exists in the map for the current state
-    for (const auto& map : transitions_.at(current_)) {
+    auto transitions = transitions_.find(current_);
+    if (transitions == transitions_.end())
+        return false;
+
+    for (const auto& map : transitions->second) {
         if (map.second == s)
             return true;
     }
@@ -243,6 +402,12 @@ int Engine::stateIndex(std::string name) const
  */
 int Engine::eventIndex(std::string name) const
 {
+    // a single slot to check, when the FSM is frozen
+    if (finalized_ && !slots_.empty()) {
+        int index = slots_[hashName(name, seed_) & (slots_.size() - 1)];
+        return ((index >= 0) && (events_[static_cast<std::size_t>(index)].name == name)) ? index : -1;
+    }
+
     for (int i = 0; i < static_cast<int>(events_.size()); ++i) {
         if (events_[i].name == name)
             return i;
@@ -313,5 +478,45 @@ std::optional<std::reference_wrapper<const Event>> Engine::event(std::string nam
 }
 
 
+/* find the end state of a transition from the current state, on the maps
+ * Args:
+ *      event : the event of the transition
+ * Returns:
+ *      The end state, -1 if there is no such transition
+ */
+int Engine::follow(int event) const
+{
+    auto transitions = transitions_.find(current_);
+    if (transitions == transitions_.end())
+        return -1;
+
+    auto end = transitions->second.find(event);
+    if ((end == transitions->second.end()) || (end->second < 0) || (end->second >= states()))
+        return -1;
+
+    return end->second;
+}
+
+/* move to the end state of a transition, with the actions of the states
+ * Args:
+ *      next : the end state
+ */
+void Engine::move(int next)
+{
+    // inform user we exit from current state
+    if (actions_[static_cast<std::size_t>(current_)] & kExit)
+        queue_.push(states_[current_].exit);
+
+    current_ = next;
+
+    // inform the user we enter to current state
+    if (actions_[static_cast<std::size_t>(current_)] & kEnter)
+        queue_.push(states_[current_].enter);
+
+    // check if the state is an end state
+    if (actions_[static_cast<std::size_t>(current_)] & kEnd)
+        has_ended_ = true;
+}
+
 // ----- end namespace
 }
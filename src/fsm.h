@@ -10,7 +10,10 @@
 #define FORTH_FSM_H_
 
 // ----- includes
+#include <cstddef>
+#include <cstdint>
 #include <queue>
+#include <span>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -77,13 +80,17 @@ public:
     // get the current state of the FSM
     std::string_view state() const;
 
+    // freeze the transitions into a matrix, done by start() if needed
+    bool finalize();
+
     // start and stop the FSM
     bool start();
     bool stop();
 
-    // update the FSM according to the new event
+    // update the FSM according to the new event, or to a batch of events
     bool update(int);
     bool update(std::string);
+    std::size_t run(std::span<const int>);
 
     // check if a transition to a new state is possible (can) or not (cannot)
     bool can(int) const;
@@ -107,11 +114,22 @@ public:
 
 
 private:
+    int follow(int) const;
+    void move(int);
+
+private:
+    // actions of a state, flags of the frozen engine
+    enum Action : std::uint8_t {
+        kExit = 1,
+        kEnter = 2,
+        kEnd = 4
+    };
+
     bool has_ended_ {true};
     int current_ {-1};
 
-    std::vector<State> states_;
-    std::vector<Event> events_;
+    std::vector<State> states_ {};
+    std::vector<Event> events_ {};
 
     // event_map        => event ID, end state ID
     // transition_map   => begin state ID, event_map
@@ -119,6 +137,19 @@ private:
     using TransitionMap_T = std::unordered_map<int, EventMap_T>;
     TransitionMap_T transitions_ {};
 
+    // frozen engine: the end state of each state and event, -1 for none,
+    // in a row per state with a last column of -1, empty when the engine
+    // stays on the maps, and the actions of the states
+    bool finalized_ {false};
+    std::vector<std::int16_t> matrix_ {};
+    std::size_t columns_ {0};
+    std::vector<std::uint8_t> actions_ {};
+
+    // perfect hash of the event names: a slot per hash, holding an event
+    // index or -1
+    std::vector<std::int16_t> slots_ {};
+    std::uint32_t seed_ {0};
+
     UserQueue_T& queue_;
 };
 
@@ -0,0 +1,487 @@
+/*
+ * @file    image.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Forth Virtual Machine dictionary images
+ */
+
+// ----- includes
+#include "forth_vm.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+// ----- helpers
+namespace {
+
+// the image starts with its magic and the layout of the machine that wrote
+// it. The addresses are code space indexes, so the image can be loaded
+// anywhere in memory.
+constexpr char kImageMagic[8] = {'S', 'L', 'F', 'I', 'M', 'A', 'G', 'E'};
+constexpr std::uint32_t kImageVersion {6};
+
+struct ImageHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t cell_size;
+    std::uint32_t opcodes;          // number of opcodes of the instruction set
+    std::uint32_t signature;        // hash of the opcode names, in order
+    std::uint64_t code_size;        // cells of the code space
+    std::uint64_t data_size;        // bytes of the data space
+    std::uint64_t words;            // entries of the dictionary
+};
+
+// hash of the instruction set, an image is only valid with the same opcodes
+std::uint32_t opcodeSignature()
+{
+    std::uint32_t hash {2166136261u};
+    for (const char* name : kOpcodeNames) {
+        for (const char* c = name; *c != '\0'; ++c)
+            hash = (hash ^ static_cast<unsigned char>(*c)) * 16777619u;
+        hash = (hash ^ ' ') * 16777619u;
+    }
+    return hash;
+}
+
+/* check the threaded code of a word read from an image: known opcodes,
+ * with their operand, and calls to the words of the dictionary
+ * Args:
+ *  code   : the first cell of the word
+ *  size   : the number of cells of the word
+ *  words  : the number of words that may be called
+ *  inside : true if the branches must land on an instruction of the word
+ * Returns:
+ *  True if the code can be decoded
+ */
+bool validCode(const Cell* code, std::size_t size, std::size_t words, bool inside)
+{
+    std::vector<bool> start(size, false);
+    std::vector<std::size_t> targets;
+
+    for (std::size_t ip = 0; ip < size; ) {
+        start[ip] = true;
+        if ((code[ip] < 0) || (static_cast<std::size_t>(code[ip]) >= std::size(kOpcodeNames)))
+            return false;
+
+        auto op = static_cast<Opcode>(code[ip++]);
+        if (op == Opcode::FLiteral) {
+            if (size - ip < kRealCells)
+                return false;
+            ip += kRealCells;
+            continue;
+        }
+        if (!hasOperand(op))
+            continue;
+        if (ip >= size)
+            return false;
+
+        // the branches are relative to their operand
+        auto operand = static_cast<std::ptrdiff_t>(code[ip]);
+        if (inside && isBranch(op) && ((operand < -static_cast<std::ptrdiff_t>(ip)) ||
+                                       (operand >= static_cast<std::ptrdiff_t>(size - ip))))
+            return false;
+        if ((op == Opcode::Call) && ((operand < 0) || (static_cast<std::size_t>(operand) >= words)))
+            return false;
+        if (inside && isBranch(op))
+            targets.push_back(static_cast<std::size_t>(static_cast<std::ptrdiff_t>(ip) + operand));
+        ++ip;
+    }
+
+    return std::all_of(targets.begin(), targets.end(), [&](std::size_t target) { return start[target]; });
+}
+
+// append the raw bytes of values to an image
+void put(std::string& image, const void* data, std::size_t size)
+{
+    image.append(static_cast<const char*>(data), size);
+}
+
+template<typename T>
+void put(std::string& image, const T& value)
+{
+    put(image, &value, sizeof(value));
+}
+
+// read the raw bytes of values from an image, in order
+class ImageReader
+{
+public:
+    explicit ImageReader(std::string_view data) : data_ {data} { }
+
+    bool get(void* data, std::size_t size) {
+        if (data_.size() - position_ < size)
+            return false;
+        if (size == 0)
+            return true;
+        std::memcpy(data, data_.data() + position_, size);
+        position_ += size;
+        return true;
+    }
+
+    template<typename T>
+    bool get(T& value) {
+        return get(&value, sizeof(value));
+    }
+
+    // a vector of values, preceded by its size
+    template<typename T>
+    bool get(std::vector<T>& values) {
+        std::uint64_t size {0};
+        if (!get(size) || (size > (data_.size() - position_) / sizeof(T)))
+            return false;
+        values.resize(static_cast<std::size_t>(size));
+        return get(values.data(), values.size() * sizeof(T));
+    }
+
+private:
+    std::string_view data_ {};
+    std::size_t position_ {0};
+};
+
+}
+
+
+// ----- public implementation
+
+/* Save the dictionary, the code space and the data space in an image, the
+ * prelude included
+ * Args:
+ *  filename (std::string) : the image to write
+ * Returns:
+ *  True if the image has been written
+ */
+bool ForthVM::saveImage(const std::string& filename) const
+{
+    ImageHeader header {};
+    std::memcpy(header.magic, kImageMagic, sizeof(header.magic));
+    header.version = kImageVersion;
+    header.cell_size = sizeof(Cell);
+    header.opcodes = static_cast<std::uint32_t>(std::size(kOpcodeNames));
+    header.signature = opcodeSignature();
+    header.code_size = code_.size();
+    header.data_size = data_.here();
+    header.words = wordCount();
+
+    std::string image;
+    put(image, header);
+    put(image, code_.data(), code_.size() * sizeof(Cell));
+
+    std::vector<std::uint8_t> data = data_.contents();
+    put(image, data.data(), data.size());
+
+    // the native code and the call counts are rebuilt at run time
+    for (std::size_t i = 0; i < wordCount(); ++i) {
+        const Word& word = this->word(i);
+        put(image, static_cast<std::uint64_t>(word.name.size()));
+        put(image, word.name.data(), word.name.size());
+        put(image, static_cast<std::uint64_t>(word.address));
+        put(image, static_cast<std::uint64_t>(word.size));
+        put(image, static_cast<std::uint8_t>(word.effect.known));
+        put(image, static_cast<std::int32_t>(word.effect.in));
+        put(image, static_cast<std::int32_t>(word.effect.out));
+        put(image, static_cast<std::uint8_t>(word.does));
+
+        put(image, static_cast<std::uint64_t>(word.unoptimized.size()));
+        put(image, word.unoptimized.data(), word.unoptimized.size() * sizeof(Cell));
+
+        put(image, static_cast<std::uint64_t>(word.inlined.size()));
+        for (auto callee : word.inlined)
+            put(image, static_cast<std::uint64_t>(callee));
+    }
+
+    std::ofstream file {filename, std::ios::binary | std::ios::trunc};
+    if (!file.write(image.data(), static_cast<std::streamsize>(image.size()))) {
+        *err_ << "Error: unable to write the image [" << filename << "]\n";
+        return false;
+    }
+
+    return true;
+}
+
+/* Load an image saved by SAVE-IMAGE, in place of the dictionary, the code
+ * space and the data space, the prelude included
+ * Args:
+ *  filename (std::string) : the image to read
+ * Returns:
+ *  True if the image has been loaded
+ */
+bool ForthVM::loadImage(const std::string& filename)
+{
+    MappedFile file {filename};
+    if (!file.isOpen()) {
+        error() << "Error: unable to load the image [" << filename << "]\n";
+        return false;
+    }
+
+    ImageReader reader {file.data()};
+    ImageHeader header {};
+    if (!reader.get(header) || (std::memcmp(header.magic, kImageMagic, sizeof(header.magic)) != 0)) {
+        error() << "Error: [" << filename << "] is not an image!\n";
+        return false;
+    }
+
+    if ((header.version != kImageVersion) || (header.cell_size != sizeof(Cell)) ||
+        (header.opcodes != std::size(kOpcodeNames)) || (header.signature != opcodeSignature())) {
+        error() << "Error: the image [" << filename << "] was saved by another version!\n";
+        return false;
+    }
+
+    // read everything before replacing the current state
+    std::vector<Cell> code;
+    std::vector<Word> dictionary;
+    bool valid = (header.code_size <= file.data().size() / sizeof(Cell));
+    if (valid) {
+        code.resize(static_cast<std::size_t>(header.code_size));
+        valid = reader.get(code.data(), code.size() * sizeof(Cell));
+    }
+
+    std::vector<std::uint8_t> data;
+    valid = valid && (header.data_size <= std::min<std::uint64_t>(file.data().size(), data_.capacity()));
+    if (valid) {
+        data.resize(static_cast<std::size_t>(header.data_size));
+        valid = reader.get(data.data(), data.size());
+    }
+
+    for (std::uint64_t i = 0; valid && (i < header.words); ++i) {
+        Word word;
+        std::uint64_t length {0};
+        std::uint64_t address {0};
+        std::uint64_t size {0};
+        std::uint8_t known {0};
+        std::int32_t in {0};
+        std::int32_t out {0};
+        std::uint8_t does {0};
+        std::vector<std::uint64_t> inlined;
+
+        valid = reader.get(length) && (length <= file.data().size());
+        if (valid) {
+            word.name.resize(static_cast<std::size_t>(length));
+            valid = reader.get(word.name.data(), word.name.size()) &&
+                    reader.get(address) && reader.get(size) && reader.get(known) &&
+                    reader.get(in) && reader.get(out) && reader.get(does) &&
+                    reader.get(word.unoptimized) && reader.get(inlined) &&
+                    (address <= code.size()) && (size <= code.size() - address);
+        }
+
+        valid = valid && (in >= 0) && (out >= 0);
+        word.address = static_cast<std::size_t>(address);
+        word.size = static_cast<std::size_t>(size);
+        word.effect = {known != 0, in, out};
+        word.does = (does != 0);
+        for (auto callee : inlined) {
+            valid = valid && (callee < header.words);
+            word.inlined.push_back(static_cast<std::size_t>(callee));
+        }
+        dictionary.push_back(std::move(word));
+    }
+
+    // the code of every word only runs once it has been checked, the code
+    // before optimization is only displayed
+    for (std::size_t i = 0; valid && (i < dictionary.size()); ++i) {
+        const Word& word = dictionary[i];
+        valid = validCode(word.unoptimized.data(), word.unoptimized.size(), dictionary.size(), false) &&
+                verifyWord(code, dictionary, i);
+    }
+
+    if (!valid) {
+        error() << "Error: the image [" << filename << "] is corrupted!\n";
+        return false;
+    }
+
+    prelude_.reset();
+    prelude_words_ = 0;
+    prelude_cells_ = 0;
+
+    jit_.release();
+    code_ = std::move(code);
+    data_.load(data);
+    last_created_.reset();
+    dictionary_ = std::move(dictionary);
+    runtime_.assign(dictionary_.size(), {});
+    userfn_.clear();
+    for (std::size_t i = 0; i < dictionary_.size(); ++i)
+        userfn_[dictionary_[i].name] = i;
+
+    return true;
+}
+
+
+// ----- private implementation
+
+/* check the code of a word read from an image before it may run: the
+ * branches land on its instructions, it only calls the words before it or
+ * itself, the guards cover its stack accesses, its loops are nested and
+ * left before it returns, its return stack is balanced and its stack
+ * effect, when known, is the one of its code
+ * Args:
+ *  code       : the code space of the image
+ *  dictionary : the words of the image, the ones before index checked
+ *  index      : the word to check
+ * Returns:
+ *  True if the word can run
+ */
+bool ForthVM::verifyWord(const std::vector<Cell>& code, const std::vector<Word>& dictionary,
+                         std::size_t index) const
+{
+    const Word& definition = dictionary[index];
+    const Cell* cells = code.data() + definition.address;
+
+    // the words created with DOES> branch to the code after a DOES> of a
+    // word before them
+    if (definition.does) {
+        if ((definition.size != 4) || (cells[0] != static_cast<Cell>(Opcode::Literal)) ||
+            (cells[2] != static_cast<Cell>(Opcode::Branch)))
+            return false;
+
+        auto target = static_cast<std::ptrdiff_t>(definition.address + 3) + static_cast<std::ptrdiff_t>(cells[3]);
+        return !definition.effect.known &&
+               std::any_of(dictionary.begin(), dictionary.begin() + static_cast<std::ptrdiff_t>(index),
+                           [&](const Word& other) {
+            const Cell* body = code.data() + other.address;
+            for (std::size_t ip = 0; ip < other.size; ip += 1 + operandCells(static_cast<Opcode>(body[ip]))) {
+                if ((body[ip] == static_cast<Cell>(Opcode::Does)) &&
+                    (static_cast<std::ptrdiff_t>(other.address + ip + 1) + body[ip + 1] == target))
+                    return true;
+            }
+            return false;
+        });
+    }
+
+    if ((definition.size == 0) || !validCode(cells, definition.size, index + 1, true))
+        return false;
+
+    // a known effect is checked from the entry guard, the callers rely on it
+    const StackEffect& effect = definition.effect;
+    std::vector<Instruction> program = decode(cells, definition.size);
+    if (!checkReturnStack(program))
+        return false;
+    if (effect.known && ((effect.in < 0) || (effect.out < 0) ||
+                         (static_cast<std::size_t>(effect.in) > kSandboxDepth) ||
+                         (static_cast<std::size_t>(effect.out) > kSandboxDepth) ||
+                         ((effect.in > 0) && ((program[0].op != Opcode::Guard) || (program[0].operand < effect.in)))))
+        return false;
+
+    // lowest depth of the data stack guaranteed by the guards, depth
+    // relative to the entry and loop nesting, before every instruction.
+    // The guards and the effects are at most kSandboxDepth, the depths
+    // stay far from the limits of 64 bits.
+    struct State {
+        std::int64_t depth;
+        std::int64_t relative;
+        int level;
+    };
+    std::vector<std::optional<State>> states(program.size());
+    std::vector<std::size_t> pending;
+    bool valid {true};
+
+    auto reach = [&](std::size_t to, State state) {
+        if ((to >= program.size()) || (state.level < 0)) {
+            valid = false;
+        } else if (!states[to]) {
+            states[to] = state;
+            pending.push_back(to);
+        } else if ((states[to]->level != state.level) || (effect.known && (states[to]->relative != state.relative))) {
+            valid = false;
+        } else if (state.depth < states[to]->depth) {
+            states[to]->depth = state.depth;
+            pending.push_back(to);
+        }
+    };
+
+    reach(0, {0, 0, 0});
+    while (valid && !pending.empty()) {
+        std::size_t i = pending.back(); pending.pop_back();
+        const Instruction& instruction = program[i];
+        State state = *states[i];
+
+        OpcodeEffect taken = effectOf(instruction.op);
+        bool unknown {false};
+        switch (instruction.op) {
+            case Opcode::Guard:
+                // no word of a program needs a deeper stack
+                valid = (instruction.operand >= 0) && (static_cast<std::size_t>(instruction.operand) <= kSandboxDepth);
+                state.depth = std::max<std::int64_t>(state.depth, instruction.operand);
+                break;
+            case Opcode::Call: {
+                // the callers of a word of unknown effect are guarded after it
+                const StackEffect& callee = dictionary[static_cast<std::size_t>(instruction.operand)].effect;
+                if (callee.known) {
+                    state.depth = std::max<std::int64_t>(state.depth, callee.in);
+                    taken = {callee.in, callee.out};
+                } else {
+                    unknown = true;
+                }
+                break;
+            }
+            case Opcode::Execute:
+            case Opcode::Does:
+                unknown = true;
+                break;
+            case Opcode::Loop:
+            case Opcode::PlusLoop:
+            case Opcode::Unloop:
+            case Opcode::I:
+            case Opcode::IAdd:
+            case Opcode::IndexCell:
+                valid = (state.level >= 1);
+                break;
+            case Opcode::J:
+                valid = (state.level >= 2);
+                break;
+            default:
+                break;
+        }
+
+        if (!valid || (state.depth < taken.in) || (unknown && effect.known))
+            return false;
+
+        State next {unknown ? 0 : state.depth - taken.in + taken.out, state.relative - taken.in + taken.out,
+                    state.level};
+        switch (instruction.op) {
+            case Opcode::Exit:
+                if ((next.level != 0) || (effect.known && (next.relative != effect.out - effect.in)))
+                    return false;
+                break;
+            case Opcode::Branch:
+                reach(instruction.target, next);
+                break;
+            case Opcode::Leave:
+                reach(instruction.target, {next.depth, next.relative, next.level - 1});
+                break;
+            case Opcode::ZeroBranch:
+            case Opcode::NonZeroBranch:
+            case Opcode::DupZeroBranch:
+                reach(instruction.target, next);
+                reach(i + 1, next);
+                break;
+            case Opcode::Do:
+                reach(i + 1, {next.depth, next.relative, next.level + 1});
+                break;
+            case Opcode::QDo:
+                reach(instruction.target, next);
+                reach(i + 1, {next.depth, next.relative, next.level + 1});
+                break;
+            case Opcode::Loop:
+            case Opcode::PlusLoop:
+                reach(instruction.target, next);
+                reach(i + 1, {next.depth, next.relative, next.level - 1});
+                break;
+            case Opcode::Unloop:
+                reach(i + 1, {next.depth, next.relative, next.level - 1});
+                break;
+            case Opcode::Does:
+                // entered from the words created, after their address
+                reach(instruction.target, {1, 0, 0});
+                reach(i + 1, next);
+                break;
+            default:
+                reach(i + 1, next);
+                break;
+        }
+    }
+
+    return valid;
+}
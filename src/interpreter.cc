@@ -0,0 +1,951 @@
+/*
+ * @file    interpreter.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Forth Virtual Machine inner interpreter
+ */
+
+// ----- includes
+#include "forth_vm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+// ----- helpers
+namespace {
+
+// largest number of cells taken by a native word, saved for its faults
+constexpr int kNativeInputs {16};
+
+// length of an array, the negative ones are empty
+std::size_t length(Cell count)
+{
+    return static_cast<std::size_t>(std::max<Cell>(count, 0));
+}
+
+// float converted to a cell, toward zero and saturated, NaN as 0
+Cell toCell(double value)
+{
+    constexpr auto kMin = static_cast<double>(std::numeric_limits<Cell>::min());
+    if (std::isnan(value))
+        return 0;
+    if (value <= kMin)
+        return std::numeric_limits<Cell>::min();
+    if (value >= -kMin)
+        return std::numeric_limits<Cell>::max();
+    return static_cast<Cell>(value);
+}
+
+}
+
+
+// ----- dispatch macros
+// trace points, compiled to nothing unless FORTH_TRACE is defined
+#define TRACE(event, value) \
+    FORTH_TRACE_EVENT(trace_, TraceEvent::event, static_cast<std::uint32_t>(value), stack_.size())
+
+// the profiled interpreter times every instruction before dispatching it
+#define PROFILE()       if constexpr (Profile) profiler_.instruction(static_cast<Opcode>(code[ip]), stack_.size())
+
+// the data space accesses are checked against the allotted space, unless
+// the build is unchecked
+#define CHECK_ADDRESS(address)                              \
+    if (!data_.valid(address)) {                            \
+        error() << "Error: invalid address!\n";             \
+        TRACE(Error, TraceError::InvalidAddress);           \
+        goto error;                                         \
+    }
+
+#define CHECK_ARRAY(address, count)                         \
+    if (!data_.valid(address, count)) {                     \
+        error() << "Error: invalid address!\n";             \
+        TRACE(Error, TraceError::InvalidAddress);           \
+        goto error;                                         \
+    }
+
+#define CHECK_BYTES(address, size)                          \
+    if (!data_.validBytes(address, size)) {                 \
+        error() << "Error: invalid address!\n";             \
+        TRACE(Error, TraceError::InvalidAddress);           \
+        goto error;                                         \
+    }
+
+#define CHECK_REALS(address, count)                         \
+    if (!data_.validReals(address, count)) {                \
+        error() << "Error: invalid address!\n";             \
+        TRACE(Error, TraceError::InvalidAddress);           \
+        goto error;                                         \
+    }
+
+// the words reading the return stack check it holds the cells they need
+// above the base of the execution
+#define CHECK_RSTACK(count)                                 \
+    if (rstack_.size() < base + (count)) {                  \
+        error() << "Error: return stack underflow!\n";      \
+        TRACE(Error, TraceError::StackUnderflow);           \
+        goto error;                                         \
+    }
+
+// the divisions check their divisor, and that their quotient fits in a cell
+#define CHECK_DIVISOR(divisor)                              \
+    if ((divisor) == 0) {                                   \
+        error() << "Error: division by zero!\n";            \
+        TRACE(Error, TraceError::DivisionByZero);           \
+        goto error;                                         \
+    }
+
+#define CHECK_QUOTIENT(condition)                           \
+    if (condition) {                                        \
+        error() << "Error: quotient overflow!\n";           \
+        TRACE(Error, TraceError::Overflow);                 \
+        goto error;                                         \
+    }
+
+// the branches and the calls stop once the program is interrupted from
+// another thread, so that no loop nor recursion runs forever. A sandboxed
+// program also stops there once one of its stacks grows too deep.
+#define CHECK_INTERRUPT()                                   \
+    if (interrupted_.load(std::memory_order_relaxed)) {     \
+        error() << "Error: interrupted!\n";                 \
+        TRACE(Error, TraceError::Interrupted);              \
+        goto error;                                         \
+    }                                                       \
+    if (sandbox_ && ((stack_.size() > kSandboxDepth) || (rstack_.size() > kSandboxDepth) || \
+                     (fstack_.size() > kSandboxDepth))) {   \
+        error() << "Error: stack overflow!\n";              \
+        TRACE(Error, TraceError::Overflow);                 \
+        goto error;                                         \
+    }
+
+// the guards only check the data stack, the floating point words check
+// their own stack
+#define CHECK_FLOATS(count)                                 \
+    if (fstack_.size() < (count)) {                         \
+        error() << "Error: not enough floats!\n";           \
+        TRACE(Error, TraceError::StackUnderflow);           \
+        goto error;                                         \
+    }
+
+#ifdef FORTH_COMPUTED_GOTO
+#define OPCODE(name)    op_##name
+#define NEXT()          do { PROFILE(); goto *dispatch[code[ip++]]; } while (false)
+#else
+#define OPCODE(name)    case Opcode::name
+#define NEXT()          goto next
+#endif
+
+
+// ----- private implementation
+
+/* execute the threaded code of a user defined function
+ * Args:
+ *  address : the entry point of the function in the code space
+ *  base    : the depth of the return stack at which the execution ends
+ */
+void ForthVM::execute(std::size_t address, std::size_t base)
+{
+    if (profiler_.enabled()) {
+        interpret<true>(address, base);
+        profiler_.flush();
+    } else {
+        interpret<false>(address, base);
+    }
+}
+
+/* inner interpreter, with or without the profiling of every instruction
+ * Args:
+ *  address : the entry point of the function in the code space
+ *  base    : the depth of the return stack at which the execution ends
+ */
+template<bool Profile>
+void ForthVM::interpret(std::size_t address, std::size_t base)
+{
+#ifdef FORTH_COMPUTED_GOTO
+    // one label per opcode, in execution token order
+    static const void* const dispatch[] = {
+#define X(name, in, out) &&op_##name,
+        FORTH_OPCODES(X)
+#undef X
+    };
+#endif
+
+    // the return stack is unwound to its base on errors, the calls still
+    // open are closed in the profile and in the trace
+    const std::size_t frames {profiler_.frames()};
+    [[maybe_unused]] std::ptrdiff_t calls {0};
+    const Cell* code {code_.data()};
+    std::size_t ip {address};
+
+#ifdef FORTH_COMPUTED_GOTO
+    NEXT();
+#else
+next:
+    PROFILE();
+    switch (static_cast<Opcode>(code[ip++])) {
+#endif
+
+    // ----- threading
+    OPCODE(Exit): {
+        if (rstack_.size() <= base)
+            return;
+        TRACE(WordExit, 0);
+        if constexpr (Profile)
+            profiler_.leave();
+        --calls;
+        ip = static_cast<std::size_t>(rstack_.back()); rstack_.pop_back();
+    } NEXT();
+
+    OPCODE(Literal): {
+        stack_.push_back(code[ip++]);
+    } NEXT();
+
+    OPCODE(Call): {
+        CHECK_INTERRUPT();
+        auto index = static_cast<std::size_t>(code[ip]);
+        Runtime& runtime = runtime_[index];
+        TRACE(WordEnter, index);
+        if constexpr (Profile)
+            profiler_.enter(index, stack_.size());
+
+        // hot words leave the interpreter for their native code
+        if ((runtime.native.entry == nullptr) && (++runtime.calls == jit_threshold_))
+            tierUp(index);
+        // a native word stopped on an error runs again here, to report it
+        if ((runtime.native.entry != nullptr) && runNative(word(index), runtime)) {
+            TRACE(WordExit, 0);
+            if constexpr (Profile)
+                profiler_.leave();
+            ++ip;
+            NEXT();
+        }
+
+        ++calls;
+        rstack_.push_back(static_cast<Cell>(ip + 1));
+        ip = word(index).address;
+    } NEXT();
+
+    OPCODE(Guard): {
+        // single depth check for the unchecked instructions that follow
+        if (stack_.size() < static_cast<std::size_t>(code[ip])) {
+            error() << "Error: not enough values on the stack!\n";
+            TRACE(Error, TraceError::StackUnderflow);
+            goto error;
+        }
+        ++ip;
+    } NEXT();
+
+    // ----- control flow
+    OPCODE(Branch): {
+        CHECK_INTERRUPT();
+        ip += static_cast<std::size_t>(code[ip]);
+    } NEXT();
+
+    OPCODE(ZeroBranch): {
+        // a false condition jumps over the branch
+        Cell condition = stack_.back(); stack_.pop_back();
+        if (condition == 0) {
+            TRACE(BranchTaken, ip - 1);
+            CHECK_INTERRUPT();
+            ip += static_cast<std::size_t>(code[ip]);
+        } else {
+            TRACE(BranchNotTaken, ip - 1);
+            ++ip;
+        }
+    } NEXT();
+
+    // ----- loops
+    OPCODE(Do): {
+        // return stack: limit index
+        Cell index = stack_.back(); stack_.pop_back();
+        Cell limit = stack_.back(); stack_.pop_back();
+        rstack_.push_back(limit);
+        rstack_.push_back(index);
+    } NEXT();
+
+    OPCODE(QDo): {
+        // skip the whole loop when there is nothing to iterate
+        Cell index = stack_.back(); stack_.pop_back();
+        Cell limit = stack_.back(); stack_.pop_back();
+        if (index == limit) {
+            ip += static_cast<std::size_t>(code[ip]);
+        } else {
+            rstack_.push_back(limit);
+            rstack_.push_back(index);
+            ++ip;
+        }
+    } NEXT();
+
+    OPCODE(Loop): {
+        // counted loop fast path: one increment and one compare in place,
+        // the index wraps around past the largest cell. The compiler and
+        // the image loader refuse the unbalanced return stacks, the loop
+        // parameters are always there
+        Cell* params = rstack_.data() + rstack_.size() - 2;
+        params[1] = static_cast<Cell>(static_cast<UCell>(params[1]) + 1);
+        if (params[1] != params[0]) {
+            CHECK_INTERRUPT();
+            ip += static_cast<std::size_t>(code[ip]);
+        } else {
+            rstack_.resize(rstack_.size() - 2);
+            ++ip;
+        }
+    } NEXT();
+
+    OPCODE(PlusLoop): {
+        // the loop ends when the index crosses the boundary between
+        // limit-1 and limit, in either direction
+        // the distance to the limit wraps around, the index and the limit
+        // may be as far apart as a cell allows
+        auto step = static_cast<UCell>(stack_.back()); stack_.pop_back();
+        Cell* params = rstack_.data() + rstack_.size() - 2;
+        UCell before = static_cast<UCell>(params[1]) - static_cast<UCell>(params[0]);
+        UCell after = before + step;
+        params[1] = static_cast<Cell>(static_cast<UCell>(params[1]) + step);
+
+        if (static_cast<Cell>((before ^ after) & (before ^ step)) >= 0) {
+            CHECK_INTERRUPT();
+            ip += static_cast<std::size_t>(code[ip]);
+        } else {
+            rstack_.resize(rstack_.size() - 2);
+            ++ip;
+        }
+    } NEXT();
+
+    OPCODE(Leave): {
+        CHECK_RSTACK(2);
+        rstack_.resize(rstack_.size() - 2);
+        ip += static_cast<std::size_t>(code[ip]);
+    } NEXT();
+
+    OPCODE(Unloop): {
+        CHECK_RSTACK(2);
+        rstack_.resize(rstack_.size() - 2);
+    } NEXT();
+
+    OPCODE(I): {
+        CHECK_RSTACK(1);
+        stack_.push_back(rstack_.back());
+    } NEXT();
+
+    OPCODE(J): {
+        CHECK_RSTACK(3);
+        stack_.push_back(rstack_[rstack_.size() - 3]);
+    } NEXT();
+
+    // ----- return stack
+    OPCODE(ToR): {
+        rstack_.push_back(stack_.back()); stack_.pop_back();
+    } NEXT();
+
+    OPCODE(RFrom): {
+        CHECK_RSTACK(1);
+        stack_.push_back(rstack_.back()); rstack_.pop_back();
+    } NEXT();
+
+    OPCODE(RFetch): {
+        CHECK_RSTACK(1);
+        stack_.push_back(rstack_.back());
+    } NEXT();
+
+    // ----- arithmetic operators
+    OPCODE(Add): binaryOperator<UCell>(std::plus<>()); NEXT();
+    OPCODE(Sub): binaryOperator<UCell>(std::minus<>()); NEXT();
+    OPCODE(Mul): binaryOperator<UCell>(std::multiplies<>()); NEXT();
+    OPCODE(Div): {
+        CHECK_DIVISOR(stack_.back());
+        CHECK_QUOTIENT((stack_.back() == -1) && (stack_[stack_.size() - 2] == std::numeric_limits<Cell>::min()));
+        binaryOperator(std::divides<>());
+    } NEXT();
+
+    OPCODE(Mod): {
+        CHECK_DIVISOR(stack_.back());
+        CHECK_QUOTIENT((stack_.back() == -1) && (stack_[stack_.size() - 2] == std::numeric_limits<Cell>::min()));
+        binaryOperator(std::modulus<>());
+    } NEXT();
+    OPCODE(Negate): unaryOperator<UCell>(std::negate<>()); NEXT();
+
+    OPCODE(MStar): {
+        Cell b = stack_.back(); stack_.pop_back();
+        Cell a = stack_.back(); stack_.pop_back();
+        pushDouble(static_cast<DoubleCell>(a) * b);
+    } NEXT();
+
+    OPCODE(UMStar): {
+        auto b = static_cast<UCell>(stack_.back()); stack_.pop_back();
+        auto a = static_cast<UCell>(stack_.back()); stack_.pop_back();
+        pushDouble(static_cast<DoubleCell>(static_cast<UDoubleCell>(a) * b));
+    } NEXT();
+
+    OPCODE(UMSlashMod): {
+        // the quotient fits in a cell when the high cell of the dividend is
+        // below the divisor
+        auto divisor = static_cast<UCell>(stack_.back());
+        CHECK_DIVISOR(divisor);
+        CHECK_QUOTIENT(static_cast<UCell>(stack_[stack_.size() - 2]) >= divisor);
+        stack_.pop_back();
+        auto dividend = static_cast<UDoubleCell>(popDouble());
+        stack_.push_back(static_cast<Cell>(static_cast<UCell>(dividend % divisor)));
+        stack_.push_back(static_cast<Cell>(static_cast<UCell>(dividend / divisor)));
+    } NEXT();
+
+    OPCODE(StarSlash): {
+        // the product of two cells never overflows a double cell, the
+        // quotient may overflow a cell
+        Cell c = stack_.back();
+        CHECK_DIVISOR(c);
+        DoubleCell quotient = static_cast<DoubleCell>(stack_[stack_.size() - 3]) * stack_[stack_.size() - 2] / c;
+        CHECK_QUOTIENT((quotient < std::numeric_limits<Cell>::min()) || (quotient > std::numeric_limits<Cell>::max()));
+        stack_.resize(stack_.size() - 2);
+        stack_.back() = static_cast<Cell>(quotient);
+    } NEXT();
+
+    // ----- double cells
+    OPCODE(SToD): {
+        stack_.push_back((stack_.back() < 0) ? -1 : 0);
+    } NEXT();
+
+    OPCODE(DAdd): {
+        auto b = static_cast<UDoubleCell>(popDouble());
+        auto a = static_cast<UDoubleCell>(popDouble());
+        pushDouble(static_cast<DoubleCell>(a + b));
+    } NEXT();
+
+    OPCODE(DNegate): {
+        pushDouble(static_cast<DoubleCell>(UDoubleCell {0} - static_cast<UDoubleCell>(popDouble())));
+    } NEXT();
+
+    OPCODE(DDot): output_.number(popDouble(), ForthVM::base()); NEXT();
+
+    // ----- comparison operators
+    OPCODE(Greater): binaryOperator(std::greater<>()); NEXT();
+    OPCODE(Lesser): binaryOperator(std::less<>()); NEXT();
+    OPCODE(Equal): binaryOperator(std::equal_to<>()); NEXT();
+    OPCODE(NotEqual): binaryOperator(std::not_equal_to<>()); NEXT();
+
+    OPCODE(ZeroEqual): zeroCompare(ZeroCompFcn::Equal); NEXT();
+    OPCODE(ZeroLesser): zeroCompare(ZeroCompFcn::Lesser); NEXT();
+    OPCODE(ZeroGreater): zeroCompare(ZeroCompFcn::Greater); NEXT();
+    OPCODE(ZeroNotEqual): zeroCompare(ZeroCompFcn::Not_Equal); NEXT();
+
+    // ----- stack manipulation
+    OPCODE(Dup): dup(); NEXT();
+    OPCODE(Drop): drop(); NEXT();
+    OPCODE(Swap): swap(); NEXT();
+    OPCODE(Over): over(); NEXT();
+    OPCODE(Rot): rot(); NEXT();
+
+    // ----- bitwise operators
+    OPCODE(And): binaryOperator(std::bit_and<>()); NEXT();
+    OPCODE(Or): binaryOperator(std::bit_or<>()); NEXT();
+    OPCODE(Xor): binaryOperator(std::bit_xor<>()); NEXT();
+    OPCODE(Not): unaryOperator(std::bit_not<>()); NEXT();
+
+    // ----- stack display
+    OPCODE(Dot): display(DisplayFcn::Top); NEXT();
+    OPCODE(Emit): display(DisplayFcn::Emit); NEXT();
+    OPCODE(Cr): output_.put('\n'); NEXT();
+
+    OPCODE(Type): {
+        Cell size = stack_.back(); stack_.pop_back();
+        Cell address = stack_.back(); stack_.pop_back();
+        CHECK_BYTES(address, size);
+        output_.write({reinterpret_cast<const char*>(data_.bytes(address)), length(size)});
+    } NEXT();
+
+    OPCODE(Flush): output_.flush(); NEXT();
+
+    // ----- tasks
+    OPCODE(Execute): {
+        CHECK_INTERRUPT();
+        auto index = static_cast<std::size_t>(stack_.back()); stack_.pop_back();
+        if (index >= wordCount()) {
+            error() << "Error: invalid execution token!\n";
+            goto error;
+        }
+        TRACE(WordEnter, index);
+        if constexpr (Profile)
+            profiler_.enter(index, stack_.size());
+
+        ++calls;
+        rstack_.push_back(static_cast<Cell>(ip));
+        ip = word(index).address;
+    } NEXT();
+
+    OPCODE(Spawn): {
+        auto index = static_cast<std::size_t>(stack_.back()); stack_.pop_back();
+        if (index >= wordCount()) {
+            error() << "Error: invalid execution token!\n";
+            goto error;
+        }
+        if (sandbox_ && (tasks_.size() >= kSandboxTasks)) {
+            error() << "Error: too many tasks!\n";
+            goto error;
+        }
+        tasks_.push_back({{}, {}, {}, word(index).address});
+    } NEXT();
+
+    OPCODE(Pause): {
+        // a task goes back to the scheduler, the main program runs the tasks
+        if (in_task_) {
+            paused_ = ip;
+            return;
+        }
+
+        // the tasks may have grown the code space
+        schedule();
+        code = code_.data();
+    } NEXT();
+
+    OPCODE(Key): {
+        if (sandbox_) {
+            error() << "Error: KEY is not available here!\n";
+            goto error;
+        }
+
+        // waiting for the input lets the other tasks run, KEY is retried
+        output_.flush();
+        auto key = readKey(tasks_.empty() && !in_task_);
+        if (key) {
+            stack_.push_back(*key);
+        } else if (in_task_) {
+            paused_ = ip - 1;
+            return;
+        } else {
+            schedule();
+            code = code_.data();
+            --ip;
+        }
+    } NEXT();
+
+    // ----- data space
+    OPCODE(Fetch): {
+        Cell address = stack_.back();
+        CHECK_ADDRESS(address);
+        stack_.back() = data_.fetch(address);
+    } NEXT();
+
+    OPCODE(Store): {
+        Cell address = stack_.back(); stack_.pop_back();
+        Cell value = stack_.back(); stack_.pop_back();
+        CHECK_ADDRESS(address);
+        data_.store(address, value);
+    } NEXT();
+
+    OPCODE(PlusStore): {
+        Cell address = stack_.back(); stack_.pop_back();
+        Cell value = stack_.back(); stack_.pop_back();
+        CHECK_ADDRESS(address);
+        data_.store(address, static_cast<Cell>(static_cast<std::make_unsigned_t<Cell>>(data_.fetch(address))
+                                               + static_cast<std::make_unsigned_t<Cell>>(value)));
+    } NEXT();
+
+    OPCODE(Here): {
+        stack_.push_back(static_cast<Cell>(data_.here()));
+    } NEXT();
+
+    OPCODE(Allot): {
+        Cell size = stack_.back(); stack_.pop_back();
+        if (!data_.allot(size)) {
+            error() << "Error: data space exhausted!\n";
+            goto error;
+        }
+    } NEXT();
+
+    OPCODE(Comma): {
+        auto address = static_cast<Cell>(data_.here());
+        if (!data_.allot(sizeof(Cell))) {
+            error() << "Error: data space exhausted!\n";
+            goto error;
+        }
+        data_.store(address, stack_.back()); stack_.pop_back();
+    } NEXT();
+
+    OPCODE(Cells): {
+        stack_.back() = static_cast<Cell>(static_cast<UCell>(stack_.back()) * sizeof(Cell));
+    } NEXT();
+
+    OPCODE(Base): {
+        stack_.push_back(kBaseAddress);
+    } NEXT();
+
+    OPCODE(Hex): data_.store(kBaseAddress, 16); NEXT();
+    OPCODE(Decimal): data_.store(kBaseAddress, 10); NEXT();
+
+    OPCODE(Create): {
+        // the name follows the defining word in the input
+        auto name = tokenizer_.next();
+        if (!name) {
+            error() << "Error: CREATE without a name!\n";
+            goto error;
+        }
+        create(*name);
+        code = code_.data();
+    } NEXT();
+
+    OPCODE(Does): {
+        if (!does(ip + static_cast<std::size_t>(code[ip])))
+            goto error;
+        ++ip;
+    } NEXT();
+
+    // ----- vector words
+    OPCODE(VFill): {
+        Cell value = stack_.back(); stack_.pop_back();
+        Cell count = stack_.back(); stack_.pop_back();
+        Cell address = stack_.back(); stack_.pop_back();
+        CHECK_ARRAY(address, count);
+        vector_.fill(data_.writable(address, length(count) * sizeof(Cell)), length(count), value);
+    } NEXT();
+
+    OPCODE(VAdd): {
+        Cell count = stack_.back(); stack_.pop_back();
+        Cell destination = stack_.back(); stack_.pop_back();
+        Cell b = stack_.back(); stack_.pop_back();
+        Cell a = stack_.back(); stack_.pop_back();
+        CHECK_ARRAY(a, count);
+        CHECK_ARRAY(b, count);
+        CHECK_ARRAY(destination, count);
+        vector_.add(data_.bytes(a), data_.bytes(b), data_.writable(destination, length(count) * sizeof(Cell)),
+                    length(count));
+    } NEXT();
+
+    OPCODE(VMul): {
+        Cell count = stack_.back(); stack_.pop_back();
+        Cell destination = stack_.back(); stack_.pop_back();
+        Cell b = stack_.back(); stack_.pop_back();
+        Cell a = stack_.back(); stack_.pop_back();
+        CHECK_ARRAY(a, count);
+        CHECK_ARRAY(b, count);
+        CHECK_ARRAY(destination, count);
+        vector_.mul(data_.bytes(a), data_.bytes(b), data_.writable(destination, length(count) * sizeof(Cell)),
+                    length(count));
+    } NEXT();
+
+    OPCODE(VSum): {
+        Cell count = stack_.back(); stack_.pop_back();
+        Cell address = stack_.back();
+        CHECK_ARRAY(address, count);
+        stack_.back() = vector_.sum(data_.bytes(address), length(count));
+    } NEXT();
+
+    OPCODE(VMin): {
+        Cell count = stack_.back(); stack_.pop_back();
+        Cell address = stack_.back();
+        CHECK_ARRAY(address, count);
+        stack_.back() = vector_.min(data_.bytes(address), length(count));
+    } NEXT();
+
+    OPCODE(VMax): {
+        Cell count = stack_.back(); stack_.pop_back();
+        Cell address = stack_.back();
+        CHECK_ARRAY(address, count);
+        stack_.back() = vector_.max(data_.bytes(address), length(count));
+    } NEXT();
+
+    OPCODE(VDot): {
+        Cell count = stack_.back(); stack_.pop_back();
+        Cell b = stack_.back(); stack_.pop_back();
+        Cell a = stack_.back();
+        CHECK_ARRAY(a, count);
+        CHECK_ARRAY(b, count);
+        stack_.back() = vector_.dot(data_.bytes(a), data_.bytes(b), length(count));
+    } NEXT();
+
+    OPCODE(VCountEq): {
+        Cell value = stack_.back(); stack_.pop_back();
+        Cell count = stack_.back(); stack_.pop_back();
+        Cell address = stack_.back();
+        CHECK_ARRAY(address, count);
+        stack_.back() = vector_.count(data_.bytes(address), length(count), value);
+    } NEXT();
+
+    // ----- floating point stack
+    OPCODE(FAdd): {
+        CHECK_FLOATS(2);
+        double b = fstack_.back(); fstack_.pop_back();
+        fstack_.back() += b;
+    } NEXT();
+
+    OPCODE(FSub): {
+        CHECK_FLOATS(2);
+        double b = fstack_.back(); fstack_.pop_back();
+        fstack_.back() -= b;
+    } NEXT();
+
+    OPCODE(FMul): {
+        CHECK_FLOATS(2);
+        double b = fstack_.back(); fstack_.pop_back();
+        fstack_.back() *= b;
+    } NEXT();
+
+    OPCODE(FDiv): {
+        CHECK_FLOATS(2);
+        double b = fstack_.back(); fstack_.pop_back();
+        fstack_.back() /= b;
+    } NEXT();
+
+    OPCODE(FMulAdd): {
+        CHECK_FLOATS(3);
+        double c = fstack_.back(); fstack_.pop_back();
+        double b = fstack_.back(); fstack_.pop_back();
+        fstack_.back() = std::fma(fstack_.back(), b, c);
+    } NEXT();
+
+    OPCODE(FSqrt): {
+        CHECK_FLOATS(1);
+        fstack_.back() = std::sqrt(fstack_.back());
+    } NEXT();
+
+    OPCODE(FFloor): {
+        CHECK_FLOATS(1);
+        fstack_.back() = std::floor(fstack_.back());
+    } NEXT();
+
+    OPCODE(FDup): {
+        CHECK_FLOATS(1);
+        fstack_.push_back(fstack_.back());
+    } NEXT();
+
+    OPCODE(FDrop): {
+        CHECK_FLOATS(1);
+        fstack_.pop_back();
+    } NEXT();
+
+    OPCODE(FSwap): {
+        CHECK_FLOATS(2);
+        std::swap(fstack_[fstack_.size() - 1], fstack_[fstack_.size() - 2]);
+    } NEXT();
+
+    OPCODE(FDot): {
+        CHECK_FLOATS(1);
+        output_.real(fstack_.back()); fstack_.pop_back();
+    } NEXT();
+
+    OPCODE(SToF): {
+        fstack_.push_back(static_cast<double>(stack_.back())); stack_.pop_back();
+    } NEXT();
+
+    OPCODE(FToS): {
+        CHECK_FLOATS(1);
+        stack_.push_back(toCell(fstack_.back())); fstack_.pop_back();
+    } NEXT();
+
+    OPCODE(FLiteral): {
+        double value;
+        std::memcpy(&value, &code[ip], sizeof(double));
+        fstack_.push_back(value);
+        ip += kRealCells;
+    } NEXT();
+
+    OPCODE(FFetch): {
+        Cell address = stack_.back(); stack_.pop_back();
+        CHECK_BYTES(address, sizeof(double));
+        double value;
+        std::memcpy(&value, data_.bytes(address), sizeof(double));
+        fstack_.push_back(value);
+    } NEXT();
+
+    OPCODE(FStore): {
+        CHECK_FLOATS(1);
+        Cell address = stack_.back(); stack_.pop_back();
+        CHECK_BYTES(address, sizeof(double));
+        std::memcpy(data_.writable(address, sizeof(double)), &fstack_.back(), sizeof(double));
+        fstack_.pop_back();
+    } NEXT();
+
+    OPCODE(Floats): {
+        stack_.back() = static_cast<Cell>(static_cast<UCell>(stack_.back()) * sizeof(double));
+    } NEXT();
+
+    OPCODE(FVMul): {
+        Cell count = stack_.back(); stack_.pop_back();
+        Cell destination = stack_.back(); stack_.pop_back();
+        Cell b = stack_.back(); stack_.pop_back();
+        Cell a = stack_.back(); stack_.pop_back();
+        CHECK_REALS(a, count);
+        CHECK_REALS(b, count);
+        CHECK_REALS(destination, count);
+        vector_.fmul(data_.bytes(a), data_.bytes(b), data_.writable(destination, length(count) * sizeof(double)),
+                     length(count));
+    } NEXT();
+
+    OPCODE(FVSum): {
+        Cell count = stack_.back(); stack_.pop_back();
+        Cell address = stack_.back(); stack_.pop_back();
+        CHECK_REALS(address, count);
+        fstack_.push_back(vector_.fsum(data_.bytes(address), length(count)));
+    } NEXT();
+
+    // ----- superinstructions
+    OPCODE(LitAdd): {
+        stack_.back() = static_cast<Cell>(static_cast<UCell>(stack_.back()) + static_cast<UCell>(code[ip++]));
+    } NEXT();
+
+    OPCODE(Square): {
+        auto value = static_cast<UCell>(stack_.back());
+        stack_.back() = static_cast<Cell>(value * value);
+    } NEXT();
+
+    OPCODE(OverFetch): {
+        Cell address = stack_[stack_.size() - 2];
+        CHECK_ADDRESS(address);
+        stack_.push_back(data_.fetch(address));
+    } NEXT();
+
+    OPCODE(IAdd): {
+        CHECK_RSTACK(1);
+        stack_.back() = static_cast<Cell>(static_cast<UCell>(stack_.back()) + static_cast<UCell>(rstack_.back()));
+    } NEXT();
+
+    OPCODE(LitAnd): {
+        stack_.back() &= code[ip++];
+    } NEXT();
+
+    OPCODE(IndexCell): {
+        CHECK_RSTACK(1);
+        stack_.push_back(static_cast<Cell>(static_cast<UCell>(rstack_.back()) * sizeof(Cell) +
+                                           static_cast<UCell>(code[ip++])));
+    } NEXT();
+
+    OPCODE(NonZeroBranch): {
+        Cell condition = stack_.back(); stack_.pop_back();
+        if (condition != 0) {
+            TRACE(BranchTaken, ip - 1);
+            CHECK_INTERRUPT();
+            ip += static_cast<std::size_t>(code[ip]);
+        } else {
+            TRACE(BranchNotTaken, ip - 1);
+            ++ip;
+        }
+    } NEXT();
+
+    OPCODE(DupZeroBranch): {
+        if (stack_.back() == 0) {
+            TRACE(BranchTaken, ip - 1);
+            CHECK_INTERRUPT();
+            ip += static_cast<std::size_t>(code[ip]);
+        } else {
+            TRACE(BranchNotTaken, ip - 1);
+            ++ip;
+        }
+    } NEXT();
+
+#ifndef FORTH_COMPUTED_GOTO
+    }
+#endif
+
+    // abort the execution, and unwind the return stack
+error:
+    rstack_.resize(base);
+    if constexpr (Profile)
+        profiler_.unwind(frames);
+    for (; calls > 0; --calls)
+        TRACE(WordExit, 0);
+}
+
+/* execute a user defined word from the outer interpreter
+ * Args:
+ *  index : the index of the word in the dictionary
+ */
+void ForthVM::callWord(std::size_t index)
+{
+    Runtime& runtime = runtime_[index];
+    bool profile = profiler_.enabled();
+
+    TRACE(WordEnter, index);
+    if (profile)
+        profiler_.enter(index, stack_.size());
+
+    if ((runtime.native.entry == nullptr) && (++runtime.calls == jit_threshold_))
+        tierUp(index);
+    if ((runtime.native.entry == nullptr) || !runNative(word(index), runtime))
+        execute(word(index).address, rstack_.size());
+
+    TRACE(WordExit, 0);
+    if (profile)
+        profiler_.leave();
+}
+
+/* translate a word to native code, the words the generator does not
+ * support keep running in the interpreter
+ * Args:
+ *  index : the index of the word to translate
+ */
+void ForthVM::tierUp(std::size_t index)
+{
+    const Word& definition = word(index);
+    if (definition.effect.known && (definition.effect.in <= kNativeInputs))
+        runtime_[index].native = jit_.compile(code_.data() + definition.address, definition.size,
+                                              definition.effect.in, definition.effect.out);
+}
+
+/* run the native code of a word on the data stack
+ * Args:
+ *  word    : the word to run
+ *  runtime : its native code
+ * Returns:
+ *  False if the stack does not hold the values taken by the word, or if
+ *  the native code stopped on an error. The stack is left as it was, for
+ *  the interpreter to run the word and report the error.
+ */
+bool ForthVM::runNative(const Word& word, const Runtime& runtime)
+{
+    auto in = static_cast<std::size_t>(word.effect.in);
+    if (stack_.size() < in)
+        return false;
+
+    // the native code works in place, from the first cell it takes, and
+    // only changes the stack: the cells taken are enough to start again
+    std::size_t base = stack_.size() - in;
+    Cell inputs[kNativeInputs];
+    std::copy_n(stack_.data() + base, in, inputs);
+
+    stack_.resize(base + runtime.native.cells);
+    if (runtime.native.entry(stack_.data() + base) != Jit::Fault::None) {
+        stack_.resize(base + in);
+        std::copy_n(inputs, in, stack_.data() + base);
+        return false;
+    }
+    stack_.resize(base + static_cast<std::size_t>(word.effect.out));
+    return true;
+}
+
+/* execute a single builtin from the outer interpreter
+ * Args:
+ *  op : the builtin to execute
+ */
+void ForthVM::executeBuiltin(Opcode op)
+{
+    if (stack_.size() < static_cast<std::size_t>(effectOf(op).in)) {
+        error() << "Error: not enough values on the stack!\n";
+        TRACE(Error, TraceError::StackUnderflow);
+        return;
+    }
+
+    // run it from a scratch area at the end of the code space
+    std::size_t address = code_.size();
+    emit(op);
+    emit(Opcode::Exit);
+
+    execute(address, rstack_.size());
+
+    // unless the builtin defined words after it
+    if (code_.size() == address + 2)
+        code_.resize(address);
+}
+
+#undef TRACE
+#undef CHECK_ADDRESS
+#undef CHECK_ARRAY
+#undef CHECK_BYTES
+#undef CHECK_REALS
+#undef CHECK_RSTACK
+#undef CHECK_DIVISOR
+#undef CHECK_QUOTIENT
+#undef CHECK_INTERRUPT
+#undef CHECK_FLOATS
+#undef PROFILE
+#undef OPCODE
+#undef NEXT
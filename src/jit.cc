@@ -0,0 +1,795 @@
+/*
+ * @file    jit.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Native x86-64 code generator for the hot definitions
+ */
+
+// ----- includes
+#include "jit.h"
+#include "opcodes.h"
+
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// ----- helpers
+namespace {
+
+#if defined(__x86_64__)
+
+// registers, in their encoding order
+enum Reg : int {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11,
+};
+
+// condition codes of the conditional instructions
+enum Cond : std::uint8_t {
+    Overflow    = 0x0,
+    NoOverflow  = 0x1,
+    Zero        = 0x4,
+    NotZero     = 0x5,
+    Less        = 0xC,
+    Greater     = 0xF,
+};
+
+// the first stack cells of a definition live in registers, the others stay
+// in memory. RAX and RDX are scratch registers, RDI holds the address of
+// the first cell taken by the definition.
+constexpr int kSlotRegs[] = {RCX, RSI, R8, R9, R10, R11};
+constexpr int kRegSlots {static_cast<int>(std::size(kSlotRegs))};
+
+// the loop parameters live in the red zone below the stack pointer, as the
+// native code never calls anything
+constexpr int kLoopFrame {16};
+constexpr int kMaxLoops {128 / kLoopFrame};
+
+constexpr bool kWide {sizeof(Cell) == 8};
+constexpr int kCellBits {static_cast<int>(sizeof(Cell)) * CHAR_BIT};
+
+// depth of an instruction not reached yet by the analysis
+constexpr int kUnreached {INT_MIN};
+
+// operand of an instruction: a register, or a memory cell at reg + disp
+struct Loc {
+    bool is_reg;
+    int reg;
+    std::int32_t disp;
+};
+
+// decoded threaded code instruction
+struct Instruction {
+    Opcode op;
+    Cell operand;
+    std::size_t target;     // index of the branch destination
+};
+
+// location of a stack cell, counted from the first one of the definition
+Loc slot(int k)
+{
+    if (k < kRegSlots)
+        return {true, kSlotRegs[k], 0};
+    return {false, RDI, k * static_cast<std::int32_t>(sizeof(Cell))};
+}
+
+// location of the loop parameters of a nesting level
+Loc loopLimit(int level)
+{
+    return {false, RSP, -kLoopFrame * (level + 1)};
+}
+
+Loc loopIndex(int level)
+{
+    return {false, RSP, -kLoopFrame * (level + 1) + 8};
+}
+
+// opcodes translated to native code, the others stay in the interpreter
+bool isCompilable(Opcode op)
+{
+    switch (op) {
+        case Opcode::Call:
+        case Opcode::ToR:
+        case Opcode::RFrom:
+        case Opcode::RFetch:
+        case Opcode::Dot:
+        case Opcode::MStar:
+        case Opcode::UMStar:
+        case Opcode::UMSlashMod:
+        case Opcode::StarSlash:
+        case Opcode::SToD:
+        case Opcode::DAdd:
+        case Opcode::DNegate:
+        case Opcode::DDot:
+        case Opcode::Emit:
+        case Opcode::Cr:
+        case Opcode::Type:
+        case Opcode::Flush:
+        case Opcode::Execute:
+        case Opcode::Spawn:
+        case Opcode::Pause:
+        case Opcode::Key:
+        case Opcode::Fetch:
+        case Opcode::OverFetch:
+        case Opcode::Store:
+        case Opcode::PlusStore:
+        case Opcode::Here:
+        case Opcode::Allot:
+        case Opcode::Comma:
+        case Opcode::Create:
+        case Opcode::Does:
+        case Opcode::Base:
+        case Opcode::Hex:
+        case Opcode::Decimal:
+        case Opcode::VFill:
+        case Opcode::VAdd:
+        case Opcode::VMul:
+        case Opcode::VSum:
+        case Opcode::VMin:
+        case Opcode::VMax:
+        case Opcode::VDot:
+        case Opcode::VCountEq:
+        case Opcode::FAdd:
+        case Opcode::FSub:
+        case Opcode::FMul:
+        case Opcode::FDiv:
+        case Opcode::FMulAdd:
+        case Opcode::FSqrt:
+        case Opcode::FFloor:
+        case Opcode::FDup:
+        case Opcode::FDrop:
+        case Opcode::FSwap:
+        case Opcode::FDot:
+        case Opcode::SToF:
+        case Opcode::FToS:
+        case Opcode::FLiteral:
+        case Opcode::FFetch:
+        case Opcode::FStore:
+        case Opcode::Floats:
+        case Opcode::FVMul:
+        case Opcode::FVSum:
+            return false;
+        default:
+            return true;
+    }
+}
+
+// x86-64 instruction encoder
+class Assembler
+{
+public:
+    std::vector<std::uint8_t> bytes {};
+
+    void byte(std::uint8_t value) {
+        bytes.push_back(value);
+    }
+
+    void imm32(std::int32_t value) {
+        auto u = static_cast<std::uint32_t>(value);
+        for (int shift = 0; shift < 32; shift += 8)
+            byte(static_cast<std::uint8_t>(u >> shift));
+    }
+
+    /* encode an instruction with a ModRM operand
+     * Args:
+     *  opcode : the opcode bytes
+     *  reg    : the register operand, or the opcode extension
+     *  rm     : the register or memory operand
+     *  wide   : true for a 64 bits operation
+     */
+    void emit(std::initializer_list<std::uint8_t> opcode, int reg, const Loc& rm, bool wide = kWide) {
+        auto rex = static_cast<std::uint8_t>(0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) |
+                                             ((rm.reg & 8) ? 0x01 : 0));
+        if (rex != 0x40)
+            byte(rex);
+        for (auto value : opcode)
+            byte(value);
+
+        if (rm.is_reg) {
+            byte(static_cast<std::uint8_t>(0xC0 | ((reg & 7) << 3) | (rm.reg & 7)));
+            return;
+        }
+
+        // [base + disp32], RSP as a base needs a SIB byte
+        byte(static_cast<std::uint8_t>(0x80 | ((reg & 7) << 3) | (rm.reg & 7)));
+        if ((rm.reg & 7) == RSP)
+            byte(0x24);
+        imm32(rm.disp);
+    }
+
+    // reg = src
+    void load(int reg, const Loc& src) {
+        if (!src.is_reg || (src.reg != reg))
+            emit({0x8B}, reg, src);
+    }
+
+    // dst = reg
+    void store(const Loc& dst, int reg) {
+        if (!dst.is_reg || (dst.reg != reg))
+            emit({0x89}, reg, dst);
+    }
+
+    // dst = src, through RDX between two memory cells
+    void move(const Loc& dst, const Loc& src) {
+        if (dst.is_reg) {
+            load(dst.reg, src);
+        } else if (src.is_reg) {
+            store(dst, src.reg);
+        } else {
+            load(RDX, src);
+            store(dst, RDX);
+        }
+    }
+
+    // RAX = value, for the constants too large for an immediate
+    void loadAbsolute(Cell value) {
+        loadAddress(static_cast<std::uint64_t>(value));
+    }
+
+    // RAX = address, whatever the width of the cells
+    void loadAddress(std::uint64_t address) {
+        byte(0x48);
+        byte(0xB8);
+        for (int shift = 0; shift < 64; shift += 8)
+            byte(static_cast<std::uint8_t>(address >> shift));
+    }
+
+    // set the flags on the byte at the address in RAX
+    void testFlag() {
+        emit({0x80}, 7, {false, RAX, 0}, false);
+        byte(0);
+    }
+
+    // dst = value
+    void moveImmediate(const Loc& dst, Cell value) {
+        if (dst.is_reg && (value == 0)) {
+            emit({0x31}, dst.reg, dst, false);
+        } else if (std::in_range<std::int32_t>(value)) {
+            emit({0xC7}, 0, dst);
+            imm32(static_cast<std::int32_t>(value));
+        } else {
+            loadAbsolute(value);
+            store(dst, RAX);
+        }
+    }
+
+    // a = a op b, with the "op r/m, r" and "op r, r/m" forms of the operator
+    void alu(std::uint8_t op_rm_r, std::uint8_t op_r_rm, const Loc& a, const Loc& b) {
+        if (a.is_reg) {
+            emit({op_r_rm}, a.reg, b);
+        } else if (b.is_reg) {
+            emit({op_rm_r}, b.reg, a);
+        } else {
+            load(RAX, b);
+            emit({op_rm_r}, RAX, a);
+        }
+    }
+
+    // a = a + value
+    void addImmediate(const Loc& a, Cell value) {
+        if (std::in_range<std::int32_t>(value)) {
+            emit({0x81}, 0, a);
+            imm32(static_cast<std::int32_t>(value));
+        } else {
+            loadAbsolute(value);
+            alu(0x01, 0x03, a, {true, RAX, 0});
+        }
+    }
+
+    // a = a & value
+    void andImmediate(const Loc& a, Cell value) {
+        if (std::in_range<std::int32_t>(value)) {
+            emit({0x81}, 4, a);
+            imm32(static_cast<std::int32_t>(value));
+        } else {
+            loadAbsolute(value);
+            alu(0x21, 0x23, a, {true, RAX, 0});
+        }
+    }
+
+    // a = a << count
+    void shiftLeft(const Loc& a, int count) {
+        emit({0xC1}, 4, a);
+        byte(static_cast<std::uint8_t>(count));
+    }
+
+    // a = a * b
+    void multiply(const Loc& a, const Loc& b) {
+        if (a.is_reg) {
+            emit({0x0F, 0xAF}, a.reg, b);
+        } else {
+            load(RAX, a);
+            emit({0x0F, 0xAF}, RAX, b);
+            store(a, RAX);
+        }
+    }
+
+    // a = a / b or a = a % b, returning the positions of the jumps taken
+    // when b is 0, and when the quotient overflows (the most negative cell
+    // divided by -1)
+    std::pair<std::size_t, std::size_t> divide(const Loc& a, const Loc& b, bool quotient) {
+        compareZero(b);
+        std::size_t zero = jump(Zero);
+        emit({0x83}, 7, b);
+        byte(0xFF);                 // cmp b, -1
+        std::size_t other = jump(NotZero);
+        load(RAX, a);
+        emit({0xF7}, 3, {true, RAX, 0});
+        std::size_t overflow = jump(Overflow);
+        patch(other, bytes.size());
+
+        load(RAX, a);
+        if (kWide)
+            byte(0x48);
+        byte(0x99);                 // sign extend into RDX
+        emit({0xF7}, 7, b);         // idiv
+        store(a, quotient ? RAX : RDX);
+        return {zero, overflow};
+    }
+
+    // flags of a - 0
+    void compareZero(const Loc& a) {
+        emit({0x83}, 7, a);
+        byte(0);
+    }
+
+    // dst = 1 if the condition holds, 0 otherwise
+    void setFlag(std::uint8_t cond, const Loc& dst) {
+        emit({0x0F, static_cast<std::uint8_t>(0x90 | cond)}, 0, {true, RAX, 0}, false);
+        if (dst.is_reg) {
+            emit({0x0F, 0xB6}, dst.reg, {true, RAX, 0}, false);
+        } else {
+            emit({0x0F, 0xB6}, RAX, {true, RAX, 0}, false);
+            store(dst, RAX);
+        }
+    }
+
+    // jumps, returning the position of their displacement
+    std::size_t jump() {
+        byte(0xE9);
+        imm32(0);
+        return bytes.size() - 4;
+    }
+
+    std::size_t jump(std::uint8_t cond) {
+        byte(0x0F);
+        byte(static_cast<std::uint8_t>(0x80 | cond));
+        imm32(0);
+        return bytes.size() - 4;
+    }
+
+    void patch(std::size_t position, std::size_t target) {
+        auto displacement = static_cast<std::int32_t>(static_cast<std::ptrdiff_t>(target) -
+                                                      static_cast<std::ptrdiff_t>(position + 4));
+        std::memcpy(bytes.data() + position, &displacement, sizeof(displacement));
+    }
+};
+
+#endif
+
+}
+
+
+// ----- public implementation
+
+/* constructor
+ * Args:
+ *  interrupt : the flag that stops the loops of the native code, if any
+ */
+Jit::Jit(const std::atomic<bool>* interrupt) :
+    interrupt_ {interrupt}
+{ }
+
+/* destructor
+ */
+Jit::~Jit()
+{
+    release();
+}
+
+/* release the native code generated so far, no entry point of it may be
+ * called afterwards
+ */
+void Jit::release()
+{
+    for (auto& [address, size] : regions_)
+        ::munmap(address, size);
+    regions_.clear();
+}
+
+/* release the native code of a single definition
+ * Args:
+ *  entry : the entry point returned by compile
+ */
+void Jit::release(Entry_T entry)
+{
+    auto region = std::find_if(regions_.begin(), regions_.end(), [entry](const auto& r) {
+        return r.first == reinterpret_cast<void*>(entry);
+    });
+    if (region == regions_.end())
+        return;
+
+    ::munmap(region->first, region->second);
+    regions_.erase(region);
+}
+
+/* check if native code can be generated on this machine
+ * Returns:
+ *  True on x86-64
+ */
+bool Jit::isSupported()
+{
+#if defined(__x86_64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* translate the threaded code of a definition into native code
+ * Args:
+ *  code : the first cell of the definition
+ *  size : the number of cells of the definition
+ *  in   : the number of cells the definition takes from the stack
+ *  out  : the number of cells it leaves on the stack
+ * Returns:
+ *  The native code, without entry point if the definition uses something
+ *  the generator does not support
+ */
+Jit::Native Jit::compile(const Cell* code, std::size_t size, int in, int out)
+{
+#if defined(__x86_64__)
+    // decode the threaded code
+    std::vector<Instruction> program;
+    std::vector<std::size_t> index(size + 1, 0);
+    for (std::size_t ip = 0; ip < size; ) {
+        index[ip] = program.size();
+
+        auto op = static_cast<Opcode>(code[ip++]);
+        if (!isCompilable(op))
+            return {};
+
+        Instruction instruction {op, 0, 0};
+        if (hasOperand(op)) {
+            instruction.operand = code[ip];
+            if (isBranch(op))
+                instruction.target = ip + static_cast<std::size_t>(code[ip]);
+            ++ip;
+        }
+        program.push_back(instruction);
+    }
+    index[size] = program.size();
+
+    std::size_t n = program.size();
+    for (auto& instruction : program) {
+        if (isBranch(instruction.op))
+            instruction.target = index[instruction.target];
+    }
+
+    // depth of the stack and loop nesting before every instruction, so that
+    // each stack cell has a single location wherever it is used
+    std::vector<int> depth(n, kUnreached);
+    std::vector<int> loops(n, 0);
+    std::vector<std::size_t> pending {0};
+    depth[0] = in;
+
+    int peak = std::max(in, out);
+    int nesting {0};
+    bool consistent {true};
+
+    auto reach = [&](std::size_t to, int d, int level) {
+        if ((to >= n) || (level < 0) || (level > kMaxLoops)) {
+            consistent = false;
+        } else if (depth[to] == kUnreached) {
+            depth[to] = d;
+            loops[to] = level;
+            pending.push_back(to);
+        } else if ((depth[to] != d) || (loops[to] != level)) {
+            consistent = false;
+        }
+    };
+
+    while (!pending.empty() && consistent) {
+        std::size_t i = pending.back(); pending.pop_back();
+        const Instruction& instruction = program[i];
+        int d = depth[i];
+        int level = loops[i];
+
+        OpcodeEffect effect = effectOf(instruction.op);
+        if (d < effect.in)
+            return {};
+        int next = d - effect.in + effect.out;
+        peak = std::max(peak, next);
+
+        switch (instruction.op) {
+            case Opcode::Exit:
+                if ((next != out) || (level != 0))
+                    return {};
+                break;
+            case Opcode::Guard:
+                if (i != 0)
+                    return {};
+                reach(i + 1, next, level);
+                break;
+            case Opcode::Branch:
+                reach(instruction.target, next, level);
+                break;
+            case Opcode::Leave:
+                reach(instruction.target, next, level - 1);
+                break;
+            case Opcode::ZeroBranch:
+            case Opcode::NonZeroBranch:
+            case Opcode::DupZeroBranch:
+                reach(instruction.target, next, level);
+                reach(i + 1, next, level);
+                break;
+            case Opcode::Do:
+                reach(i + 1, next, level + 1);
+                break;
+            case Opcode::QDo:
+                reach(instruction.target, next, level);
+                reach(i + 1, next, level + 1);
+                break;
+            case Opcode::Loop:
+            case Opcode::PlusLoop:
+                reach(instruction.target, next, level);
+                reach(i + 1, next, level - 1);
+                break;
+            case Opcode::Unloop:
+                reach(i + 1, next, level - 1);
+                break;
+            case Opcode::I:
+            case Opcode::J:
+            case Opcode::IAdd:
+            case Opcode::IndexCell:
+                if (level < ((instruction.op == Opcode::J) ? 2 : 1))
+                    return {};
+                reach(i + 1, next, level);
+                break;
+            default:
+                reach(i + 1, next, level);
+                break;
+        }
+        nesting = std::max(nesting, level);
+    }
+
+    if (!consistent || (nesting > kMaxLoops))
+        return {};
+
+    // generate the code, with the branches resolved once every instruction
+    // has been placed
+    Assembler as;
+    std::vector<std::size_t> offset(n + 1, 0);
+    std::vector<std::pair<std::size_t, std::size_t>> fixups;
+    std::vector<std::pair<std::size_t, Fault>> faults;
+
+    for (int k = 0; k < std::min(in, kRegSlots); ++k)
+        as.load(kSlotRegs[k], {false, RDI, k * static_cast<std::int32_t>(sizeof(Cell))});
+
+    for (std::size_t i = 0; i < n; ++i) {
+        offset[i] = as.bytes.size();
+        if (depth[i] == kUnreached)
+            continue;
+
+        const Instruction& instruction = program[i];
+        int d = depth[i];
+        int level = loops[i];
+
+        // the backward jumps check the interrupt flag, so no loop runs forever
+        if ((interrupt_ != nullptr) && isBranch(instruction.op) && (instruction.target <= i)) {
+            as.loadAddress(reinterpret_cast<std::uintptr_t>(interrupt_));
+            as.testFlag();
+            faults.push_back({as.jump(NotZero), Fault::Interrupted});
+        }
+
+        switch (instruction.op) {
+            // ----- threading
+            case Opcode::Exit:
+                if (i + 1 < n)
+                    fixups.push_back({as.jump(), n});
+                break;
+            case Opcode::Literal:
+                as.moveImmediate(slot(d), instruction.operand);
+                break;
+            case Opcode::Guard:
+                // checked by the interpreter before the call
+                break;
+
+            // ----- control flow
+            case Opcode::Branch:
+            case Opcode::Leave:
+                fixups.push_back({as.jump(), instruction.target});
+                break;
+            case Opcode::ZeroBranch:
+            case Opcode::DupZeroBranch:
+                as.compareZero(slot(d - 1));
+                fixups.push_back({as.jump(Zero), instruction.target});
+                break;
+            case Opcode::NonZeroBranch:
+                as.compareZero(slot(d - 1));
+                fixups.push_back({as.jump(NotZero), instruction.target});
+                break;
+
+            // ----- loops
+            case Opcode::Do:
+            case Opcode::QDo:
+                as.move(loopLimit(level), slot(d - 2));
+                as.move(loopIndex(level), slot(d - 1));
+                if (instruction.op == Opcode::QDo) {
+                    as.load(RAX, loopIndex(level));
+                    as.emit({0x3B}, RAX, loopLimit(level));
+                    fixups.push_back({as.jump(Zero), instruction.target});
+                }
+                break;
+            case Opcode::Loop:
+                as.load(RAX, loopIndex(level - 1));
+                as.addImmediate({true, RAX, 0}, 1);
+                as.store(loopIndex(level - 1), RAX);
+                as.emit({0x3B}, RAX, loopLimit(level - 1));
+                fixups.push_back({as.jump(NotZero), instruction.target});
+                break;
+            case Opcode::PlusLoop: {
+                // index - limit with its sign flipped overflows exactly when
+                // the step crosses the boundary between limit-1 and limit
+                Loc step = slot(d - 1);
+                as.load(RAX, loopIndex(level - 1));
+                as.emit({0x2B}, RAX, loopLimit(level - 1));
+                as.emit({0x0F, 0xBA}, 7, {true, RAX, 0});
+                as.byte(static_cast<std::uint8_t>(kCellBits - 1));
+                if (step.is_reg) {
+                    as.emit({0x01}, step.reg, loopIndex(level - 1));
+                } else {
+                    as.load(RDX, step);
+                    as.emit({0x01}, RDX, loopIndex(level - 1));
+                }
+                as.emit({0x03}, RAX, step);
+                fixups.push_back({as.jump(NoOverflow), instruction.target});
+                break;
+            }
+            case Opcode::Unloop:
+                break;
+            case Opcode::I:
+                as.move(slot(d), loopIndex(level - 1));
+                break;
+            case Opcode::J:
+                as.move(slot(d), loopIndex(level - 2));
+                break;
+
+            // ----- arithmetic operators
+            case Opcode::Add:   as.alu(0x01, 0x03, slot(d - 2), slot(d - 1)); break;
+            case Opcode::Sub:   as.alu(0x29, 0x2B, slot(d - 2), slot(d - 1)); break;
+            case Opcode::Mul:   as.multiply(slot(d - 2), slot(d - 1)); break;
+            case Opcode::Div:
+            case Opcode::Mod: {
+                auto [zero, overflow] = as.divide(slot(d - 2), slot(d - 1), instruction.op == Opcode::Div);
+                faults.push_back({zero, Fault::DivisionByZero});
+                faults.push_back({overflow, Fault::Overflow});
+                break;
+            }
+            case Opcode::Negate: as.emit({0xF7}, 3, slot(d - 1)); break;
+
+            // ----- comparison operators
+            case Opcode::Greater:
+            case Opcode::Lesser:
+            case Opcode::Equal:
+            case Opcode::NotEqual: {
+                static constexpr std::uint8_t conditions[] = {Greater, Less, Zero, NotZero};
+                as.alu(0x39, 0x3B, slot(d - 2), slot(d - 1));
+                as.setFlag(conditions[static_cast<int>(instruction.op) - static_cast<int>(Opcode::Greater)],
+                           slot(d - 2));
+                break;
+            }
+            case Opcode::ZeroEqual:
+            case Opcode::ZeroLesser:
+            case Opcode::ZeroGreater:
+            case Opcode::ZeroNotEqual: {
+                static constexpr std::uint8_t conditions[] = {Zero, Less, Greater, NotZero};
+                as.compareZero(slot(d - 1));
+                as.setFlag(conditions[static_cast<int>(instruction.op) - static_cast<int>(Opcode::ZeroEqual)],
+                           slot(d - 1));
+                break;
+            }
+
+            // ----- stack manipulation
+            case Opcode::Dup:
+                as.move(slot(d), slot(d - 1));
+                break;
+            case Opcode::Drop:
+                break;
+            case Opcode::Swap:
+                as.load(RAX, slot(d - 2));
+                as.move(slot(d - 2), slot(d - 1));
+                as.store(slot(d - 1), RAX);
+                break;
+            case Opcode::Over:
+                as.move(slot(d), slot(d - 2));
+                break;
+            case Opcode::Rot:
+                as.load(RAX, slot(d - 3));
+                as.move(slot(d - 3), slot(d - 2));
+                as.move(slot(d - 2), slot(d - 1));
+                as.store(slot(d - 1), RAX);
+                break;
+
+            // ----- bitwise operators
+            case Opcode::And:   as.alu(0x21, 0x23, slot(d - 2), slot(d - 1)); break;
+            case Opcode::Or:    as.alu(0x09, 0x0B, slot(d - 2), slot(d - 1)); break;
+            case Opcode::Xor:   as.alu(0x31, 0x33, slot(d - 2), slot(d - 1)); break;
+            case Opcode::Not:   as.emit({0xF7}, 2, slot(d - 1)); break;
+
+            // ----- superinstructions
+            case Opcode::LitAdd:
+                as.addImmediate(slot(d - 1), instruction.operand);
+                break;
+            case Opcode::Square:
+                as.multiply(slot(d - 1), slot(d - 1));
+                break;
+            case Opcode::IAdd:
+                as.alu(0x01, 0x03, slot(d - 1), loopIndex(level - 1));
+                break;
+            case Opcode::LitAnd:
+                as.andImmediate(slot(d - 1), instruction.operand);
+                break;
+            case Opcode::IndexCell:
+                as.move(slot(d), loopIndex(level - 1));
+                as.shiftLeft(slot(d), std::countr_zero(sizeof(Cell)));
+                as.addImmediate(slot(d), instruction.operand);
+                break;
+
+            default:
+                return {};
+        }
+    }
+
+    // write the cells left in registers back to the stack
+    offset[n] = as.bytes.size();
+    for (int k = 0; k < std::min(out, kRegSlots); ++k)
+        as.store({false, RDI, k * static_cast<std::int32_t>(sizeof(Cell))}, kSlotRegs[k]);
+    as.moveImmediate({true, RAX, 0}, static_cast<Cell>(Fault::None));
+    as.byte(0xC3);
+
+    for (auto [position, target] : fixups)
+        as.patch(position, offset[target]);
+
+    // the faults return their code at once, the caller drops the stack cells
+    for (Fault fault : {Fault::DivisionByZero, Fault::Overflow, Fault::Interrupted}) {
+        std::size_t stub = as.bytes.size();
+        bool used {false};
+        for (auto [position, kind] : faults) {
+            if (kind == fault) {
+                as.patch(position, stub);
+                used = true;
+            }
+        }
+        if (used) {
+            as.moveImmediate({true, RAX, 0}, static_cast<Cell>(fault));
+            as.byte(0xC3);
+        }
+    }
+
+    // copy the code in its own region, executable once written
+    auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    std::size_t length = (as.bytes.size() + page - 1) / page * page;
+    void* region = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+        return {};
+
+    std::memcpy(region, as.bytes.data(), as.bytes.size());
+    if (::mprotect(region, length, PROT_READ | PROT_EXEC) != 0) {
+        ::munmap(region, length);
+        return {};
+    }
+    regions_.push_back({region, length});
+
+    return {reinterpret_cast<Entry_T>(region), static_cast<std::size_t>(peak)};
+#else
+    (void)code; (void)size; (void)in; (void)out;
+    return {};
+#endif
+}
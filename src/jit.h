@@ -0,0 +1,64 @@
+/*
+ * @file    jit.h
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Interface / Native x86-64 code generator for the hot definitions
+ */
+
+// ----- header guards
+#ifndef FORTH_JIT_H_
+#define FORTH_JIT_H_
+
+// ----- includes
+#include "cell.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// ----- class
+class Jit
+{
+public:
+    // runtime errors of the native code, reported by the interpreter
+    enum class Fault : std::int32_t {
+        None,
+        DivisionByZero,
+        Overflow,
+        Interrupted,
+    };
+
+    // native code of a definition, called with the address of the first
+    // stack cell it takes
+    using Entry_T = Fault (*)(Cell*);
+
+    struct Native {
+        Entry_T entry {nullptr};
+        std::size_t cells {0};      // stack cells used from the first one
+    };
+
+    explicit Jit(const std::atomic<bool>* = nullptr);
+    virtual ~Jit();
+
+    // no copy or move semantics
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+    Jit(Jit&&) = delete;
+    Jit& operator=(Jit&&) = delete;
+
+    static bool isSupported();
+    Native compile(const Cell*, std::size_t, int, int);
+    void release();
+    void release(Entry_T);
+
+private:
+    // flag polled on the backward jumps, set to stop the native code
+    const std::atomic<bool>* interrupt_ {nullptr};
+
+    // executable regions, released with the generator
+    std::vector<std::pair<void*, std::size_t>> regions_ {};
+};
+
+#endif // FORTH_JIT_H_
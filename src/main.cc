@@ -6,37 +6,139 @@
  */
 
 // ----- includes
+#include "batch.h"
 #include "forth_vm.h"
+#include "server.h"
 
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <optional>
+#include <string_view>
+#include <thread>
 
 
 // ----- main
 int main(int argc, char* argv[]) {
-    ForthVM forth;
+    // the data space is sized before anything runs in it
+    std::size_t data_size {DataSpace::kDefaultCapacity};
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string_view {argv[i]} == "--data-size")
+            data_size = std::strtoul(argv[i + 1], nullptr, 10);
+    }
+    if ((data_size == 0) || (data_size > (std::size_t {1} << 40))) {
+        std::cerr << "Error: invalid data space size!\n";
+        return 1;
+    }
+
+    ForthVM forth {data_size};
     std::string input;
+    std::string filename;
+    std::string stacks;
+    std::string trace;
+    std::string batch;
+    std::string socket;
+    std::size_t jobs {std::thread::hardware_concurrency()};
+    std::optional<std::size_t> jit_threshold;
+    std::optional<std::chrono::milliseconds> time_limit;
+
+    // options, and the file to run
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg {argv[i]};
+
+        if (arg == "--no-jit") {
+            jit_threshold = 0;
+            forth.setJitThreshold(0);
+        } else if ((arg == "--jit-threshold") && (i + 1 < argc)) {
+            jit_threshold = std::strtoul(argv[++i], nullptr, 10);
+            forth.setJitThreshold(*jit_threshold);
+        } else if (arg == "--profile") {
+            forth.setProfiling(true);
+        } else if ((arg == "--profile-stacks") && (i + 1 < argc)) {
+            // profile, and write the call stacks for the flame graphs
+            forth.setProfiling(true);
+            stacks = argv[++i];
+        } else if ((arg == "--trace") && (i + 1 < argc)) {
+            trace = argv[++i];
+        } else if ((arg == "--image") && (i + 1 < argc)) {
+            // start from a saved dictionary instead of an empty one
+            if (!forth.loadImage(argv[++i]))
+                return 1;
+        } else if ((arg == "--prelude") && (i + 1 < argc)) {
+            // words defined before the program, shared by the batch workers
+            forth.load(argv[++i]);
+        } else if ((arg == "--batch") && (i + 1 < argc)) {
+            batch = argv[++i];
+        } else if ((arg == "--serve") && (i + 1 < argc)) {
+            socket = argv[++i];
+        } else if ((arg == "--jobs") && (i + 1 < argc)) {
+            jobs = std::strtoul(argv[++i], nullptr, 10);
+        } else if ((arg == "--time-limit") && (i + 1 < argc)) {
+            // milliseconds a request or a batch script may run, 0 for no limit
+            time_limit = std::chrono::milliseconds {std::strtoll(argv[++i], nullptr, 10)};
+        } else if ((arg == "--data-size") && (i + 1 < argc)) {
+            ++i;
+        } else {
+            filename = arg;
+        }
+    }
 
-    // look for a file
-    if (argc == 2) {
-        forth.load(argv[1]);
+    // the requests and the batch scripts start from the state reached so far
+    ForthVM::SnapshotPtr_T snapshot;
+    if (!socket.empty() || !batch.empty()) {
+        snapshot = forth.snapshot();
+        if (!snapshot)
+            return 1;
+    }
+
+    // serve the requests
+    if (!socket.empty()) {
+        Server server {snapshot, jobs};
+        if (jit_threshold)
+            server.setJitThreshold(*jit_threshold);
+        if (time_limit)
+            server.setTimeLimit(*time_limit);
+        if (!server.listen(socket))
+            return 1;
+        server.run();
+        return 0;
+    }
+
+    // run the scripts of a batch
+    if (!batch.empty()) {
+        BatchRunner runner {snapshot, jobs};
+        if (jit_threshold)
+            runner.setJitThreshold(*jit_threshold);
+        if (time_limit)
+            runner.setTimeLimit(*time_limit);
+        runner.run(BatchRunner::listScripts(batch), std::cout, std::cerr);
         return 0;
     }
 
-    // launch the interpreter instead
-    std::cout << "Forth Interpreter. Enter 'exit' to quit.\n";
+    // look for a file, or launch the interpreter instead
+    if (!filename.empty()) {
+        forth.load(filename);
+    } else {
+        std::cout << "Forth Interpreter. Enter 'exit' to quit.\n";
 
-    // mainloop
-    while (true) {
-        std::cout << "> ";
-        std::getline(std::cin, input);
+        // mainloop
+        while (true) {
+            std::cout << "> ";
+            std::getline(std::cin, input);
 
-        if (input == "exit")
-            break;
+            if (input == "exit")
+                break;
 
-        forth.run(input);
-        // forth.printStack();
-        std::cout << "OK\n";
+            forth.run(input);
+            // forth.printStack();
+            std::cout << "OK\n";
+        }
     }
 
+    // reports of the run
+    forth.writeProfile(stacks);
+    if (!trace.empty())
+        forth.writeTrace(trace);
+
     return 0;
 }
@@ -0,0 +1,98 @@
+/*
+ * @file    mapped_file.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Read only view of a whole file
+ */
+
+// ----- includes
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ----- constants
+namespace {
+
+constexpr std::size_t kReadChunk {1 << 16};
+
+}
+
+// ----- public implementation
+
+/* constructor
+ * Args:
+ *      filename (std::string) : the file to open
+ */
+MappedFile::MappedFile(const std::string& filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    // regular files are mapped in memory
+    struct stat st {};
+    if ((::fstat(fd, &st) == 0) && S_ISREG(st.st_mode)) {
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ == 0) {
+            open_ = true;
+            ::close(fd);
+            return;
+        }
+
+        void* map = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            ::madvise(map, size_, MADV_SEQUENTIAL);
+            map_ = map;
+            open_ = true;
+            ::close(fd);
+            return;
+        }
+    }
+
+    // otherwise read everything in a single buffer
+    size_ = 0;
+    for (;;) {
+        std::size_t used = buffer_.size();
+        buffer_.resize(used + kReadChunk);
+
+        ssize_t count = ::read(fd, buffer_.data() + used, kReadChunk);
+        if (count <= 0) {
+            buffer_.resize(used);
+            open_ = (count == 0);
+            break;
+        }
+        buffer_.resize(used + static_cast<std::size_t>(count));
+    }
+
+    ::close(fd);
+}
+
+// destructor
+/*virtual*/ MappedFile::~MappedFile()
+{
+    if (map_ != nullptr)
+        ::munmap(map_, size_);
+}
+
+/* check if the file has been loaded
+ * Returns:
+ *      True if the content of the file is available
+ */
+bool MappedFile::isOpen() const
+{
+    return open_;
+}
+
+/* return the content of the file
+ * Returns:
+ *      A view over the whole file
+ */
+std::string_view MappedFile::data() const
+{
+    if (map_ != nullptr)
+        return std::string_view(static_cast<const char*>(map_), size_);
+    return buffer_;
+}
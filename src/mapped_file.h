@@ -0,0 +1,42 @@
+/*
+ * @file    mapped_file.h
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Interface / Read only view of a whole file
+ */
+
+// ----- header guards
+#ifndef FORTH_MAPPED_FILE_H_
+#define FORTH_MAPPED_FILE_H_
+
+// ----- includes
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// ----- class
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string&);
+    virtual ~MappedFile();
+
+    // no copy or move semantics
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    bool isOpen() const;
+    std::string_view data() const;
+
+private:
+    bool open_ {false};
+
+    // regular files are mapped, other files (pipes, ...) are read at once
+    void* map_ {nullptr};
+    std::size_t size_ {0};
+    std::string buffer_ {};
+};
+
+#endif // FORTH_MAPPED_FILE_H_
@@ -0,0 +1,239 @@
+/*
+ * @file    opcodes.h
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Interface / Threaded code instruction set
+ */
+
+// ----- header guards
+#ifndef FORTH_OPCODES_H_
+#define FORTH_OPCODES_H_
+
+// ----- includes
+#include "cell.h"
+
+#include <cstddef>
+
+// ----- dispatch strategy
+// computed goto (labels as values) is used with GCC and clang, unless the
+// portable switch dispatch has been requested at build time
+#if defined(__GNUC__) && !defined(FORTH_SWITCH_DISPATCH)
+#define FORTH_COMPUTED_GOTO
+#endif
+
+// ----- instruction set
+// every opcode of the inner interpreter, in execution token order, with
+// the number of cells it takes from and leaves on the data stack
+#define FORTH_OPCODES(X)                                                    \
+    /* threading */                                                         \
+    X(Exit,         0, 0)   /* return from the current definition */        \
+    X(Literal,      0, 1)   /* push the next cell on the stack */           \
+    X(Call,         0, 0)   /* call the user word whose index is next */    \
+    X(Guard,        0, 0)   /* check the depth given by the next cell */  \
+                                                                            \
+    /* control flow */                                                      \
+    X(Branch,       0, 0)   /* jump by the offset in the next cell */       \
+    X(ZeroBranch,   1, 0)   /* jump by the next cell if the top is 0 */     \
+                                                                            \
+    /* loops */                                                             \
+    X(Do,           2, 0)   /* move the loop parameters to the rstack */    \
+    X(QDo,          2, 0)   /* same, or jump by the next cell if equal */   \
+    X(Loop,         0, 0)   /* increment, jump back by the next cell */     \
+    X(PlusLoop,     1, 0)   /* add the top, jump back by the next cell */   \
+    X(Leave,        0, 0)   /* drop the loop, jump by the next cell */      \
+    X(Unloop,       0, 0)                                                   \
+    X(I,            0, 1)                                                   \
+    X(J,            0, 1)                                                   \
+                                                                            \
+    /* return stack */                                                      \
+    X(ToR,          1, 0)                                                   \
+    X(RFrom,        0, 1)                                                   \
+    X(RFetch,       0, 1)                                                   \
+                                                                            \
+    /* arithmetic operators */                                              \
+    X(Add,          2, 1)                                                   \
+    X(Sub,          2, 1)                                                   \
+    X(Mul,          2, 1)                                                   \
+    X(Div,          2, 1)                                                   \
+    X(Mod,          2, 1)                                                   \
+    X(Negate,       1, 1)                                                   \
+    X(MStar,        2, 2)   /* signed product as a double cell */           \
+    X(UMStar,       2, 2)   /* unsigned product as a double cell */         \
+    X(UMSlashMod,   3, 2)   /* double by cell division, rem and quot */     \
+    X(StarSlash,    3, 1)   /* product as a double cell, divided */         \
+                                                                            \
+    /* double cells, the high cell on top */                                \
+    X(SToD,         1, 2)                                                   \
+    X(DAdd,         4, 2)                                                   \
+    X(DNegate,      2, 2)                                                   \
+    X(DDot,         2, 0)                                                   \
+                                                                            \
+    /* comparison operators */                                              \
+    X(Greater,      2, 1)                                                   \
+    X(Lesser,       2, 1)                                                   \
+    X(Equal,        2, 1)                                                   \
+    X(NotEqual,     2, 1)                                                   \
+    X(ZeroEqual,    1, 1)                                                   \
+    X(ZeroLesser,   1, 1)                                                   \
+    X(ZeroGreater,  1, 1)                                                   \
+    X(ZeroNotEqual, 1, 1)                                                   \
+                                                                            \
+    /* stack manipulation */                                                \
+    X(Dup,          1, 2)                                                   \
+    X(Drop,         1, 0)                                                   \
+    X(Swap,         2, 2)                                                   \
+    X(Over,         2, 3)                                                   \
+    X(Rot,          3, 3)                                                   \
+                                                                            \
+    /* bitwise operators */                                                 \
+    X(And,          2, 1)                                                   \
+    X(Or,           2, 1)                                                   \
+    X(Xor,          2, 1)                                                   \
+    X(Not,          1, 1)                                                   \
+                                                                            \
+    /* stack display */                                                     \
+    X(Dot,          1, 0)                                                   \
+    X(Emit,         1, 0)                                                   \
+    X(Cr,           0, 0)                                                   \
+    X(Type,         2, 0)                                                   \
+    X(Flush,        0, 0)                                                   \
+                                                                            \
+    /* tasks */                                                             \
+    X(Execute,      1, 0)   /* call the word whose index is on top */       \
+    X(Spawn,        1, 0)   /* start a task running the word on top */      \
+    X(Pause,        0, 0)   /* switch to the next task */                   \
+    X(Key,          0, 1)   /* read a character, pausing while none */      \
+                                                                            \
+    /* data space */                                                        \
+    X(Fetch,        1, 1)                                                   \
+    X(Store,        2, 0)                                                   \
+    X(PlusStore,    2, 0)                                                   \
+    X(Here,         0, 1)                                                   \
+    X(Allot,        1, 0)                                                   \
+    X(Comma,        1, 0)                                                   \
+    X(Cells,        1, 1)                                                   \
+    X(Base,         0, 1)   /* address of the base of the numbers */        \
+    X(Hex,          0, 0)                                                   \
+    X(Decimal,      0, 0)                                                   \
+    X(Create,       0, 0)   /* define a word for the next name parsed */    \
+    X(Does,         0, 0)   /* last created word runs the next offset */    \
+                                                                            \
+    /* vector words */                                                      \
+    X(VFill,        3, 0)   /* fill n cells with a value */                 \
+    X(VAdd,         4, 0)   /* add two arrays into a third one */           \
+    X(VMul,         4, 0)   /* multiply two arrays into a third one */      \
+    X(VSum,         2, 1)                                                   \
+    X(VMin,         2, 1)                                                   \
+    X(VMax,         2, 1)                                                   \
+    X(VDot,         3, 1)   /* sum of the products of two arrays */         \
+    X(VCountEq,     3, 1)   /* cells equal to a value */                    \
+                                                                            \
+    /* floating point stack, the effects are on the data stack */           \
+    X(FAdd,         0, 0)                                                   \
+    X(FSub,         0, 0)                                                   \
+    X(FMul,         0, 0)                                                   \
+    X(FDiv,         0, 0)                                                   \
+    X(FMulAdd,      0, 0)   /* fused multiply add, r1 * r2 + r3 */          \
+    X(FSqrt,        0, 0)                                                   \
+    X(FFloor,       0, 0)                                                   \
+    X(FDup,         0, 0)                                                   \
+    X(FDrop,        0, 0)                                                   \
+    X(FSwap,        0, 0)                                                   \
+    X(FDot,         0, 0)                                                   \
+    X(SToF,         1, 0)                                                   \
+    X(FToS,         0, 1)   /* truncated, and saturated to a cell */        \
+    X(FLiteral,     0, 0)   /* push the double in the next cells */         \
+    X(FFetch,       1, 0)                                                   \
+    X(FStore,       1, 0)                                                   \
+    X(Floats,       1, 1)                                                   \
+    X(FVMul,        4, 0)   /* multiply two float arrays into a third */    \
+    X(FVSum,        2, 0)   /* sum of a float array */                      \
+                                                                            \
+    /* superinstructions */                                                 \
+    X(LitAdd,       1, 1)   /* literal + */                                 \
+    X(Square,       1, 1)   /* DUP * */                                     \
+    X(OverFetch,    2, 3)   /* OVER @ */                                    \
+    X(IAdd,         1, 1)   /* I + */                                       \
+    X(LitAnd,       1, 1)   /* literal AND */                               \
+    X(IndexCell,    0, 1)   /* I CELLS literal + */                         \
+    X(NonZeroBranch, 1, 0)  /* 0= IF */                                     \
+    X(DupZeroBranch, 1, 1)  /* DUP IF */
+
+// ----- types
+enum class Opcode : Cell {
+#define X(name, in, out) name,
+    FORTH_OPCODES(X)
+#undef X
+};
+
+// stack effect of an opcode
+struct OpcodeEffect
+{
+    int in;
+    int out;
+};
+
+inline constexpr OpcodeEffect kOpcodeEffects[] = {
+#define X(name, in, out) {in, out},
+    FORTH_OPCODES(X)
+#undef X
+};
+
+inline constexpr const char* kOpcodeNames[] = {
+#define X(name, in, out) #name,
+    FORTH_OPCODES(X)
+#undef X
+};
+
+// ----- functions
+
+// stack effect of an opcode
+constexpr const OpcodeEffect& effectOf(Opcode op)
+{
+    return kOpcodeEffects[static_cast<std::size_t>(op)];
+}
+
+// name of an opcode
+constexpr const char* nameOf(Opcode op)
+{
+    return kOpcodeNames[static_cast<std::size_t>(op)];
+}
+
+// opcodes whose next cell is a branch offset
+constexpr bool isBranch(Opcode op)
+{
+    switch (op) {
+        case Opcode::Branch:
+        case Opcode::ZeroBranch:
+        case Opcode::NonZeroBranch:
+        case Opcode::DupZeroBranch:
+        case Opcode::QDo:
+        case Opcode::Loop:
+        case Opcode::PlusLoop:
+        case Opcode::Leave:
+        case Opcode::Does:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// opcodes followed by an operand cell
+constexpr bool hasOperand(Opcode op)
+{
+    return isBranch(op) || (op == Opcode::Literal) || (op == Opcode::Call) || (op == Opcode::Guard) ||
+           (op == Opcode::LitAdd) || (op == Opcode::LitAnd) || (op == Opcode::IndexCell);
+}
+
+// cells holding the double of an FLiteral
+inline constexpr std::size_t kRealCells {sizeof(double) / sizeof(Cell)};
+
+// number of operand cells following an opcode
+constexpr std::size_t operandCells(Opcode op)
+{
+    if (op == Opcode::FLiteral)
+        return kRealCells;
+    return hasOperand(op) ? 1 : 0;
+}
+
+#endif // FORTH_OPCODES_H_
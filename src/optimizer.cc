@@ -0,0 +1,263 @@
+/*
+ * @file    optimizer.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Forth Virtual Machine peephole optimizer
+ */
+
+// ----- includes
+#include "forth_vm.h"
+
+#include <limits>
+#include <optional>
+#include <type_traits>
+
+// ----- helpers
+namespace {
+
+// addition wrapping around, as on the stack
+Cell wrapAdd(Cell a, Cell b)
+{
+    return static_cast<Cell>(static_cast<UCell>(a) + static_cast<UCell>(b));
+}
+
+/* fold a binary operator over two literals
+ * Args:
+ *  op : the operator
+ *  a  : the second value of the stack
+ *  b  : the top of the stack
+ * Returns:
+ *  The folded value, std::nullopt if the operator can't be folded
+ */
+std::optional<Cell> foldBinary(Opcode op, Cell a, Cell b)
+{
+    // the arithmetic wraps around, as on the stack
+    auto ua = static_cast<UCell>(a);
+    auto ub = static_cast<UCell>(b);
+
+    switch (op) {
+        case Opcode::Add:       return static_cast<Cell>(ua + ub);
+        case Opcode::Sub:       return static_cast<Cell>(ua - ub);
+        case Opcode::Mul:       return static_cast<Cell>(ua * ub);
+        case Opcode::And:       return a & b;
+        case Opcode::Or:        return a | b;
+        case Opcode::Xor:       return a ^ b;
+        case Opcode::Greater:   return a > b;
+        case Opcode::Lesser:    return a < b;
+        case Opcode::Equal:     return a == b;
+        case Opcode::NotEqual:  return a != b;
+        case Opcode::Div:
+        case Opcode::Mod:
+            // leave the runtime errors to the runtime
+            if ((b == 0) || ((a == std::numeric_limits<Cell>::min()) && (b == -1)))
+                return std::nullopt;
+            return (op == Opcode::Div) ? (a / b) : (a % b);
+        default:
+            return std::nullopt;
+    }
+}
+
+/* fold an unary operator over a literal
+ * Args:
+ *  op : the operator
+ *  a  : the top of the stack
+ * Returns:
+ *  The folded value, std::nullopt if the operator can't be folded
+ */
+std::optional<Cell> foldUnary(Opcode op, Cell a)
+{
+    switch (op) {
+        case Opcode::Negate:        return static_cast<Cell>(UCell{0} - static_cast<UCell>(a));
+        case Opcode::Not:           return ~a;
+        case Opcode::ZeroEqual:     return a == 0;
+        case Opcode::ZeroLesser:    return a < 0;
+        case Opcode::ZeroGreater:   return a > 0;
+        case Opcode::ZeroNotEqual:  return a != 0;
+        case Opcode::Cells:         return static_cast<Cell>(static_cast<UCell>(a) * sizeof(Cell));
+        case Opcode::Floats:        return static_cast<Cell>(static_cast<UCell>(a) * sizeof(double));
+        default:
+            return std::nullopt;
+    }
+}
+
+// instructions after which the next one is only reached by a branch
+bool isUnconditional(Opcode op)
+{
+    return (op == Opcode::Branch) || (op == Opcode::Exit) || (op == Opcode::Leave);
+}
+
+}
+
+
+// ----- private implementation
+
+/* optimize the instructions of a definition until nothing changes:
+ *  - fold the constant expressions over literals
+ *  - fuse the frequent sequences into superinstructions
+ *  - remove the code after unconditional branches
+ * Args:
+ *  code : the instructions of the definition
+ * Returns:
+ *  The optimized instructions
+ */
+std::vector<ForthVM::Instruction> ForthVM::optimize(std::vector<Instruction> code) const
+{
+    bool changed {true};
+
+    while (changed) {
+        changed = false;
+
+        // the instructions reached by a branch can't be fused with the
+        // instruction before them
+        std::vector<bool> target(code.size() + 1, false);
+        for (const auto& instruction : code) {
+            if (isBranch(instruction.op))
+                target[instruction.target] = true;
+        }
+
+        // a sequence of n instructions at i can be rewritten
+        auto fusable = [&](std::size_t i, std::size_t n) {
+            if (i + n > code.size())
+                return false;
+            for (std::size_t k = i + 1; k < i + n; ++k) {
+                if (target[k])
+                    return false;
+            }
+            return true;
+        };
+
+        std::vector<Instruction> optimized;
+        std::vector<std::size_t> index(code.size() + 1, 0);
+        std::size_t i {0};
+
+        // replace n instructions at i
+        auto rewrite = [&](std::size_t n, std::initializer_list<Instruction> replacement) {
+            for (std::size_t k = i; k < i + n; ++k)
+                index[k] = optimized.size();
+            optimized.insert(optimized.end(), replacement);
+            i += n;
+            changed = true;
+        };
+
+        while (i < code.size()) {
+            const Instruction& a = code[i];
+            Opcode b = fusable(i, 2) ? code[i + 1].op : Opcode::Exit;
+            Opcode c = fusable(i, 3) ? code[i + 2].op : Opcode::Exit;
+
+            // literal literal operator
+            if ((a.op == Opcode::Literal) && (b == Opcode::Literal)) {
+                if (auto value = foldBinary(c, a.operand, code[i + 1].operand)) {
+                    rewrite(3, {{Opcode::Literal, *value}});
+                    continue;
+                }
+            }
+
+            // literal operator
+            if (a.op == Opcode::Literal) {
+                if (auto value = foldUnary(b, a.operand)) {
+                    rewrite(2, {{Opcode::Literal, *value}});
+                    continue;
+                }
+
+                switch (b) {
+                    case Opcode::LitAdd:
+                        rewrite(2, {{Opcode::Literal, wrapAdd(a.operand, code[i + 1].operand)}});
+                        continue;
+                    case Opcode::Drop:
+                        rewrite(2, {});
+                        continue;
+                    case Opcode::Dup:
+                        rewrite(2, {a, a});
+                        continue;
+                    case Opcode::ZeroBranch:
+                        if (a.operand == 0)
+                            rewrite(2, {{Opcode::Branch, 0, code[i + 1].target}});
+                        else
+                            rewrite(2, {});
+                        continue;
+                    case Opcode::Add:
+                        rewrite(2, {{Opcode::LitAdd, a.operand}});
+                        continue;
+                    case Opcode::Sub:
+                        rewrite(2, {{Opcode::LitAdd, static_cast<Cell>(UCell{0} - static_cast<UCell>(a.operand))}});
+                        continue;
+                    case Opcode::And:
+                        rewrite(2, {{Opcode::LitAnd, a.operand}});
+                        continue;
+                    default:
+                        break;
+                }
+            }
+
+            // superinstructions
+            if ((a.op == Opcode::LitAdd) && (b == Opcode::LitAdd)) {
+                rewrite(2, {{Opcode::LitAdd, wrapAdd(a.operand, code[i + 1].operand)}});
+                continue;
+            }
+            if ((a.op == Opcode::LitAdd) && (a.operand == 0)) {
+                rewrite(1, {});
+                continue;
+            }
+            if ((a.op == Opcode::Dup) && (b == Opcode::Mul)) {
+                rewrite(2, {{Opcode::Square}});
+                continue;
+            }
+            if ((a.op == Opcode::Over) && (b == Opcode::Fetch)) {
+                rewrite(2, {{Opcode::OverFetch}});
+                continue;
+            }
+            if ((a.op == Opcode::I) && (b == Opcode::Cells) && (c == Opcode::LitAdd)) {
+                rewrite(3, {{Opcode::IndexCell, code[i + 2].operand}});
+                continue;
+            }
+            if ((a.op == Opcode::I) && (b == Opcode::Add)) {
+                rewrite(2, {{Opcode::IAdd}});
+                continue;
+            }
+            if ((a.op == Opcode::Swap) && (b == Opcode::Swap)) {
+                rewrite(2, {});
+                continue;
+            }
+            if ((a.op == Opcode::ZeroEqual) && (b == Opcode::ZeroBranch)) {
+                rewrite(2, {{Opcode::NonZeroBranch, 0, code[i + 1].target}});
+                continue;
+            }
+            if ((a.op == Opcode::Dup) && (b == Opcode::ZeroBranch)) {
+                rewrite(2, {{Opcode::DupZeroBranch, 0, code[i + 1].target}});
+                continue;
+            }
+
+            // a branch to the next instruction
+            if ((a.op == Opcode::Branch) && (a.target == i + 1)) {
+                rewrite(1, {});
+                continue;
+            }
+
+            // dead code, up to the next branch destination
+            if (isUnconditional(a.op) && (i + 1 < code.size()) && !target[i + 1]) {
+                index[i] = optimized.size();
+                optimized.push_back(a);
+                ++i;
+
+                std::size_t n {0};
+                while ((i + n < code.size()) && !target[i + n])
+                    ++n;
+                rewrite(n, {});
+                continue;
+            }
+
+            index[i] = optimized.size();
+            optimized.push_back(a);
+            ++i;
+        }
+        index[code.size()] = optimized.size();
+
+        for (auto& instruction : optimized) {
+            if (isBranch(instruction.op))
+                instruction.target = index[instruction.target];
+        }
+        code = std::move(optimized);
+    }
+
+    return code;
+}
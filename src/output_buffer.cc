@@ -0,0 +1,145 @@
+/*
+ * @file    output_buffer.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Buffered output of the words
+ */
+
+// ----- includes
+#include "output_buffer.h"
+
+#include <charconv>
+#include <cstring>
+
+
+// ----- public implementation
+
+/* constructor
+ * Args:
+ *  stream : the stream receiving the text
+ */
+OutputBuffer::OutputBuffer(std::ostream& stream) :
+    stream_ {&stream}
+{
+}
+
+/* destructor, the text left is written
+ */
+/*virtual*/ OutputBuffer::~OutputBuffer()
+{
+    flush();
+}
+
+/* write the text gathered so far, and send the next one to another stream
+ * Args:
+ *  stream : the stream receiving the text
+ */
+void OutputBuffer::setStream(std::ostream& stream)
+{
+    flush();
+    stream_ = &stream;
+}
+
+// write the text gathered to the stream
+void OutputBuffer::flush()
+{
+    if (size_ == 0)
+        return;
+
+    stream_->write(buffer_.data(), static_cast<std::streamsize>(size_));
+    stream_->flush();
+    size_ = 0;
+}
+
+/* append a text, the large ones go directly to the stream
+ * Args:
+ *  text : the text to append
+ */
+void OutputBuffer::write(std::string_view text)
+{
+    if (text.size() > kCapacity - size_) {
+        flush();
+        if (text.size() >= kCapacity) {
+            stream_->write(text.data(), static_cast<std::streamsize>(text.size()));
+            return;
+        }
+    }
+
+    std::memcpy(buffer_.data() + size_, text.data(), text.size());
+    size_ += text.size();
+}
+
+/* append a number followed by a space
+ * Args:
+ *  value : the number
+ *  base  : its base, from 2 to 36
+ */
+void OutputBuffer::number(Cell value, int base)
+{
+    // room for the sign, the binary digits and the space
+    constexpr std::size_t kDigits {sizeof(Cell) * 8 + 2};
+    if (kCapacity - size_ < kDigits)
+        flush();
+
+    char* first = buffer_.data() + size_;
+    auto [end, error] = std::to_chars(first, buffer_.data() + kCapacity, value, base);
+
+    // the digits above 9 in upper case, as they are read
+    if (base > 10) {
+        for (char* c = first; c != end; ++c) {
+            if ((*c >= 'a') && (*c <= 'z'))
+                *c = static_cast<char>(*c - 'a' + 'A');
+        }
+    }
+
+    size_ = static_cast<std::size_t>(end - buffer_.data());
+    buffer_[size_++] = ' ';
+}
+
+/* append a floating point number followed by a space, in its shortest
+ * form read back as the same value
+ * Args:
+ *  value : the number
+ */
+void OutputBuffer::real(double value)
+{
+    // room for the longest form, as -2.2250738585072014e-308, and the space
+    constexpr std::size_t kDigits {32};
+    if (kCapacity - size_ < kDigits)
+        flush();
+
+    auto [end, error] = std::to_chars(buffer_.data() + size_, buffer_.data() + kCapacity, value);
+    size_ = static_cast<std::size_t>(end - buffer_.data());
+    buffer_[size_++] = ' ';
+}
+
+/* append a double cell number followed by a space, converted by hand as
+ * to_chars does not take the 128 bits integers
+ * Args:
+ *  value : the number
+ *  base  : its base, from 2 to 36
+ */
+void OutputBuffer::number(DoubleCell value, int base)
+{
+    constexpr std::size_t kDigits {sizeof(DoubleCell) * 8 + 2};
+    if (kCapacity - size_ < kDigits)
+        flush();
+
+    // the digits from the last one, before the space
+    char* end = buffer_.data() + size_ + kDigits - 1;
+    char* first = end;
+    auto radix = static_cast<unsigned>(base);
+    UDoubleCell magnitude = (value < 0) ? UDoubleCell {0} - static_cast<UDoubleCell>(value)
+                                        : static_cast<UDoubleCell>(value);
+    do {
+        *--first = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"[magnitude % radix];
+        magnitude /= radix;
+    } while (magnitude != 0);
+
+    if (value < 0)
+        *--first = '-';
+
+    std::memmove(buffer_.data() + size_, first, static_cast<std::size_t>(end - first));
+    size_ += static_cast<std::size_t>(end - first);
+    buffer_[size_++] = ' ';
+}
@@ -0,0 +1,56 @@
+/*
+ * @file    output_buffer.h
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Interface / Buffered output of the words
+ */
+
+// ----- header guards
+#ifndef FORTH_OUTPUT_BUFFER_H_
+#define FORTH_OUTPUT_BUFFER_H_
+
+// ----- includes
+#include "cell.h"
+
+#include <array>
+#include <cstddef>
+#include <ostream>
+#include <string_view>
+
+// ----- class
+// the text is gathered here and written to the stream in bulk, when the
+// buffer is full or flushed
+class OutputBuffer
+{
+public:
+    explicit OutputBuffer(std::ostream&);
+    virtual ~OutputBuffer();
+
+    // no copy or move semantics
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+    OutputBuffer(OutputBuffer&&) = delete;
+    OutputBuffer& operator=(OutputBuffer&&) = delete;
+
+    void setStream(std::ostream&);
+    void flush();
+
+    void put(char c) {
+        if (size_ == kCapacity)
+            flush();
+        buffer_[size_++] = c;
+    }
+    void write(std::string_view);
+    void number(Cell, int);
+    void number(DoubleCell, int);
+    void real(double);
+
+private:
+    static constexpr std::size_t kCapacity {8192};
+
+    std::ostream* stream_ {nullptr};
+    std::array<char, kCapacity> buffer_ {};
+    std::size_t size_ {0};
+};
+
+#endif // FORTH_OUTPUT_BUFFER_H_
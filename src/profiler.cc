@@ -0,0 +1,296 @@
+/*
+ * @file    profiler.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Per word execution profiler
+ */
+
+// ----- includes
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// ----- constants
+namespace {
+
+// parent of the root of the call tree
+constexpr std::size_t kNoParent {std::numeric_limits<std::size_t>::max()};
+
+// lines of the table of the instruction pairs
+constexpr std::size_t kPairsShown {16};
+
+}
+
+
+// ----- public implementation
+
+/* constructor
+ */
+Profiler::Profiler() :
+    opcodes_(std::size(kOpcodeNames)),
+    pairs_(std::size(kOpcodeNames) * std::size(kOpcodeNames), 0)
+{
+    // the root of the call tree, for the words called by the outer interpreter
+    nodes_.push_back({kNoParent, 0});
+}
+
+/* destructor
+ */
+/*virtual*/ Profiler::~Profiler()
+{
+}
+
+/* start or stop recording
+ * Args:
+ *  enabled : true to record the executions
+ */
+void Profiler::enable(bool enabled)
+{
+    enabled_ = enabled;
+}
+
+/* check if something has been recorded
+ * Returns:
+ *  True if no instruction has been recorded
+ */
+bool Profiler::empty() const
+{
+    return std::none_of(opcodes_.begin(), opcodes_.end(), [](const Stats& s) { return s.calls > 0; });
+}
+
+/* record the start of an instruction, which ends the previous one
+ * Args:
+ *  op    : the instruction starting
+ *  depth : the depth of the data stack
+ */
+void Profiler::instruction(Opcode op, std::size_t depth)
+{
+    std::uint64_t t = now();
+    if (timing_)
+        ++pairs_[static_cast<std::size_t>(current_) * opcodes_.size() + static_cast<std::size_t>(op)];
+    flush();
+
+    Stats& stats = opcodes_[static_cast<std::size_t>(op)];
+    ++stats.calls;
+    stats.max_depth = std::max(stats.max_depth, depth);
+    if (!frames_.empty())
+        frames_.back().max_depth = std::max(frames_.back().max_depth, depth);
+
+    timing_ = true;
+    current_ = op;
+    started_ = t;
+}
+
+/* end the instruction being timed, when the inner interpreter returns
+ */
+void Profiler::flush()
+{
+    if (!timing_)
+        return;
+
+    std::uint64_t cycles = now() - started_;
+    Stats& stats = opcodes_[static_cast<std::size_t>(current_)];
+    stats.inclusive += cycles;
+    stats.exclusive += cycles;
+    timing_ = false;
+}
+
+/* record the call of a user defined word
+ * Args:
+ *  word  : the index of the word in the dictionary
+ *  depth : the depth of the data stack
+ */
+void Profiler::enter(std::size_t word, std::size_t depth)
+{
+    std::size_t parent = frames_.empty() ? 0 : frames_.back().node;
+    std::uint64_t key = (static_cast<std::uint64_t>(parent) << 32) ^ word;
+
+    auto [child, inserted] = children_.try_emplace(key, nodes_.size());
+    if (inserted)
+        nodes_.push_back({parent, word});
+
+    if (word >= words_.size())
+        words_.resize(word + 1);
+    ++words_[word].active;
+
+    frames_.push_back({word, child->second, now(), 0, depth});
+}
+
+/* record the return of the word called last
+ */
+void Profiler::leave()
+{
+    if (frames_.empty())
+        return;
+
+    Frame frame = frames_.back();
+    frames_.pop_back();
+
+    std::uint64_t inclusive = now() - frame.start;
+    std::uint64_t exclusive = inclusive - std::min(inclusive, frame.children);
+
+    // the cycles of the recursive calls are counted once, by the outermost
+    Stats& stats = words_[frame.word];
+    ++stats.calls;
+    stats.exclusive += exclusive;
+    if (--stats.active == 0)
+        stats.inclusive += inclusive;
+    stats.max_depth = std::max(stats.max_depth, frame.max_depth);
+    nodes_[frame.node].cycles += exclusive;
+
+    if (!frames_.empty()) {
+        frames_.back().children += inclusive;
+        frames_.back().max_depth = std::max(frames_.back().max_depth, frame.max_depth);
+    }
+}
+
+/* return from the words aborted by an error
+ * Args:
+ *  frames : the number of calls to keep
+ */
+void Profiler::unwind(std::size_t frames)
+{
+    while (frames_.size() > frames)
+        leave();
+}
+
+/* set the open calls aside at a task switch, so that the calls of the
+ * other tasks are not counted as their callees
+ * Returns:
+ *  The calls, to resume once the task runs again
+ */
+Profiler::Suspended Profiler::suspend()
+{
+    flush();
+
+    Suspended suspended {std::move(frames_), now()};
+    frames_.clear();
+    for (const Frame& frame : suspended.frames)
+        --words_[frame.word].active;
+
+    return suspended;
+}
+
+/* open again the calls of a task resumed, without the time it was paused
+ * Args:
+ *  suspended : the calls set aside by suspend()
+ */
+void Profiler::resume(Suspended suspended)
+{
+    std::uint64_t paused = now() - suspended.since;
+    for (Frame& frame : suspended.frames) {
+        frame.start += paused;
+        ++words_[frame.word].active;
+        frames_.push_back(frame);
+    }
+}
+
+/* print the measures, sorted by exclusive cycles. The builtins executed by
+ * a word are part of its exclusive cycles, the words inlined in it too.
+ * Args:
+ *  out     : the stream to print to
+ *  opcodes : the name of every opcode
+ *  words   : the name of every user defined word
+ */
+void Profiler::report(std::ostream& out, const std::vector<std::string>& opcodes,
+                      const std::vector<std::string>& words) const
+{
+    auto table = [&out](const char* title, const std::vector<Stats>& stats,
+                        const std::vector<std::string>& names) {
+        std::vector<std::size_t> order;
+        for (std::size_t i = 0; i < stats.size(); ++i) {
+            if (stats[i].calls > 0)
+                order.push_back(i);
+        }
+        std::sort(order.begin(), order.end(), [&stats](std::size_t a, std::size_t b) {
+            return stats[a].exclusive > stats[b].exclusive;
+        });
+
+        out << std::left << std::setw(20) << title << std::right
+            << std::setw(12) << "calls" << std::setw(16) << "inclusive" << std::setw(16) << "exclusive"
+            << std::setw(12) << "per call" << std::setw(10) << "depth" << "\n";
+        for (auto i : order) {
+            const Stats& s = stats[i];
+            out << std::left << std::setw(20) << ((i < names.size()) ? names[i] : "?") << std::right
+                << std::setw(12) << s.calls << std::setw(16) << s.inclusive << std::setw(16) << s.exclusive
+                << std::setw(12) << s.exclusive / s.calls << std::setw(10) << s.max_depth << "\n";
+        }
+    };
+
+    out << "----- profile (cycles)\n";
+    table("word", words_, words);
+    out << "\n";
+    table("builtin", opcodes_, opcodes);
+
+    // the pairs executed most, the candidates of the superinstructions
+    std::vector<std::size_t> order;
+    for (std::size_t i = 0; i < pairs_.size(); ++i) {
+        if (pairs_[i] > 0)
+            order.push_back(i);
+    }
+    std::size_t shown = std::min<std::size_t>(order.size(), kPairsShown);
+    std::partial_sort(order.begin(), order.begin() + static_cast<std::ptrdiff_t>(shown), order.end(),
+                      [this](std::size_t a, std::size_t b) { return pairs_[a] > pairs_[b]; });
+
+    auto name = [&opcodes](std::size_t i) { return (i < opcodes.size()) ? opcodes[i] : std::string {"?"}; };
+    out << "\n" << std::left << std::setw(32) << "pair" << std::right << std::setw(12) << "count" << "\n";
+    for (std::size_t k = 0; k < shown; ++k) {
+        std::size_t first = order[k] / opcodes_.size();
+        std::size_t second = order[k] % opcodes_.size();
+        out << std::left << std::setw(32) << (name(first) + " " + name(second)) << std::right
+            << std::setw(12) << pairs_[order[k]] << "\n";
+    }
+}
+
+/* write the exclusive cycles of every call path, in the collapsed stack
+ * format of the flame graph tools: "A;B;C cycles"
+ * Args:
+ *  filename : the file to write
+ *  words    : the name of every user defined word
+ * Returns:
+ *  True if the file has been written
+ */
+bool Profiler::writeCollapsed(const std::string& filename, const std::vector<std::string>& words) const
+{
+    std::ofstream file {filename};
+    if (!file)
+        return false;
+
+    std::vector<std::string> path;
+    for (std::size_t i = 1; i < nodes_.size(); ++i) {
+        if (nodes_[i].cycles == 0)
+            continue;
+
+        path.clear();
+        for (std::size_t node = i; node != 0; node = nodes_[node].parent)
+            path.push_back((nodes_[node].word < words.size()) ? words[nodes_[node].word] : "?");
+
+        for (auto name = path.rbegin(); name != path.rend(); ++name)
+            file << ((name == path.rbegin()) ? "" : ";") << *name;
+        file << " " << nodes_[i].cycles << "\n";
+    }
+
+    return static_cast<bool>(file);
+}
+
+
+// ----- private implementation
+
+// time stamp counter, or nanoseconds where there is none
+std::uint64_t Profiler::now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
@@ -0,0 +1,105 @@
+/*
+ * @file    profiler.h
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Interface / Per word execution profiler
+ */
+
+// ----- header guards
+#ifndef FORTH_PROFILER_H_
+#define FORTH_PROFILER_H_
+
+// ----- includes
+#include "opcodes.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ----- class
+class Profiler
+{
+public:
+    // word being executed
+    struct Frame {
+        std::size_t word;
+        std::size_t node;
+        std::uint64_t start;
+        std::uint64_t children {0};     // inclusive cycles of the callees
+        std::size_t max_depth {0};
+    };
+
+    // calls set aside while their task is paused
+    struct Suspended {
+        std::vector<Frame> frames {};
+        std::uint64_t since {0};
+    };
+
+public:
+    Profiler();
+    virtual ~Profiler();
+
+    // no copy or move semantics
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+    Profiler(Profiler&&) = delete;
+    Profiler& operator=(Profiler&&) = delete;
+
+    void enable(bool);
+    bool enabled() const { return enabled_; }
+    bool empty() const;
+
+    // instructions, timed until the next one starts
+    void instruction(Opcode, std::size_t);
+    void flush();
+
+    // calls of the user defined words
+    void enter(std::size_t, std::size_t);
+    void leave();
+    std::size_t frames() const { return frames_.size(); }
+    void unwind(std::size_t);
+    Suspended suspend();
+    void resume(Suspended);
+
+    // reports, with the names of the opcodes and of the user defined words
+    void report(std::ostream&, const std::vector<std::string>&, const std::vector<std::string>&) const;
+    bool writeCollapsed(const std::string&, const std::vector<std::string>&) const;
+
+private:
+    // measures of a builtin or a user defined word
+    struct Stats {
+        std::uint64_t calls {0};
+        std::uint64_t inclusive {0};
+        std::uint64_t exclusive {0};
+        std::size_t max_depth {0};
+        std::size_t active {0};         // recursive calls in progress
+    };
+
+    // node of the call tree, for the collapsed stacks
+    struct Node {
+        std::size_t parent;
+        std::size_t word;
+        std::uint64_t cycles {0};       // exclusive cycles on this path
+    };
+
+    static std::uint64_t now();
+
+private:
+    bool enabled_ {false};
+
+    std::vector<Stats> opcodes_ {};
+    std::vector<std::uint64_t> pairs_ {};  // instruction followed by another
+    std::vector<Stats> words_ {};
+    std::vector<Frame> frames_ {};
+    std::vector<Node> nodes_ {};
+    std::unordered_map<std::uint64_t, std::size_t> children_ {};
+
+    // instruction being timed
+    bool timing_ {false};
+    Opcode current_ {Opcode::Exit};
+    std::uint64_t started_ {0};
+};
+
+#endif // FORTH_PROFILER_H_
@@ -0,0 +1,599 @@
+/*
+ * @file    server.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Persistent server running scripts sent over a socket
+ */
+
+// ----- includes
+#include "server.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <streambuf>
+#include <thread>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// ----- constants
+namespace {
+
+// epoll keys of the listening socket and of the workers, the connections
+// use their own identifier
+constexpr std::uint64_t kListenKey {std::numeric_limits<std::uint64_t>::max()};
+constexpr std::uint64_t kWakeKey {kListenKey - 1};
+constexpr std::uint64_t kSignalKey {kListenKey - 2};
+
+// largest script accepted, larger requests close the connection
+constexpr std::size_t kMaxRequest {1 << 20};
+
+// longest header, the digits of kMaxRequest with room for leading zeros
+constexpr std::size_t kMaxHeader {20};
+
+// period of the checks of the time limit, in milliseconds
+constexpr int kWatchPeriod {100};
+
+// largest output of a request, its program is interrupted past it
+constexpr std::size_t kMaxOutput {1 << 20};
+
+// requests of a connection queued or running, and bytes of its responses
+// not sent yet, past which its next requests wait in the socket
+constexpr std::uint64_t kMaxOutstanding {32};
+constexpr std::size_t kMaxUnsent {1 << 22};
+
+constexpr std::size_t kReadChunk {1 << 16};
+constexpr int kMaxEvents {64};
+
+// output of a request, the text past the limit is dropped and the program
+// interrupted
+class BoundedOutput : public std::streambuf
+{
+public:
+    explicit BoundedOutput(ForthVM& forth) : forth_ {forth} { }
+
+    const std::string& text() const { return text_; }
+    bool exceeded() const { return exceeded_; }
+    void clear() {
+        text_.clear();
+        exceeded_ = false;
+    }
+
+protected:
+    std::streamsize xsputn(const char* text, std::streamsize count) override {
+        auto size = static_cast<std::size_t>(count);
+        std::size_t kept = std::min(size, kMaxOutput - text_.size());
+        text_.append(text, kept);
+        if ((kept < size) && !exceeded_) {
+            exceeded_ = true;
+            forth_.interrupt();
+        }
+        return count;
+    }
+
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            char text = traits_type::to_char_type(c);
+            xsputn(&text, 1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+private:
+    ForthVM& forth_;
+    std::string text_ {};
+    bool exceeded_ {false};
+};
+
+}
+
+
+// ----- public implementation
+
+/* constructor
+ * Args:
+ *  snapshot : the state every request starts from
+ *  workers  : the number of virtual machines running the requests
+ */
+Server::Server(ForthVM::SnapshotPtr_T snapshot, std::size_t workers) :
+    snapshot_ {std::move(snapshot)},
+    workers_ {std::max<std::size_t>(workers, 1)}
+{
+}
+
+/* destructor
+ */
+/*virtual*/ Server::~Server()
+{
+    for (auto& [id, connection] : connections_)
+        ::close(connection.fd);
+
+    if (wake_fd_ >= 0)
+        ::close(wake_fd_);
+    if (epoll_fd_ >= 0)
+        ::close(epoll_fd_);
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+        ::unlink(path_.c_str());
+    }
+}
+
+/* set the number of calls after which a word is translated to native code,
+ * in every worker
+ * Args:
+ *  threshold : the number of calls, 0 to keep every word in the interpreter
+ */
+void Server::setJitThreshold(std::size_t threshold)
+{
+    jit_threshold_ = threshold;
+}
+
+/* set the time a request may run before it is interrupted
+ * Args:
+ *  limit : the time limit, 0 to let the requests run as long as they need
+ */
+void Server::setTimeLimit(std::chrono::milliseconds limit)
+{
+    time_limit_ = limit;
+}
+
+/* create the socket, replacing a stale one
+ * Args:
+ *  path : the path of the Unix domain socket
+ * Returns:
+ *  True if the server is ready to run
+ */
+bool Server::listen(const std::string& path)
+{
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: the socket path [" << path << "] is too long!\n";
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        std::cerr << "Error: unable to create the socket [" << path << "]: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    ::unlink(path.c_str());
+    if ((::bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) ||
+        (::listen(listen_fd_, SOMAXCONN) != 0)) {
+        std::cerr << "Error: unable to listen on [" << path << "]: " << std::strerror(errno) << "\n";
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    path_ = path;
+
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((epoll_fd_ < 0) || (wake_fd_ < 0)) {
+        std::cerr << "Error: unable to create the event loop: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    epoll_event listen_event {EPOLLIN, {.u64 = kListenKey}};
+    epoll_event wake_event {EPOLLIN, {.u64 = kWakeKey}};
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &listen_event);
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &wake_event);
+
+    return true;
+}
+
+/* serve the requests, until an interrupt or a termination signal
+ */
+void Server::run()
+{
+    // the signals are received by the event loop, the workers inherit the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    ::pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    int signal_fd = ::signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    epoll_event signal_event {EPOLLIN, {.u64 = kSignalKey}};
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, signal_fd, &signal_event);
+
+    // the virtual machines are built before the first request
+    running_.resize(workers_);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < workers_; ++i)
+        threads.emplace_back(&Server::work, this, i);
+
+    // the event loop wakes up regularly to check the time limit
+    int timeout = (time_limit_.count() > 0) ? kWatchPeriod : -1;
+
+    epoll_event events[kMaxEvents];
+    bool serving {true};
+    while (serving) {
+        int count = ::epoll_wait(epoll_fd_, events, kMaxEvents, timeout);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "Error: event loop failed: " << std::strerror(errno) << "\n";
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            std::uint64_t key = events[i].data.u64;
+            if (key == kSignalKey) {
+                serving = false;
+            } else if (key == kListenKey) {
+                accept();
+            } else if (key == kWakeKey) {
+                complete();
+            } else {
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    read(key);
+                if (events[i].events & EPOLLOUT)
+                    write(key);
+            }
+        }
+
+        if (time_limit_.count() > 0)
+            interrupt(false);
+    }
+
+    // the requests still running are stopped, the workers would not return
+    {
+        std::lock_guard lock {mutex_};
+        stopping_ = true;
+    }
+    interrupt(true);
+    ready_.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+
+    ::close(signal_fd);
+}
+
+
+// ----- private implementation
+
+/* worker thread: run the requests on its own virtual machine
+ * Args:
+ *  slot : the index of the worker in running_
+ */
+void Server::work(std::size_t slot)
+{
+    ForthVM forth {snapshot_->prelude, snapshot_->capacity};
+    if (jit_threshold_)
+        forth.setJitThreshold(*jit_threshold_);
+    forth.setSandbox(true);
+
+    BoundedOutput output {forth};
+    std::ostream out {&output};
+    std::ostringstream err;
+    forth.setOutput(out, err);
+
+    while (true) {
+        Job job;
+        {
+            std::unique_lock lock {mutex_};
+            running_[slot].forth = &forth;
+            ready_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+            if (stopping_) {
+                running_[slot] = {};
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+
+            // an interrupt aimed at the previous request is dropped
+            running_[slot].since = std::chrono::steady_clock::now();
+            forth.clearInterrupt();
+        }
+
+        // every request starts from the snapshot, the tasks it started end
+        // within its time limit, before the next restore drops them
+        output.clear();
+        err.str({});
+        forth.restore(*snapshot_);
+        forth.run(job.script);
+        forth.runTasks();
+        if (output.exceeded())
+            err << "Error: output limit reached!\n";
+
+        std::string stack;
+        for (Cell cell : forth.stack())
+            stack += (stack.empty() ? "" : " ") + std::to_string(cell);
+
+        std::string errors = err.str();
+        std::string response = std::to_string(output.text().size()) + " " + std::to_string(errors.size()) + " " +
+                               std::to_string(forth.stack().size()) + "\n" + output.text() + errors + stack + "\n";
+
+        // only the first response of a round wakes the event loop up
+        bool wake {false};
+        {
+            std::lock_guard lock {mutex_};
+            running_[slot].since.reset();
+            wake = done_.empty();
+            done_.push_back({job.connection, job.sequence, std::move(response)});
+        }
+        if (wake) {
+            std::uint64_t one {1};
+            [[maybe_unused]] auto written = ::write(wake_fd_, &one, sizeof(one));
+        }
+    }
+}
+
+/* interrupt the requests running past the time limit
+ * Args:
+ *  all : true to interrupt every request, when the server stops
+ */
+void Server::interrupt(bool all)
+{
+    auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard lock {mutex_};
+    for (Running& running : running_) {
+        if ((running.forth != nullptr) && running.since && (all || (now - *running.since > time_limit_)))
+            running.forth->interrupt();
+    }
+}
+
+// accept the pending connections
+void Server::accept()
+{
+    while (true) {
+        int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        std::uint64_t id = next_connection_++;
+        Connection& connection = connections_[id];
+        connection.fd = fd;
+        watch(connection, id);
+    }
+}
+
+/* read the requests of a connection, and queue them for the workers
+ * Args:
+ *  id : the identifier of the connection
+ */
+void Server::read(std::uint64_t id)
+{
+    auto found = connections_.find(id);
+    if (found == connections_.end())
+        return;
+    Connection& connection = found->second;
+
+    // the input holds at most one request past the complete ones, the rest
+    // stays in the socket until the next events
+    char buffer[kReadChunk];
+    while (!connection.closing && (connection.input.size() <= kMaxRequest + kMaxHeader)) {
+        ssize_t count = ::recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (count > 0) {
+            connection.input.append(buffer, static_cast<std::size_t>(count));
+        } else if ((count < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+            break;
+        } else if ((count < 0) && (errno == EINTR)) {
+            continue;
+        } else {
+            connection.closing = true;
+        }
+    }
+
+    split(connection, id);
+
+    // the responses still due are sent before closing
+    if (connection.closing && (connection.next == connection.received) && connection.output.empty())
+        close(id);
+    else
+        watch(connection, id);
+}
+
+/* queue the complete requests read on a connection for the workers, until
+ * too many of them or of their responses are waiting, or up to an invalid
+ * request header
+ * Args:
+ *  connection : the connection
+ *  id         : its identifier
+ */
+void Server::split(Connection& connection, std::uint64_t id)
+{
+    std::vector<Job> jobs;
+    std::size_t position {0};
+    while (!saturated(connection)) {
+        std::size_t eol = connection.input.find('\n', position);
+        if ((eol == std::string::npos) && (connection.input.size() - position > kMaxHeader)) {
+            refuse(connection);
+            position = connection.input.size();
+            break;
+        }
+        if (eol == std::string::npos)
+            break;
+
+        std::size_t size {0};
+        bool valid = (eol > position);
+        for (std::size_t i = position; valid && (i < eol); ++i) {
+            valid = std::isdigit(static_cast<unsigned char>(connection.input[i])) && (size <= kMaxRequest);
+            size = size * 10 + static_cast<std::size_t>(connection.input[i] - '0');
+        }
+        if (!valid || (size > kMaxRequest)) {
+            refuse(connection);
+            position = connection.input.size();
+            break;
+        }
+
+        if (connection.input.size() - (eol + 1) < size)
+            break;
+
+        jobs.push_back({id, connection.received++, connection.input.substr(eol + 1, size)});
+        position = eol + 1 + size;
+    }
+    connection.input.erase(0, position);
+    queue(jobs);
+}
+
+/* stop reading a connection sending an invalid request header, it is
+ * closed once the responses of the requests before are sent
+ * Args:
+ *  connection : the connection
+ */
+void Server::refuse(Connection& connection)
+{
+    std::cerr << "Error: invalid request header, closing the connection\n";
+    connection.closing = true;
+}
+
+/* queue requests for the workers
+ * Args:
+ *  jobs : the requests, moved to the queue
+ */
+void Server::queue(std::vector<Job>& jobs)
+{
+    if (jobs.empty())
+        return;
+
+    {
+        std::lock_guard lock {mutex_};
+        for (Job& job : jobs)
+            jobs_.push_back(std::move(job));
+    }
+    if (jobs.size() == 1)
+        ready_.notify_one();
+    else
+        ready_.notify_all();
+}
+
+/* send the responses queued on a connection
+ * Args:
+ *  id : the identifier of the connection
+ */
+void Server::write(std::uint64_t id)
+{
+    auto found = connections_.find(id);
+    if (found == connections_.end())
+        return;
+    Connection& connection = found->second;
+
+    while (connection.sent < connection.output.size()) {
+        ssize_t count = ::send(connection.fd, connection.output.data() + connection.sent,
+                               connection.output.size() - connection.sent, MSG_NOSIGNAL);
+        if (count >= 0) {
+            connection.sent += static_cast<std::size_t>(count);
+        } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            break;
+        } else if (errno != EINTR) {
+            close(id);
+            return;
+        }
+    }
+
+    if (connection.sent == connection.output.size()) {
+        connection.output.clear();
+        connection.sent = 0;
+    }
+
+    // the requests left waiting while the connection was saturated
+    split(connection, id);
+
+    if (connection.closing && (connection.next == connection.received) && connection.output.empty())
+        close(id);
+    else
+        watch(connection, id);
+}
+
+// queue the responses of the workers, in the order of the requests
+void Server::complete()
+{
+    std::uint64_t signals {0};
+    [[maybe_unused]] auto count = ::read(wake_fd_, &signals, sizeof(signals));
+
+    std::vector<Done> done;
+    {
+        std::lock_guard lock {mutex_};
+        done.swap(done_);
+    }
+
+    std::vector<std::uint64_t> ready;
+    for (Done& response : done) {
+        auto found = connections_.find(response.connection);
+        if (found == connections_.end())
+            continue;
+        Connection& connection = found->second;
+
+        connection.pending.emplace(response.sequence, std::move(response.response));
+        while (!connection.pending.empty() && (connection.pending.begin()->first == connection.next)) {
+            connection.output += connection.pending.begin()->second;
+            connection.pending.erase(connection.pending.begin());
+            ++connection.next;
+        }
+        ready.push_back(response.connection);
+    }
+
+    // try to send them right away, epoll only takes over on full sockets
+    for (auto id : ready)
+        write(id);
+}
+
+/* close a connection, the responses still running are dropped
+ * Args:
+ *  id : the identifier of the connection
+ */
+void Server::close(std::uint64_t id)
+{
+    auto found = connections_.find(id);
+    if (found == connections_.end())
+        return;
+
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, found->second.fd, nullptr);
+    ::close(found->second.fd);
+    connections_.erase(found);
+}
+
+/* check if a connection has too many requests waiting for their response,
+ * or too much of its responses waiting for the peer
+ * Args:
+ *  connection : the connection
+ * Returns:
+ *  True if its next requests are left in the socket for now
+ */
+bool Server::saturated(const Connection& connection)
+{
+    return (connection.received - connection.next >= kMaxOutstanding) ||
+           (connection.output.size() - connection.sent >= kMaxUnsent);
+}
+
+/* update the events watched on a connection: new requests until the peer
+ * closes it or while it is not saturated, room in the socket while
+ * responses are pending
+ * Args:
+ *  connection : the connection
+ *  id         : its identifier
+ */
+void Server::watch(Connection& connection, std::uint64_t id)
+{
+    std::uint32_t events {0};
+    if (!connection.closing && !saturated(connection))
+        events |= EPOLLIN;
+    if (connection.sent < connection.output.size())
+        events |= EPOLLOUT;
+
+    if (events == connection.events)
+        return;
+
+    // a connection watched for nothing leaves epoll, else a hang up would
+    // be reported in a loop
+    epoll_event event {events, {.u64 = id}};
+    if (events == 0)
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection.fd, nullptr);
+    else
+        ::epoll_ctl(epoll_fd_, (connection.events == 0) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, connection.fd, &event);
+    connection.events = events;
+}
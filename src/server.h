@@ -0,0 +1,126 @@
+/*
+ * @file    server.h
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Interface / Persistent server running scripts sent over a socket
+ */
+
+// ----- header guards
+#ifndef FORTH_SERVER_H_
+#define FORTH_SERVER_H_
+
+// ----- includes
+#include "forth_vm.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ----- class
+// a single thread multiplexes the connections with epoll, the scripts are
+// run by a pool of workers owning a virtual machine each, built on the
+// shared snapshot and restored between the requests. The workers refuse the
+// file and console words, and a request running past the time limit is
+// interrupted, as is one writing too much output. The requests of a
+// connection are left in its socket while too many of them wait for their
+// response, or too much of the responses waits for the peer to read it.
+//
+// protocol, pipelined: the requests of a connection are answered in order
+//  request  : "<size>\n" followed by the script
+//  response : "<output size> <error size> <depth>\n" followed by the output,
+//             the errors and the stack cells, bottom first, on one line
+class Server
+{
+public:
+    Server(ForthVM::SnapshotPtr_T, std::size_t);
+    virtual ~Server();
+
+    // no copy or move semantics
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+    Server(Server&&) = delete;
+    Server& operator=(Server&&) = delete;
+
+    void setJitThreshold(std::size_t);
+    void setTimeLimit(std::chrono::milliseconds);
+    bool listen(const std::string&);
+    void run();
+
+private:
+    // script waiting for a worker
+    struct Job {
+        std::uint64_t connection {0};
+        std::uint64_t sequence {0};
+        std::string script {};
+    };
+
+    // response of a worker, until the I/O thread queues it
+    struct Done {
+        std::uint64_t connection {0};
+        std::uint64_t sequence {0};
+        std::string response {};
+    };
+
+    // virtual machine of a worker, and the start of its current request
+    struct Running {
+        ForthVM* forth {nullptr};
+        std::optional<std::chrono::steady_clock::time_point> since {};
+    };
+
+    struct Connection {
+        int fd {-1};
+        std::string input {};
+        std::string output {};
+        std::size_t sent {0};
+        std::uint64_t received {0};     // sequence of the next request
+        std::uint64_t next {0};         // sequence of the next response
+        std::map<std::uint64_t, std::string> pending {};    // out of order
+        bool closing {false};           // no more requests from the peer
+        std::uint32_t events {0};       // watched by epoll
+    };
+
+    void work(std::size_t);
+    void interrupt(bool);
+    void accept();
+    void read(std::uint64_t);
+    void split(Connection&, std::uint64_t);
+    static void refuse(Connection&);
+    void queue(std::vector<Job>&);
+    void write(std::uint64_t);
+    void complete();
+    void close(std::uint64_t);
+    static bool saturated(const Connection&);
+    void watch(Connection&, std::uint64_t);
+
+private:
+    ForthVM::SnapshotPtr_T snapshot_ {};
+    std::size_t workers_ {1};
+    std::optional<std::size_t> jit_threshold_ {};
+    std::chrono::milliseconds time_limit_ {10000};
+
+    std::string path_ {};
+    int listen_fd_ {-1};
+    int epoll_fd_ {-1};
+    int wake_fd_ {-1};                  // eventfd signaled by the workers
+
+    std::unordered_map<std::uint64_t, Connection> connections_ {};
+    std::uint64_t next_connection_ {0};
+
+    // jobs for the workers, and their responses
+    std::mutex mutex_ {};
+    std::condition_variable ready_ {};
+    std::deque<Job> jobs_ {};
+    std::vector<Done> done_ {};
+    std::vector<Running> running_ {};   // one per worker
+    bool stopping_ {false};
+};
+
+#endif // FORTH_SERVER_H_
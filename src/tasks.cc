@@ -0,0 +1,94 @@
+/*
+ * @file    tasks.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Forth Virtual Machine cooperative tasks
+ */
+
+// ----- includes
+#include "forth_vm.h"
+
+#include <poll.h>
+#include <unistd.h>
+
+
+// ----- public implementation
+
+/* Run the tasks left until they all end, and write their output
+ */
+void ForthVM::runTasks()
+{
+    while (!tasks_.empty())
+        schedule();
+    output_.flush();
+}
+
+
+// ----- private implementation
+
+/* run every task once, up to its next PAUSE or its end. A switch only
+ * swaps the stacks of the task with the ones of the virtual machine.
+ */
+void ForthVM::schedule()
+{
+    if (in_task_)
+        return;
+
+    // the calls open in the profile and the trace belong to the program
+    // running, they are set aside while the others run
+    Profiler::Suspended calls = profiler_.suspend();
+    std::vector<std::uint32_t> traced = trace_.suspend(stack_.size());
+
+    // the tasks spawned during the round start at the next one
+    std::size_t count = tasks_.size();
+    for (std::size_t i = 0; i < count; ) {
+        stack_.swap(tasks_[i].stack);
+        rstack_.swap(tasks_[i].rstack);
+        fstack_.swap(tasks_[i].fstack);
+        profiler_.resume(std::move(tasks_[i].calls));
+        trace_.resume(tasks_[i].traced, stack_.size());
+        in_task_ = true;
+        paused_.reset();
+
+        execute(tasks_[i].ip, 0);
+
+        // a task ended by an error may leave the calls it resumed open
+        in_task_ = false;
+        if (!paused_)
+            profiler_.unwind(0);
+        tasks_[i].calls = profiler_.suspend();
+        tasks_[i].traced = trace_.suspend(stack_.size());
+        stack_.swap(tasks_[i].stack);
+        rstack_.swap(tasks_[i].rstack);
+        fstack_.swap(tasks_[i].fstack);
+
+        if (paused_) {
+            tasks_[i].ip = *paused_;
+            ++i;
+        } else {
+            tasks_.erase(tasks_.begin() + static_cast<std::ptrdiff_t>(i));
+            --count;
+        }
+    }
+
+    profiler_.resume(std::move(calls));
+    trace_.resume(traced, stack_.size());
+}
+
+/* read a character from the standard input
+ * Args:
+ *  wait : false to give up when no character is available yet
+ * Returns:
+ *  The character, -1 at the end of the input, none if it would wait
+ */
+std::optional<Cell> ForthVM::readKey(bool wait)
+{
+    pollfd input {STDIN_FILENO, POLLIN, 0};
+    if (!wait && (::poll(&input, 1, 0) == 0))
+        return std::nullopt;
+
+    unsigned char c {0};
+    if (::read(STDIN_FILENO, &c, 1) != 1)
+        return -1;
+    return c;
+}
@@ -8,6 +8,17 @@
 // ----- includes
 #include "tokenizer.h"
 
+// ----- helpers
+namespace {
+
+// token separators, as for the formatted stream extraction
+inline bool isSpace(char c)
+{
+    return (c == ' ') || ((c >= '\t') && (c <= '\r'));
+}
+
+}
+
 // ----- public implementation
 
 // constructor
@@ -20,65 +31,112 @@ Tokenizer::Tokenizer()
 {
 }
 
-/* Initialize the underlying istream with the user input
+/* Initialize the scanner with the user input
  * Args:
- *      line (std::string) : the input line from the user
+ *      input (std::string_view) : the input from the user
  */
-void Tokenizer::parse(const std::string& line)
+void Tokenizer::parse(std::string_view input)
 {
-    // clear the current istream
-    clear();
+    current_ = input.data();
+    end_ = input.data() + input.size();
+    consumed_ = current_;
 
-    // set the istream to the new line
-    stream_.str(line);
+    // the lookahead token is always ready
+    scan();
 }
 
-// clear the current istream
+// clear the current input
 void Tokenizer::clear()
 {
-    stream_.str("");
-    stream_.seekg(0L);
-    next_token_.clear();
+    current_ = nullptr;
+    end_ = nullptr;
+    consumed_ = nullptr;
+    next_token_ = std::nullopt;
 }
 
-/* return the next token in the string
+/* return the next token in the input
  * Returns:
  *      The next token if any, std::nullopt if none is available
  */
-std::optional<std::string> Tokenizer::next()
+std::optional<std::string_view> Tokenizer::next()
 {
-    std::string token;
-
-    // lookup in the list if we already have a token from a previous peek
-    if (next_token_.size() > 0) {
-        // retrieve the token and send it back
-        token = next_token_.front(); next_token_.pop_front();
-        return token;
-    }
+    std::optional<std::string_view> token = next_token_;
+    if (token)
+        consumed_ = token->data() + token->size();
 
-    // end of the stream
-    if (stream_.eof())
-        return std::nullopt;
-
-    // retrieve a new token
-    stream_ >> token;
+    scan();
     return token;
 }
 
-/* peek at the next token, without removing it from the queue
+/* peek at the next token, without consuming it
  * Returns:
  *      The next token if any, std::nullopt if none is available
  */
-std::optional<std::string> Tokenizer::peek()
+std::optional<std::string_view> Tokenizer::peek() const
+{
+    return next_token_;
+}
+
+// skip the rest of the current line
+void Tokenizer::skipLine()
+{
+    current_ = consumed_;
+    while ((current_ != end_) && (*current_ != '\n'))
+        ++current_;
+
+    consumed_ = current_;
+    scan();
+}
+
+/* parse the input up to a delimiter, after the last consumed token
+ * Args:
+ *      delimiter : the character ending the text
+ * Returns:
+ *      The text before the delimiter, std::nullopt if the input ends first
+ */
+std::optional<std::string_view> Tokenizer::parseUntil(char delimiter)
 {
-    // no more token to read
-    if (stream_.eof())
+    // the text starts after the separator following the last token
+    const char* start = consumed_;
+    if ((start != end_) && isSpace(*start))
+        ++start;
+
+    current_ = start;
+    while ((current_ != end_) && (*current_ != delimiter))
+        ++current_;
+
+    // the delimiter is missing, the whole input is consumed
+    if (current_ == end_) {
+        consumed_ = current_;
+        scan();
         return std::nullopt;
+    }
+
+    std::string_view text(start, static_cast<std::size_t>(current_ - start));
+    consumed_ = ++current_;
+    scan();
+    return text;
+}
 
-    // grab the next token and add it to the list
-    std::string token;
-    stream_ >> token;
-    next_token_.push_back(token);
 
-    return token;
+// ----- private implementation
+
+// scan the lookahead token
+void Tokenizer::scan()
+{
+    // skip the separators
+    while ((current_ != end_) && isSpace(*current_))
+        ++current_;
+
+    if (current_ == end_) {
+        next_token_ = std::nullopt;
+        return;
+    }
+
+    // the token runs up to the next separator
+    const char* start = current_;
+    while ((current_ != end_) && !isSpace(*current_))
+        ++current_;
+
+    next_token_ = std::string_view(start, static_cast<std::size_t>(current_ - start));
 }
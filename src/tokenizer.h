@@ -10,10 +10,8 @@
 #define FORTH_TOKENIZER_H_
 
 // ----- includes
-#include <string>
 #include <optional>
-#include <sstream>
-#include <list>
+#include <string_view>
 
 // ----- class
 class Tokenizer
@@ -28,14 +26,23 @@ public:
     Tokenizer(Tokenizer&&) = delete;
     Tokenizer&& operator=(Tokenizer&&) = delete;
 
-    void parse(const std::string&);
+    void parse(std::string_view);
     void clear();
-    std::optional<std::string> next();
-    std::optional<std::string> peek();
+    std::optional<std::string_view> next();
+    std::optional<std::string_view> peek() const;
+
+    void skipLine();
+    std::optional<std::string_view> parseUntil(char);
+
+private:
+    void scan();
 
 private:
-    std::istringstream stream_ {};
-    std::list<std::string> next_token_ {};
+    // the tokens are slices of the caller's buffer, which must outlive them
+    const char* current_ {nullptr};
+    const char* end_ {nullptr};
+    const char* consumed_ {nullptr};        // end of the last consumed token
+    std::optional<std::string_view> next_token_ {};
 };
 
 #endif // FORTH_TOKENIZER_H_
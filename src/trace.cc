@@ -0,0 +1,163 @@
+/*
+ * @file    trace.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Event tracing ring buffer of the virtual machine
+ */
+
+// ----- includes
+#include "trace.h"
+
+#include <algorithm>
+#include <fstream>
+
+// ----- helpers
+namespace {
+
+// records kept by a buffer, a power of two
+constexpr std::size_t kTraceCapacity {1 << 16};
+
+constexpr const char* kErrorNames[] = {
+    "stack underflow",
+    "unknown word",
+    "control mismatch",
+    "invalid address",
+    "division by zero",
+    "overflow",
+    "interrupted",
+};
+
+// quote a name for a JSON string
+std::string quote(const std::string& name)
+{
+    std::string quoted {"\""};
+    for (char c : name) {
+        if ((c == '"') || (c == '\\'))
+            quoted += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20)
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+}
+
+
+// ----- public implementation
+
+/* constructor, the records are only allocated in the tracing builds
+ */
+TraceBuffer::TraceBuffer() :
+    records_(isEnabled() ? kTraceCapacity : 0),
+    mask_ {isEnabled() ? kTraceCapacity - 1 : 0},
+    origin_ {now()},
+    origin_time_ {std::chrono::steady_clock::now()}
+{
+}
+
+/* destructor
+ */
+/*virtual*/ TraceBuffer::~TraceBuffer()
+{
+}
+
+/* copy the records still in the buffer
+ * Returns:
+ *  The records, from the oldest to the newest
+ */
+std::vector<TraceRecord> TraceBuffer::snapshot() const
+{
+    std::uint64_t head = head_.load(std::memory_order_acquire);
+    std::uint64_t count = std::min<std::uint64_t>(head, records_.size());
+
+    std::vector<TraceRecord> records;
+    records.reserve(static_cast<std::size_t>(count));
+    for (std::uint64_t i = head - count; i < head; ++i)
+        records.push_back(records_[i & mask_]);
+
+    return records;
+}
+
+/* close the calls still open at a task switch, so that the calls of the
+ * other tasks are not nested in them
+ * Args:
+ *  depth : the depth of the data stack
+ * Returns:
+ *  The words of the calls, the outermost first, to resume with the task
+ */
+std::vector<std::uint32_t> TraceBuffer::suspend(std::size_t depth)
+{
+    std::vector<std::uint32_t> words {open_};
+    while (!open_.empty())
+        record(TraceEvent::WordExit, 0, depth);
+    return words;
+}
+
+/* open again the calls of a task resumed
+ * Args:
+ *  words : the words returned by suspend()
+ *  depth : the depth of the data stack
+ */
+void TraceBuffer::resume(const std::vector<std::uint32_t>& words, std::size_t depth)
+{
+    for (std::uint32_t word : words)
+        record(TraceEvent::WordEnter, word, depth);
+}
+
+/* write the records in the trace event format of the Chrome tracing tools
+ * (chrome://tracing, Perfetto)
+ * Args:
+ *  filename : the JSON file to write
+ *  words    : the name of every user defined word
+ * Returns:
+ *  True if the file has been written
+ */
+bool TraceBuffer::writeChromeTrace(const std::string& filename, const std::vector<std::string>& words) const
+{
+    std::ofstream file {filename};
+    if (!file)
+        return false;
+
+    // microseconds per tick, measured since the creation of the buffer
+    double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() -
+                                                               origin_time_).count();
+    std::uint64_t ticks = now() - origin_;
+    double scale = (ticks > 0) ? elapsed / static_cast<double>(ticks) : 0;
+
+    file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+    bool first {true};
+    for (const TraceRecord& record : snapshot()) {
+        double ts = static_cast<double>(record.time - origin_) * scale;
+        file << (first ? "" : ",\n") << "{\"pid\":1,\"tid\":1,\"ts\":" << ts << ",";
+        first = false;
+
+        switch (record.event) {
+            case TraceEvent::WordEnter:
+                file << "\"ph\":\"B\",\"name\":"
+                     << quote((record.value < words.size()) ? words[record.value] : "?") << "},\n";
+                break;
+            case TraceEvent::WordExit:
+                file << "\"ph\":\"E\"},\n";
+                break;
+            case TraceEvent::BranchTaken:
+            case TraceEvent::BranchNotTaken:
+                file << "\"ph\":\"i\",\"s\":\"t\",\"name\":\""
+                     << ((record.event == TraceEvent::BranchTaken) ? "branch taken" : "branch not taken")
+                     << "\",\"args\":{\"address\":" << record.value << "}},\n";
+                break;
+            case TraceEvent::Error:
+                file << "\"ph\":\"i\",\"s\":\"t\",\"name\":\"error: "
+                     << ((record.value < std::size(kErrorNames)) ? kErrorNames[record.value] : "?")
+                     << "\"},\n";
+                break;
+        }
+
+        // the stack depth, as a counter track
+        file << "{\"pid\":1,\"tid\":1,\"ts\":" << ts << ",\"ph\":\"C\",\"name\":\"stack\","
+             << "\"args\":{\"depth\":" << record.depth << "}}";
+    }
+
+    file << "\n]}\n";
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,127 @@
+/*
+ * @file    trace.h
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Interface / Event tracing ring buffer of the virtual machine
+ */
+
+// ----- header guards
+#ifndef FORTH_TRACE_H_
+#define FORTH_TRACE_H_
+
+// ----- includes
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// ----- tracing switch
+// the events are only recorded in the builds made with FORTH_TRACE, the
+// other builds compile the trace points to nothing
+#ifdef FORTH_TRACE
+#define FORTH_TRACE_EVENT(trace, event, value, depth)   (trace).record((event), (value), (depth))
+#else
+#define FORTH_TRACE_EVENT(trace, event, value, depth)   ((void)0)
+#endif
+
+// ----- types
+enum class TraceEvent : std::uint8_t {
+    WordEnter,          // value: index of the word
+    WordExit,
+    BranchTaken,        // value: address of the branch
+    BranchNotTaken,
+    Error,              // value: a TraceError
+};
+
+enum class TraceError : std::uint32_t {
+    StackUnderflow,
+    UnknownWord,
+    ControlMismatch,
+    InvalidAddress,
+    DivisionByZero,
+    Overflow,
+    Interrupted,
+};
+
+// fixed size record, with the stack depth when the event happened
+struct TraceRecord {
+    std::uint64_t time;
+    std::uint32_t value;
+    std::uint16_t depth;
+    TraceEvent event;
+};
+
+// ----- class
+// single producer ring buffer: the virtual machine owning it records the
+// events without locks, overwriting the oldest ones, and the snapshots
+// read the records published before them
+class TraceBuffer
+{
+public:
+    TraceBuffer();
+    virtual ~TraceBuffer();
+
+    // no copy or move semantics
+    TraceBuffer(const TraceBuffer&) = delete;
+    TraceBuffer& operator=(const TraceBuffer&) = delete;
+    TraceBuffer(TraceBuffer&&) = delete;
+    TraceBuffer& operator=(TraceBuffer&&) = delete;
+
+    static constexpr bool isEnabled();
+
+    void record(TraceEvent event, std::uint32_t value, std::size_t depth) {
+        std::uint64_t head = head_.load(std::memory_order_relaxed);
+        records_[head & mask_] = {now(), value, static_cast<std::uint16_t>(depth < 0xFFFF ? depth : 0xFFFF),
+                                  event};
+        head_.store(head + 1, std::memory_order_release);
+
+        // the calls still open, closed and opened again at a task switch
+        if (event == TraceEvent::WordEnter)
+            open_.push_back(value);
+        else if ((event == TraceEvent::WordExit) && !open_.empty())
+            open_.pop_back();
+    }
+
+    std::vector<std::uint32_t> suspend(std::size_t);
+    void resume(const std::vector<std::uint32_t>&, std::size_t);
+
+    std::vector<TraceRecord> snapshot() const;
+    bool writeChromeTrace(const std::string&, const std::vector<std::string>&) const;
+
+private:
+    // time stamp counter, or nanoseconds where there is none
+    static std::uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+private:
+    std::vector<TraceRecord> records_ {};
+    std::uint64_t mask_ {0};
+    std::atomic<std::uint64_t> head_ {0};
+    std::vector<std::uint32_t> open_ {};    // words entered and not exited yet
+
+    // clocks at creation, to convert the time stamps to microseconds
+    std::uint64_t origin_ {0};
+    std::chrono::steady_clock::time_point origin_time_ {};
+};
+
+// ----- inline functions
+constexpr bool TraceBuffer::isEnabled()
+{
+#ifdef FORTH_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+#endif // FORTH_TRACE_H_
@@ -0,0 +1,451 @@
+/*
+ * @file    vector_ops.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Bulk operations over the arrays of the data space
+ */
+
+// ----- includes
+#include "vector_ops.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+// the vector kernels work on 32 bits lanes, the 64 bits cells only have
+// the scalar ones
+#if defined(__x86_64__) && defined(__GNUC__) && (FORTH_CELL_BITS == 32)
+#define FORTH_VECTOR_X86
+#include <immintrin.h>
+#endif
+
+// ----- helpers
+namespace {
+
+constexpr std::size_t kCell {sizeof(Cell)};
+
+// cells at any byte address
+Cell load(const std::uint8_t* p)
+{
+    Cell value;
+    std::memcpy(&value, p, kCell);
+    return value;
+}
+
+void store(std::uint8_t* p, Cell value)
+{
+    std::memcpy(p, &value, kCell);
+}
+
+// ----- portable kernels, also the tails of the vector ones
+
+void scalarFill(std::uint8_t* dst, std::size_t n, Cell x)
+{
+    for (std::size_t i = 0; i < n; ++i)
+        store(dst + i * kCell, x);
+}
+
+void scalarAdd(const std::uint8_t* a, const std::uint8_t* b, std::uint8_t* dst, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i)
+        store(dst + i * kCell, static_cast<Cell>(static_cast<UCell>(load(a + i * kCell)) +
+                                                 static_cast<UCell>(load(b + i * kCell))));
+}
+
+void scalarMul(const std::uint8_t* a, const std::uint8_t* b, std::uint8_t* dst, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i)
+        store(dst + i * kCell, static_cast<Cell>(static_cast<UCell>(load(a + i * kCell)) *
+                                                 static_cast<UCell>(load(b + i * kCell))));
+}
+
+Cell scalarSum(const std::uint8_t* a, std::size_t n)
+{
+    UCell sum {0};
+    for (std::size_t i = 0; i < n; ++i)
+        sum += static_cast<UCell>(load(a + i * kCell));
+    return static_cast<Cell>(sum);
+}
+
+Cell scalarMin(const std::uint8_t* a, std::size_t n)
+{
+    Cell min {std::numeric_limits<Cell>::max()};
+    for (std::size_t i = 0; i < n; ++i)
+        min = std::min(min, load(a + i * kCell));
+    return min;
+}
+
+Cell scalarMax(const std::uint8_t* a, std::size_t n)
+{
+    Cell max {std::numeric_limits<Cell>::min()};
+    for (std::size_t i = 0; i < n; ++i)
+        max = std::max(max, load(a + i * kCell));
+    return max;
+}
+
+Cell scalarDot(const std::uint8_t* a, const std::uint8_t* b, std::size_t n)
+{
+    UCell dot {0};
+    for (std::size_t i = 0; i < n; ++i)
+        dot += static_cast<UCell>(load(a + i * kCell)) * static_cast<UCell>(load(b + i * kCell));
+    return static_cast<Cell>(dot);
+}
+
+Cell scalarCount(const std::uint8_t* a, std::size_t n, Cell x)
+{
+    Cell count {0};
+    for (std::size_t i = 0; i < n; ++i)
+        count += (load(a + i * kCell) == x);
+    return count;
+}
+
+// ----- floating point kernels, written as blocks of lanes that the
+// compiler vectorizes for the instruction set of the kernels inlining
+// them. The sums keep the lanes apart, to add in the same order whatever
+// the instruction set.
+
+constexpr std::size_t kReal {sizeof(double)};
+constexpr std::size_t kLanes {4};
+
+[[gnu::always_inline]] inline void mulReals(const std::uint8_t* a, const std::uint8_t* b, std::uint8_t* dst,
+                                            std::size_t n)
+{
+    std::size_t i {0};
+    for (; i + kLanes <= n; i += kLanes) {
+        double x[kLanes];
+        double y[kLanes];
+        std::memcpy(x, a + i * kReal, sizeof(x));
+        std::memcpy(y, b + i * kReal, sizeof(y));
+        for (std::size_t j = 0; j < kLanes; ++j)
+            x[j] *= y[j];
+        std::memcpy(dst + i * kReal, x, sizeof(x));
+    }
+
+    for (; i < n; ++i) {
+        double x;
+        double y;
+        std::memcpy(&x, a + i * kReal, kReal);
+        std::memcpy(&y, b + i * kReal, kReal);
+        x *= y;
+        std::memcpy(dst + i * kReal, &x, kReal);
+    }
+}
+
+[[gnu::always_inline]] inline double sumReals(const std::uint8_t* a, std::size_t n)
+{
+    double sum[kLanes] {};
+    std::size_t i {0};
+    for (; i + kLanes <= n; i += kLanes) {
+        double x[kLanes];
+        std::memcpy(x, a + i * kReal, sizeof(x));
+        for (std::size_t j = 0; j < kLanes; ++j)
+            sum[j] += x[j];
+    }
+
+    double total = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    for (; i < n; ++i) {
+        double x;
+        std::memcpy(&x, a + i * kReal, kReal);
+        total += x;
+    }
+    return total;
+}
+
+void scalarFMul(const std::uint8_t* a, const std::uint8_t* b, std::uint8_t* dst, std::size_t n)
+{
+    mulReals(a, b, dst, n);
+}
+
+double scalarFSum(const std::uint8_t* a, std::size_t n)
+{
+    return sumReals(a, n);
+}
+
+constexpr VectorKernels kScalar {
+    "scalar", scalarFill, scalarAdd, scalarMul, scalarSum, scalarMin, scalarMax, scalarDot, scalarCount,
+    scalarFMul, scalarFSum
+};
+
+#ifdef FORTH_VECTOR_X86
+// ----- SSE2 kernels, 4 cells at a time. SSE2 has neither the 32 bits
+// multiplication nor the 32 bits minimum and maximum, they are emulated.
+
+__m128i loadu(const std::uint8_t* p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+void storeu(std::uint8_t* p, __m128i v)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+
+__m128i mullo(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+__m128i select(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+__m128i min4(__m128i a, __m128i b)
+{
+    return select(_mm_cmpgt_epi32(a, b), b, a);
+}
+
+__m128i max4(__m128i a, __m128i b)
+{
+    return select(_mm_cmpgt_epi32(a, b), a, b);
+}
+
+// fold the 4 lanes of a vector into one
+template<typename T>
+Cell reduce(__m128i v, T op)
+{
+    v = op(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = op(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+Cell add4(__m128i v)
+{
+    return reduce(v, [](__m128i a, __m128i b) { return _mm_add_epi32(a, b); });
+}
+
+void sse2Fill(std::uint8_t* dst, std::size_t n, Cell x)
+{
+    __m128i v = _mm_set1_epi32(x);
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4)
+        storeu(dst + i * kCell, v);
+    scalarFill(dst + i * kCell, n - i, x);
+}
+
+void sse2Add(const std::uint8_t* a, const std::uint8_t* b, std::uint8_t* dst, std::size_t n)
+{
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4)
+        storeu(dst + i * kCell, _mm_add_epi32(loadu(a + i * kCell), loadu(b + i * kCell)));
+    scalarAdd(a + i * kCell, b + i * kCell, dst + i * kCell, n - i);
+}
+
+void sse2Mul(const std::uint8_t* a, const std::uint8_t* b, std::uint8_t* dst, std::size_t n)
+{
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4)
+        storeu(dst + i * kCell, mullo(loadu(a + i * kCell), loadu(b + i * kCell)));
+    scalarMul(a + i * kCell, b + i * kCell, dst + i * kCell, n - i);
+}
+
+Cell sse2Sum(const std::uint8_t* a, std::size_t n)
+{
+    __m128i sum = _mm_setzero_si128();
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4)
+        sum = _mm_add_epi32(sum, loadu(a + i * kCell));
+    return static_cast<Cell>(static_cast<UCell>(add4(sum)) + static_cast<UCell>(scalarSum(a + i * kCell, n - i)));
+}
+
+Cell sse2Min(const std::uint8_t* a, std::size_t n)
+{
+    __m128i min = _mm_set1_epi32(std::numeric_limits<Cell>::max());
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4)
+        min = min4(min, loadu(a + i * kCell));
+    return std::min(reduce(min, min4), scalarMin(a + i * kCell, n - i));
+}
+
+Cell sse2Max(const std::uint8_t* a, std::size_t n)
+{
+    __m128i max = _mm_set1_epi32(std::numeric_limits<Cell>::min());
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4)
+        max = max4(max, loadu(a + i * kCell));
+    return std::max(reduce(max, max4), scalarMax(a + i * kCell, n - i));
+}
+
+Cell sse2Dot(const std::uint8_t* a, const std::uint8_t* b, std::size_t n)
+{
+    __m128i dot = _mm_setzero_si128();
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4)
+        dot = _mm_add_epi32(dot, mullo(loadu(a + i * kCell), loadu(b + i * kCell)));
+    return static_cast<Cell>(static_cast<UCell>(add4(dot)) +
+                             static_cast<UCell>(scalarDot(a + i * kCell, b + i * kCell, n - i)));
+}
+
+Cell sse2Count(const std::uint8_t* a, std::size_t n, Cell x)
+{
+    // the lanes equal to x are -1, subtracted from the counts
+    __m128i v = _mm_set1_epi32(x);
+    __m128i count = _mm_setzero_si128();
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4)
+        count = _mm_sub_epi32(count, _mm_cmpeq_epi32(loadu(a + i * kCell), v));
+    return add4(count) + scalarCount(a + i * kCell, n - i, x);
+}
+
+constexpr VectorKernels kSse2 {
+    "sse2", sse2Fill, sse2Add, sse2Mul, sse2Sum, sse2Min, sse2Max, sse2Dot, sse2Count,
+    scalarFMul, scalarFSum
+};
+
+// ----- AVX2 kernels, 8 cells at a time, compiled for AVX2 whatever the
+// target of the build
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 __m256i loadu8(const std::uint8_t* p)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+AVX2 void storeu8(std::uint8_t* p, __m256i v)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+}
+
+// the two halves of a vector, for the SSE2 reductions
+AVX2 __m128i low(__m256i v)
+{
+    return _mm256_castsi256_si128(v);
+}
+
+AVX2 __m128i high(__m256i v)
+{
+    return _mm256_extracti128_si256(v, 1);
+}
+
+AVX2 void avx2Fill(std::uint8_t* dst, std::size_t n, Cell x)
+{
+    __m256i v = _mm256_set1_epi32(x);
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8)
+        storeu8(dst + i * kCell, v);
+    scalarFill(dst + i * kCell, n - i, x);
+}
+
+AVX2 void avx2Add(const std::uint8_t* a, const std::uint8_t* b, std::uint8_t* dst, std::size_t n)
+{
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8)
+        storeu8(dst + i * kCell, _mm256_add_epi32(loadu8(a + i * kCell), loadu8(b + i * kCell)));
+    scalarAdd(a + i * kCell, b + i * kCell, dst + i * kCell, n - i);
+}
+
+AVX2 void avx2Mul(const std::uint8_t* a, const std::uint8_t* b, std::uint8_t* dst, std::size_t n)
+{
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8)
+        storeu8(dst + i * kCell, _mm256_mullo_epi32(loadu8(a + i * kCell), loadu8(b + i * kCell)));
+    scalarMul(a + i * kCell, b + i * kCell, dst + i * kCell, n - i);
+}
+
+AVX2 Cell avx2Sum(const std::uint8_t* a, std::size_t n)
+{
+    __m256i sum = _mm256_setzero_si256();
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8)
+        sum = _mm256_add_epi32(sum, loadu8(a + i * kCell));
+    return static_cast<Cell>(static_cast<UCell>(add4(_mm_add_epi32(low(sum), high(sum)))) +
+                             static_cast<UCell>(scalarSum(a + i * kCell, n - i)));
+}
+
+AVX2 Cell avx2Min(const std::uint8_t* a, std::size_t n)
+{
+    __m256i min = _mm256_set1_epi32(std::numeric_limits<Cell>::max());
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8)
+        min = _mm256_min_epi32(min, loadu8(a + i * kCell));
+    return std::min(reduce(min4(low(min), high(min)), min4), scalarMin(a + i * kCell, n - i));
+}
+
+AVX2 Cell avx2Max(const std::uint8_t* a, std::size_t n)
+{
+    __m256i max = _mm256_set1_epi32(std::numeric_limits<Cell>::min());
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8)
+        max = _mm256_max_epi32(max, loadu8(a + i * kCell));
+    return std::max(reduce(max4(low(max), high(max)), max4), scalarMax(a + i * kCell, n - i));
+}
+
+AVX2 Cell avx2Dot(const std::uint8_t* a, const std::uint8_t* b, std::size_t n)
+{
+    __m256i dot = _mm256_setzero_si256();
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8)
+        dot = _mm256_add_epi32(dot, _mm256_mullo_epi32(loadu8(a + i * kCell), loadu8(b + i * kCell)));
+    return static_cast<Cell>(static_cast<UCell>(add4(_mm_add_epi32(low(dot), high(dot)))) +
+                             static_cast<UCell>(scalarDot(a + i * kCell, b + i * kCell, n - i)));
+}
+
+AVX2 Cell avx2Count(const std::uint8_t* a, std::size_t n, Cell x)
+{
+    __m256i v = _mm256_set1_epi32(x);
+    __m256i count = _mm256_setzero_si256();
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8)
+        count = _mm256_sub_epi32(count, _mm256_cmpeq_epi32(loadu8(a + i * kCell), v));
+    return add4(_mm_add_epi32(low(count), high(count))) + scalarCount(a + i * kCell, n - i, x);
+}
+
+AVX2 void avx2FMul(const std::uint8_t* a, const std::uint8_t* b, std::uint8_t* dst, std::size_t n)
+{
+    mulReals(a, b, dst, n);
+}
+
+AVX2 double avx2FSum(const std::uint8_t* a, std::size_t n)
+{
+    return sumReals(a, n);
+}
+
+#undef AVX2
+
+constexpr VectorKernels kAvx2 {
+    "avx2", avx2Fill, avx2Add, avx2Mul, avx2Sum, avx2Min, avx2Max, avx2Dot, avx2Count,
+    avx2FMul, avx2FSum
+};
+#endif
+
+}
+
+
+// ----- public implementation
+
+/* list the kernels the processor runs, checked once with CPUID
+ * Returns:
+ *  The kernels, the fastest first and the portable ones last
+ */
+const std::vector<const VectorKernels*>& VectorKernels::supported()
+{
+    static const std::vector<const VectorKernels*> kernels = []() {
+        std::vector<const VectorKernels*> list;
+
+#ifdef FORTH_VECTOR_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            list.push_back(&kAvx2);
+        list.push_back(&kSse2);
+#endif
+
+        list.push_back(&kScalar);
+        return list;
+    }();
+
+    return kernels;
+}
+
+/* the fastest kernels the processor runs
+ * Returns:
+ *  The kernels
+ */
+const VectorKernels& VectorKernels::best()
+{
+    return *supported().front();
+}
@@ -0,0 +1,45 @@
+/*
+ * @file    vector_ops.h
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Interface / Bulk operations over the arrays of the data space
+ */
+
+// ----- header guards
+#ifndef FORTH_VECTOR_OPS_H_
+#define FORTH_VECTOR_OPS_H_
+
+// ----- includes
+#include "cell.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// ----- types
+// kernels of the vector words, for one instruction set. The arrays are
+// given by their first byte, without any alignment, and hold a number of
+// cells or of doubles. The arithmetic of the cells wraps around, as on
+// the stack.
+struct VectorKernels
+{
+    const char* name;
+
+    void (*fill)(std::uint8_t*, std::size_t, Cell);
+    void (*add)(const std::uint8_t*, const std::uint8_t*, std::uint8_t*, std::size_t);
+    void (*mul)(const std::uint8_t*, const std::uint8_t*, std::uint8_t*, std::size_t);
+    Cell (*sum)(const std::uint8_t*, std::size_t);
+    Cell (*min)(const std::uint8_t*, std::size_t);
+    Cell (*max)(const std::uint8_t*, std::size_t);
+    Cell (*dot)(const std::uint8_t*, const std::uint8_t*, std::size_t);
+    Cell (*count)(const std::uint8_t*, std::size_t, Cell);
+
+    void (*fmul)(const std::uint8_t*, const std::uint8_t*, std::uint8_t*, std::size_t);
+    double (*fsum)(const std::uint8_t*, std::size_t);
+
+    // the kernels the processor runs, the fastest first
+    static const std::vector<const VectorKernels*>& supported();
+    static const VectorKernels& best();
+};
+
+#endif // FORTH_VECTOR_OPS_H_
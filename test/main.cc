@@ -0,0 +1,113 @@
+/*
+ * @file    main.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Unit test driver
+ */
+
+// ----- includes
+#include "test.h"
+#include "forth_vm.h"
+
+#include <cstring>
+
+// ----- state
+namespace {
+
+int failures {0};
+
+}
+
+
+// ----- public implementation
+
+/* the registered test cases
+ * Returns:
+ *  The test cases, in the order of their registration
+ */
+std::vector<TestCase>& testCases()
+{
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+/* register a test case, called by the TEST macro
+ * Args:
+ *  name : the name of the test
+ *  body : the function running it
+ * Returns:
+ *  Always true, to initialize the registration flag
+ */
+bool registerTest(const char* name, void (*body)())
+{
+    testCases().push_back({name, body});
+    return true;
+}
+
+/* report a failed check
+ * Args:
+ *  file    : the source file of the check
+ *  line    : its line
+ *  message : the condition that failed
+ */
+void reportFailure(const char* file, int line, const std::string& message)
+{
+    std::cerr << file << ":" << line << ": check failed: " << message << "\n";
+    ++failures;
+}
+
+/* run a script in a new virtual machine
+ * Args:
+ *  script    : the source code
+ *  threshold : the number of calls before a word is compiled, 0 for none
+ * Returns:
+ *  The output, the errors and the stack left by the script
+ */
+ScriptResult runScript(std::string_view script, std::size_t threshold)
+{
+    return runLines({script}, threshold);
+}
+
+/* run the lines of a script one at a time in a new virtual machine, as the
+ * interactive interpreter does
+ * Args:
+ *  lines     : the source code, one line per input
+ *  threshold : the number of calls before a word is compiled, 0 for none
+ * Returns:
+ *  The output, the errors and the stack left by the script
+ */
+ScriptResult runLines(const std::vector<std::string_view>& lines, std::size_t threshold)
+{
+    ForthVM forth;
+    forth.setJitThreshold(threshold);
+
+    std::ostringstream out;
+    std::ostringstream err;
+    forth.setOutput(out, err);
+    for (std::string_view line : lines)
+        forth.run(line);
+
+    return {out.str(), err.str(), forth.stack()};
+}
+
+
+// ----- main
+// run every test, or the ones whose name contains an argument
+int main(int argc, char* argv[]) {
+    int count {0};
+    for (const TestCase& test : testCases()) {
+        bool selected = (argc < 2);
+        for (int i = 1; i < argc; ++i)
+            selected = selected || (std::strstr(test.name, argv[i]) != nullptr);
+        if (!selected)
+            continue;
+
+        int before = failures;
+        test.body();
+        std::cout << ((failures == before) ? "ok      " : "FAILED  ") << test.name << "\n";
+        ++count;
+    }
+
+    std::cout << count << " tests, " << failures << " failed checks\n";
+    return (failures == 0) ? 0 : 1;
+}
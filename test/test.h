@@ -0,0 +1,67 @@
+/*
+ * @file    test.h
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Interface / Minimal unit test harness
+ */
+
+// ----- header guards
+#ifndef FORTH_TEST_H_
+#define FORTH_TEST_H_
+
+// ----- includes
+#include "cell.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ----- types
+// a test case, registered by the TEST macro before main runs
+struct TestCase {
+    const char* name;
+    void (*body)();
+};
+
+// result of a script run by a fresh virtual machine
+struct ScriptResult {
+    std::string output {};
+    std::string errors {};
+    std::vector<Cell> stack {};
+};
+
+// ----- functions
+std::vector<TestCase>& testCases();
+bool registerTest(const char*, void (*)());
+void reportFailure(const char*, int, const std::string&);
+
+ScriptResult runScript(std::string_view, std::size_t = 0);
+ScriptResult runLines(const std::vector<std::string_view>&, std::size_t = 0);
+
+// ----- macros
+#define TEST(name)                                                              \
+    static void name();                                                         \
+    [[maybe_unused]] static const bool name##_registered = registerTest(#name, name); \
+    static void name()
+
+// the checks report a failure and let the test go on
+#define CHECK(cond)                                                             \
+    do {                                                                        \
+        if (!(cond))                                                            \
+            reportFailure(__FILE__, __LINE__, #cond);                           \
+    } while (false)
+
+#define CHECK_EQ(a, b)                                                          \
+    do {                                                                        \
+        const auto& lhs_ = (a);                                                 \
+        const auto& rhs_ = (b);                                                 \
+        if (!(lhs_ == rhs_)) {                                                  \
+            std::ostringstream message_;                                        \
+            message_ << #a " == " #b " (" << lhs_ << " != " << rhs_ << ")";     \
+            reportFailure(__FILE__, __LINE__, message_.str());                  \
+        }                                                                       \
+    } while (false)
+
+#endif // FORTH_TEST_H_
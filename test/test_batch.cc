@@ -0,0 +1,162 @@
+/*
+ * @file    test_batch.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the parallel runner of scripts
+ */
+
+// ----- includes
+#include "test.h"
+#include "batch.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+// ----- helpers
+namespace {
+
+// scripts written to a scratch directory, removed with it
+class Scripts
+{
+public:
+    explicit Scripts(std::string_view name) :
+        dir_ {std::filesystem::temp_directory_path() / ("slforth_test_" + std::string {name})}
+    {
+        std::filesystem::remove_all(dir_);
+        std::filesystem::create_directories(dir_);
+    }
+
+    ~Scripts() { std::filesystem::remove_all(dir_); }
+
+    Scripts(const Scripts&) = delete;
+    Scripts& operator=(const Scripts&) = delete;
+
+    // write the next script of the batch, in name order
+    void add(std::string_view source)
+    {
+        char name[16];
+        std::snprintf(name, sizeof(name), "%03zu.fs", paths_.size());
+        paths_.push_back((dir_ / name).string());
+        std::ofstream {paths_.back()} << source << "\n";
+    }
+
+    std::string dir() const { return dir_.string(); }
+    const std::vector<std::string>& paths() const { return paths_; }
+
+private:
+    std::filesystem::path dir_ {};
+    std::vector<std::string> paths_ {};
+};
+
+/* run a batch on the words of a prelude
+ * Args:
+ *  prelude : the source code run before the snapshot
+ *  scripts : the paths of the scripts
+ *  jobs    : the number of workers
+ *  limit   : the time limit of a script, 0 for none
+ *  size    : the size of the data space in bytes
+ */
+ScriptResult runBatch(std::string_view prelude, const std::vector<std::string>& scripts, std::size_t jobs,
+                      std::chrono::milliseconds limit = std::chrono::milliseconds {0},
+                      std::size_t size = DataSpace::kDefaultCapacity)
+{
+    ForthVM forth {size};
+    forth.run(prelude);
+
+    BatchRunner runner {forth.snapshot(), jobs};
+    runner.setTimeLimit(limit);
+    std::ostringstream out;
+    std::ostringstream err;
+    runner.run(scripts, out, err);
+    return {out.str(), err.str(), {}};
+}
+
+}
+
+
+// ----- tests
+
+// the output comes in the order of the scripts, the slow ones included
+TEST(batchInOrder)
+{
+    Scripts scripts {"batch_order"};
+    for (int i = 0; i < 16; ++i)
+        scripts.add((i % 3 == 0) ? ": W 1000000 0 DO LOOP ; " + std::to_string(i) + " W ." : std::to_string(i) + " .");
+    CHECK(BatchRunner::listScripts(scripts.dir()) == scripts.paths());
+
+    std::string expected;
+    for (int i = 0; i < 16; ++i)
+        expected += std::to_string(i) + " ";
+    for (std::size_t jobs : {std::size_t {1}, std::size_t {4}, std::size_t {32}}) {
+        auto result = runBatch("", scripts.paths(), jobs);
+        CHECK_EQ(result.output, expected);
+        CHECK_EQ(result.errors, std::string {});
+    }
+}
+
+// a worker stuck on a script leaves its other scripts to the idle workers:
+// the two endless scripts dealt to the first worker run at the same time,
+// and both are interrupted after the time limit
+TEST(batchWorkStealing)
+{
+    Scripts scripts {"batch_stealing"};
+    scripts.add(": W BEGIN 0 UNTIL ; 1 . W");
+    scripts.add("2 .");
+    scripts.add(": W BEGIN 0 UNTIL ; 3 . W");
+    scripts.add("4 .");
+
+    constexpr std::chrono::milliseconds kLimit {500};
+    auto start = std::chrono::steady_clock::now();
+    auto result = runBatch("", scripts.paths(), 2, kLimit);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    CHECK_EQ(result.output, std::string {"1 2 3 4 "});
+    CHECK(result.errors.find("interrupted") != std::string::npos);
+    CHECK(result.errors.find("interrupted") != result.errors.rfind("interrupted"));
+    CHECK(elapsed >= kLimit);
+    CHECK(elapsed < kLimit * 3 / 2);
+}
+
+// the errors and the definitions of a script do not reach the next ones
+TEST(batchErrorIsolation)
+{
+    Scripts scripts {"batch_errors"};
+    scripts.add(": LOCAL 7 ; LOCAL . 1 0 / 99 .");
+    scripts.add("LOCAL .");
+    scripts.add(": HALF 1 2 UNKNOWN");
+    scripts.add("HALF 5 SQ .");
+    scripts.add("1 2 3 HEX");
+    scripts.add("255 . .");
+
+    // the stack and BASE start afresh, the next . has nothing to print
+    auto result = runBatch(": SQ DUP * ;", scripts.paths(), 1);
+    CHECK_EQ(result.output, std::string {"7 99 25 255 "});
+    CHECK(result.errors.find("division by zero") != std::string::npos);
+    CHECK(result.errors.find("Unknown word [LOCAL]") != std::string::npos);
+    CHECK(result.errors.find("Unknown word [HALF]") != std::string::npos);
+    CHECK(result.errors.find("not enough values on the stack") != std::string::npos);
+
+    // a missing script is an error of its own
+    auto missing = runBatch("", {scripts.dir() + "/missing.fs", scripts.paths()[3]}, 2);
+    CHECK(missing.errors.find("unable to load the file") != std::string::npos);
+    CHECK(missing.errors.find("Unknown word [HALF]") != std::string::npos);
+}
+
+// the workers size their data space as the machine of the snapshot, with
+// or without a prelude
+TEST(batchDataSize)
+{
+    Scripts scripts {"batch_data_size"};
+    scripts.add("HERE 4000000 ALLOT HERE SWAP - .");
+
+    constexpr std::size_t kSize {std::size_t {1} << 24};
+    for (std::string_view prelude : {"", "VARIABLE V"}) {
+        auto result = runBatch(prelude, scripts.paths(), 1, std::chrono::milliseconds {0}, kSize);
+        CHECK_EQ(result.output, std::string {"4000000 "});
+        CHECK_EQ(result.errors, std::string {});
+    }
+
+    auto result = runBatch("", scripts.paths(), 1);
+    CHECK(result.errors.find("data space exhausted") != std::string::npos);
+}
@@ -0,0 +1,105 @@
+/*
+ * @file    test_cells.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the cell width and of the double cells
+ */
+
+// ----- includes
+#include "test.h"
+
+#include <limits>
+
+// ----- helpers
+namespace {
+
+constexpr Cell kMax {std::numeric_limits<Cell>::max()};
+constexpr Cell kMin {std::numeric_limits<Cell>::min()};
+constexpr int kBits {FORTH_CELL_BITS};
+
+std::string cell(Cell value)
+{
+    return std::to_string(value);
+}
+
+// the two cells of a double cell, the low one first as on the stack
+std::vector<Cell> cells(DoubleCell value)
+{
+    auto u = static_cast<UDoubleCell>(value);
+    return {static_cast<Cell>(static_cast<UCell>(u)), static_cast<Cell>(static_cast<UCell>(u >> kBits))};
+}
+
+// a double cell in decimal, the 128 bits ones have no std::to_string
+std::string decimal(DoubleCell value)
+{
+    auto u = static_cast<UDoubleCell>(value);
+    if (value < 0)
+        u = UDoubleCell {0} - u;
+
+    std::string digits;
+    do {
+        digits.insert(digits.begin(), static_cast<char>('0' + static_cast<int>(u % 10)));
+        u /= 10;
+    } while (u != 0);
+    return (value < 0) ? "-" + digits : digits;
+}
+
+bool reports(std::string_view script, std::string_view message)
+{
+    return runScript(script).errors.find(message) != std::string::npos;
+}
+
+}
+
+
+// ----- tests
+
+// the cells are as wide as the build says, and their arithmetic wraps
+TEST(cellsWidth)
+{
+    CHECK(runScript("1 CELLS").stack == std::vector<Cell>({static_cast<Cell>(sizeof(Cell))}));
+    CHECK(runScript(cell(kMax) + " 1 +").stack == std::vector<Cell>({kMin}));
+    CHECK(runScript(cell(kMin) + " NEGATE").stack == std::vector<Cell>({kMin}));
+    CHECK(runScript(cell(kMax) + " 2 *").stack == std::vector<Cell>({-2}));
+    CHECK(runScript("-7 2 / -7 2 MOD 7 -2 / 7 -2 MOD").stack == std::vector<Cell>({-3, -1, -3, 1}));
+}
+
+// the products and the quotients through a double cell
+TEST(cellsDoubleArithmetic)
+{
+    CHECK(runScript("-1 -1 UM*").stack == cells(static_cast<DoubleCell>(UDoubleCell {static_cast<UCell>(-1)} *
+                                                                         static_cast<UCell>(-1))));
+    CHECK(runScript(cell(kMax) + " " + cell(kMax) + " M*").stack ==
+          cells(static_cast<DoubleCell>(kMax) * kMax));
+    CHECK(runScript(cell(kMin) + " -1 M*").stack == cells(-static_cast<DoubleCell>(kMin)));
+    CHECK(runScript("-3 7 M*").stack == cells(-21));
+
+    CHECK(runScript("0 1 2 UM/MOD").stack == std::vector<Cell>({0, kMin}));
+    CHECK(runScript("7 0 2 UM/MOD").stack == std::vector<Cell>({1, 3}));
+    CHECK(runScript(cell(kMax) + " 2 4 */").stack == std::vector<Cell>({kMax / 2}));
+    CHECK(runScript(cell(kMin) + " 3 6 */").stack == std::vector<Cell>({kMin / 2}));
+
+    CHECK(runScript("-5 S>D").stack == std::vector<Cell>({-5, -1}));
+    CHECK(runScript(cell(kMax) + " 0 1 0 D+").stack == std::vector<Cell>({kMin, 0}));
+    CHECK(runScript("-1 0 1 0 D+").stack == std::vector<Cell>({0, 1}));
+    CHECK(runScript("1 0 DNEGATE").stack == std::vector<Cell>({-1, -1}));
+
+    DoubleCell square = static_cast<DoubleCell>(kMax) * kMax;
+    CHECK_EQ(runScript(cell(kMax) + " " + cell(kMax) + " M* D.").output, decimal(square) + " ");
+    CHECK_EQ(runScript(cell(kMax) + " " + cell(kMax) + " M* DNEGATE D.").output, decimal(-square) + " ");
+}
+
+// a zero divisor or a quotient out of range is an error, not a trap
+TEST(cellsDivisionErrors)
+{
+    for (std::string_view script : {"7 0 /", "7 0 MOD", "1 0 0 UM/MOD", "1 2 0 */"})
+        CHECK(reports(script, "division by zero"));
+
+    std::string min = cell(kMin);
+    for (std::string script : {min + " -1 /", min + " -1 MOD", std::string {"0 1 1 UM/MOD"},
+                               cell(kMax) + " 4 2 */", min + " -1 1 */"})
+        CHECK(reports(script, "quotient overflow"));
+
+    // the operands stay on the stack
+    CHECK(runScript("7 0 /").stack == std::vector<Cell>({7, 0}));
+}
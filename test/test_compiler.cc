@@ -0,0 +1,99 @@
+/*
+ * @file    test_compiler.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the colon definitions and of their conditionals
+ */
+
+// ----- includes
+#include "test.h"
+
+// ----- helpers
+namespace {
+
+/* the stack left by a script, the same interpreted and native
+ * Args:
+ *  script : the source code
+ */
+std::vector<Cell> stackOf(const std::string& script)
+{
+    auto interpreted = runScript(script, 0);
+    auto native = runScript(script, 1);
+    CHECK_EQ(interpreted.errors, std::string {});
+    CHECK(interpreted.stack == native.stack);
+    return interpreted.stack;
+}
+
+/* the definition is refused, and the word is not defined
+ * Args:
+ *  definition : the definition of the word X
+ *  message    : the error reported
+ */
+bool refused(std::string_view definition, std::string_view message)
+{
+    auto result = runScript(std::string {definition} + " X");
+    return (result.errors.find(message) != std::string::npos) &&
+           (result.errors.find("Unknown word [X]") != std::string::npos);
+}
+
+}
+
+
+// ----- tests
+
+// the definitions are compiled once: their calls bind to the words defined
+// at the time, and the recursive calls to the word itself
+TEST(compilerColonDefinitions)
+{
+    CHECK(stackOf(": A 1 ; : B A 2 + ; : A 10 ; B A B") == std::vector<Cell>({3, 10, 3}));
+    CHECK(stackOf(": SQ DUP * ; : CUBE DUP SQ * ; : SUM 0 4 1 DO I CUBE + LOOP ; SUM SUM")
+          == std::vector<Cell>({36, 36}));
+    CHECK(stackOf(": FACT DUP 1 > IF DUP 1 - FACT * THEN ; 5 FACT 1 FACT") == std::vector<Cell>({120, 1}));
+    CHECK_EQ(runScript(": HI .\" hi\" ; HI HI").output, std::string {"hihi"});
+
+    // a definition using an unknown word is not defined
+    auto result = runScript(": BAD 1 NOPE ; BAD");
+    CHECK(result.errors.find("Unknown word [NOPE] in definition of [BAD]") != std::string::npos);
+    CHECK(result.errors.find("Unknown word [BAD]") != std::string::npos);
+    CHECK(result.stack.empty());
+
+    // a definition opened inside another one drops the first one
+    result = runScript(": A 1 : B 2 ; B A");
+    CHECK(result.errors.find("nested definition in definition of [A]") != std::string::npos);
+    CHECK(result.errors.find("Unknown word [A]") != std::string::npos);
+    CHECK(result.stack == std::vector<Cell>({2}));
+}
+
+// IF ... ELSE ... THEN runs one of its branches, IF ... THEN its branch or
+// nothing
+TEST(compilerIfElseThen)
+{
+    CHECK(stackOf(": S IF 1 ELSE 2 THEN ; 0 S -1 S 5 S") == std::vector<Cell>({2, 1, 1}));
+    CHECK(stackOf(": A DUP IF 10 + THEN ; 0 A 1 A") == std::vector<Cell>({0, 11}));
+    CHECK(stackOf(": E IF THEN IF ELSE THEN 3 ; 1 0 E") == std::vector<Cell>({3}));
+    CHECK(stackOf(": T 1 IF 2 ELSE 0 THEN 3 0 IF 4 ELSE 5 THEN 6 ; T") == std::vector<Cell>({2, 3, 5, 6}));
+}
+
+// the conditionals nest in both branches, and in the loops
+TEST(compilerNestedConditionals)
+{
+    std::string sign = ": SIGN DUP 0 < IF DROP -1 ELSE 0 = IF 0 ELSE 1 THEN THEN ; ";
+    CHECK(stackOf(sign + "-5 SIGN 0 SIGN 7 SIGN") == std::vector<Cell>({-1, 0, 1}));
+
+    std::string quadrant = ": Q 0 < IF 0 < IF 3 ELSE 2 THEN ELSE 0 < IF 4 ELSE 1 THEN THEN ; ";
+    CHECK(stackOf(quadrant + "1 1 Q -1 1 Q -1 -1 Q 1 -1 Q") == std::vector<Cell>({1, 4, 3, 2}));
+
+    CHECK(stackOf(": EVENS 0 10 0 DO I 2 MOD 0 = IF I + THEN LOOP ; EVENS EVENS") == std::vector<Cell>({20, 20}));
+}
+
+// the unbalanced conditionals are refused, the definition is abandoned
+TEST(compilerControlMismatch)
+{
+    CHECK(refused(": X THEN ;", "THEN without an IF"));
+    CHECK(refused(": X 1 ELSE 2 THEN ;", "ELSE without an IF"));
+    CHECK(refused(": X 1 IF 2 ELSE 3 ELSE 4 THEN ;", "ELSE without an IF"));
+    CHECK(refused(": X 1 IF 2 THEN THEN ;", "THEN without an IF"));
+    CHECK(refused(": X BEGIN THEN ;", "THEN without an IF"));
+    CHECK(refused(": X 1 IF 2 ;", "unterminated control structure"));
+    CHECK(refused(": X 1 IF BEGIN THEN AGAIN ;", "THEN without an IF"));
+}
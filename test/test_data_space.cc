@@ -0,0 +1,101 @@
+/*
+ * @file    test_data_space.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the data space words
+ */
+
+// ----- includes
+#include "test.h"
+#include "data_space.h"
+
+#include <limits>
+
+// ----- helpers
+namespace {
+
+bool reports(std::string_view script, std::string_view message)
+{
+    return runScript(script).errors.find(message) != std::string::npos;
+}
+
+constexpr auto kCell = static_cast<Cell>(sizeof(Cell));
+
+}
+
+
+// ----- tests
+
+// the variables, the constants and the cells laid down by , and CELLS
+TEST(dataSpaceCells)
+{
+    CHECK(runScript("VARIABLE V 5 V ! V @ 3 V +! V @").stack == std::vector<Cell>({5, 8}));
+    CHECK(runScript("VARIABLE V : N 10 0 DO I V +! LOOP ; N N V @").stack == std::vector<Cell>({90}));
+    CHECK(runScript("7 CONSTANT SEVEN : N SEVEN 1 + ; SEVEN N").stack == std::vector<Cell>({7, 8}));
+
+    CHECK(runScript("0 CELLS 3 CELLS -2 CELLS").stack == std::vector<Cell>({0, 3 * kCell, -2 * kCell}));
+    CHECK(runScript("HERE 7 , HERE OVER - SWAP @").stack == std::vector<Cell>({kCell, 7}));
+    CHECK(runScript("CREATE T 1 , 2 , 3 , T 2 CELLS + @ T @").stack == std::vector<Cell>({3, 1}));
+}
+
+// ALLOT moves HERE in both directions, within the data space only
+TEST(dataSpaceAllot)
+{
+    CHECK(runScript("HERE 16 ALLOT HERE SWAP -").stack == std::vector<Cell>({16}));
+    CHECK(runScript("HERE 16 ALLOT -16 ALLOT HERE -").stack == std::vector<Cell>({0}));
+
+    // past the end, or below the start, HERE stays where it was
+    std::string past = std::to_string(DataSpace::kDefaultCapacity);
+    auto result = runScript("HERE " + past + " ALLOT HERE -");
+    CHECK(result.errors.find("data space exhausted") != std::string::npos);
+    CHECK(result.stack == std::vector<Cell>({0}));
+    CHECK(reports("HERE NEGATE 1 - ALLOT", "data space exhausted"));
+    CHECK(runScript("HERE HERE NEGATE 1 - ALLOT HERE -").stack == std::vector<Cell>({0}));
+    CHECK(reports(": N " + past + " ALLOT ; N", "data space exhausted"));
+
+    std::string smallest = std::to_string(std::numeric_limits<Cell>::min());
+    result = runScript("HERE " + smallest + " ALLOT HERE -");
+    CHECK(result.errors.find("data space exhausted") != std::string::npos);
+    CHECK(result.stack == std::vector<Cell>({0}));
+}
+
+// CREATE ... DOES> gives the words created the code of their defining word,
+// called from the interpreter, from definitions and from native code
+TEST(dataSpaceCreateDoes)
+{
+    std::string words = ": CONST CREATE , DOES> @ ; "
+                        ": ARRAY CREATE CELLS ALLOT DOES> SWAP CELLS + ; ";
+
+    CHECK(runScript(words + "42 CONST X 7 CONST Y X Y").stack == std::vector<Cell>({42, 7}));
+    CHECK(runScript(words + "42 CONST X : N X 1 + ; N N").stack == std::vector<Cell>({43, 43}));
+    CHECK(runScript(words + "3 ARRAY A 5 0 A ! 6 2 A ! 0 A @ 2 A @").stack == std::vector<Cell>({5, 6}));
+
+    // the words created keep their own data, the native code included
+    std::string script = words + "4 ARRAY A 4 ARRAY B : FILL 4 0 DO I I A ! I I B ! LOOP ; "
+                                 ": SUM 0 4 0 DO I A @ I B @ * + LOOP ; "
+                                 "FILL 9 3 B ! SUM SUM";
+    auto interpreted = runScript(script, 0);
+    auto native = runScript(script, 1);
+    CHECK(interpreted.stack == std::vector<Cell>({32, 32}));
+    CHECK(interpreted.stack == native.stack);
+    CHECK_EQ(interpreted.errors, native.errors);
+
+    // a word created without DOES> pushes its address
+    CHECK(runScript(words + "CREATE Z HERE Z -").stack == std::vector<Cell>({0}));
+    CHECK(reports(": N DOES> 1 ; N", "DOES> without a CREATE"));
+}
+
+// the accesses out of the allotted space are refused, unless the build
+// is unchecked
+TEST(dataSpaceBounds)
+{
+#ifndef FORTH_UNCHECKED
+    std::string past = std::to_string(DataSpace::kDefaultCapacity);
+    CHECK(reports("-1 @", "invalid address"));
+    CHECK(reports("1 " + past + " !", "invalid address"));
+    CHECK(reports("1 HERE 1000 + +!", "invalid address"));
+    CHECK(reports(": N " + past + " @ ; N", "invalid address"));
+    CHECK(reports("VARIABLE V : N 1 V 1 + ! ; N", "invalid address"));
+    CHECK(runScript("VARIABLE V 3 V ! : N -1 @ ; N DROP V @").stack == std::vector<Cell>({3}));
+#endif
+}
@@ -0,0 +1,117 @@
+/*
+ * @file    test_floats.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the floating point stack and words
+ */
+
+// ----- includes
+#include "test.h"
+
+#include <limits>
+
+// ----- helpers
+namespace {
+
+std::string output(std::string_view script)
+{
+    return runScript(script).output;
+}
+
+bool reports(std::string_view script, std::string_view message)
+{
+    return runScript(script).errors.find(message) != std::string::npos;
+}
+
+}
+
+
+// ----- tests
+
+// the float literals and the arithmetic words, on their own stack
+TEST(floatsArithmetic)
+{
+    CHECK_EQ(output("1.5 2.25 F+ F."), std::string {"3.75 "});
+    CHECK_EQ(output("1.5 2.25 F- F."), std::string {"-0.75 "});
+    CHECK_EQ(output("1.5 -4.0 F* F."), std::string {"-6 "});
+    CHECK_EQ(output("1.0 4.0 F/ F."), std::string {"0.25 "});
+    CHECK_EQ(output("2.0 3.0 1.0 F*+ F."), std::string {"7 "});
+    CHECK_EQ(output("2.0 FSQRT FDUP F* F."), std::string {"2.0000000000000004 "});
+    CHECK_EQ(output("-2.5 FLOOR F. 2.5 FLOOR F."), std::string {"-3 2 "});
+    CHECK_EQ(output("1E3 2.5e-1 F. F."), std::string {"0.25 1000 "});
+
+    // the standard literals with an empty exponent, and the decimal point
+    // alone as a shortcut
+    CHECK_EQ(output("1e F. 1.5e F. -2.5E F. 1.5 F."), std::string {"1 1.5 -2.5 1.5 "});
+    CHECK_EQ(output(": H 1.5e 2e F* ; H F."), std::string {"3 "});
+    CHECK(runScript("e").errors.find("Unknown word [e]") != std::string::npos);
+    CHECK(runScript(".e").errors.find("Unknown word [.e]") != std::string::npos);
+    CHECK(runScript("1ee").errors.find("Unknown word [1ee]") != std::string::npos);
+    CHECK_EQ(output("1.0 2.0 FSWAP F. F. 3.0 4.0 FDROP F."), std::string {"1 2 3 "});
+
+    // the data stack is not involved
+    auto result = runScript("5 1.5 2.5 F+ 6");
+    CHECK(result.stack == std::vector<Cell>({5, 6}));
+}
+
+// the conversions between the cells and the floats
+TEST(floatsConversions)
+{
+    CHECK_EQ(output("7 S>F F. -3 S>F F."), std::string {"7 -3 "});
+    CHECK(runScript("2.9 F>S -2.9 F>S").stack == std::vector<Cell>({2, -2}));
+    CHECK(runScript("1E30 F>S -1E30 F>S").stack ==
+          std::vector<Cell>({std::numeric_limits<Cell>::max(), std::numeric_limits<Cell>::min()}));
+    CHECK(runScript("0.0 0.0 F/ F>S").stack == std::vector<Cell>({0}));
+}
+
+// the floats in the data space, one by one and as arrays
+TEST(floatsDataSpace)
+{
+    CHECK_EQ(output("1 FLOATS ."), std::string {"8 "});
+    CHECK_EQ(output("CREATE A 2 FLOATS ALLOT 1.5 A F! -2.0 A 1 FLOATS + F! A F@ A 8 + F@ F* F."),
+             std::string {"-3 "});
+
+    std::string arrays = "CREATE A 5 FLOATS ALLOT CREATE B 5 FLOATS ALLOT CREATE C 5 FLOATS ALLOT "
+                         ": FILL 5 0 DO I S>F DUP I FLOATS + F! LOOP DROP ; A FILL B FILL ";
+    CHECK_EQ(output(arrays + "A B C 5 FV* C 5 FVSUM F. A 5 FVSUM F."), std::string {"30 10 "});
+    CHECK_EQ(output(arrays + "A 0 FVSUM F."), std::string {"0 "});
+}
+
+// the float words report an empty stack or an address out of the data space
+TEST(floatsErrors)
+{
+    CHECK(reports("F.", "not enough floats"));
+    CHECK(reports("1.0 F+", "not enough floats"));
+    CHECK(reports("1.0 2.0 F*+", "not enough floats"));
+
+    // the unchecked builds leave the addresses to the programs
+#ifndef FORTH_UNCHECKED
+    CHECK(reports("-8 F@", "invalid address"));
+    CHECK(reports("1.0 -8 F!", "invalid address"));
+    CHECK(reports("HERE HERE HERE 1000000000 FV*", "invalid address"));
+#endif
+}
+
+// the words using floats give the same results once the others are native
+TEST(floatsInDefinitions)
+{
+    std::string script = ": AREA S>F FDUP F* 3.14159 F* F>S ; : SUM 0 5 0 DO I AREA + LOOP ; SUM SUM SUM";
+    auto interpreted = runScript(script, 0);
+    auto native = runScript(script, 1);
+    CHECK(interpreted.stack == std::vector<Cell>({93, 93, 93}));
+    CHECK(interpreted.stack == native.stack);
+    CHECK_EQ(interpreted.errors, native.errors);
+}
+
+// the float literals of a definition stay in the code space, the data
+// laid out around the definition is not moved
+TEST(floatsLiteralsInCodeSpace)
+{
+    auto result = runScript("HERE CREATE T 1 , : F 2.5 1.25 F+ ; 2 , HERE SWAP - T 1 CELLS + @ F F>S");
+    CHECK(result.stack == std::vector<Cell>({static_cast<Cell>(2 * sizeof(Cell)), 2, 3}));
+    CHECK(result.errors.empty());
+
+    // the inlined copies and SEE keep the double
+    CHECK_EQ(output(": F 2.5 ; : G F F 1.0 F+ F+ ; G F."), std::string {"6 "});
+    CHECK(runScript(": F 2.5 ; SEE F").output.find("FLiteral 2.5") != std::string::npos);
+}
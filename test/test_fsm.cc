@@ -0,0 +1,200 @@
+/*
+ * @file    test_fsm.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the finite state machine
+ */
+
+// ----- includes
+#include "test.h"
+#include "fsm.h"
+
+#include <vector>
+
+// ----- helpers
+namespace {
+
+// a door: closed (begin) <-> opened, closed -> locked -> closed, and broken (end) from anywhere
+struct Door
+{
+    FSM::UserQueue_T queue {};
+    FSM::Engine engine {queue};
+    int closed {engine.add(FSM::State {"closed", FSM::StateType::BEGIN_STATE, "", ""})};
+    int opened {engine.add(FSM::State {"opened", FSM::StateType::NORMAL_STATE, "enter opened", "exit opened"})};
+    int locked {engine.add(FSM::State {"locked", FSM::StateType::NORMAL_STATE, "", ""})};
+    int broken {engine.add(FSM::State {"broken", FSM::StateType::END_STATE, "enter broken", ""})};
+    int open {engine.add(FSM::Event {"open"})};
+    int close {engine.add(FSM::Event {"close"})};
+    int lock {engine.add(FSM::Event {"lock"})};
+    int unlock {engine.add(FSM::Event {"unlock"})};
+    int kick {engine.add(FSM::Event {"kick"})};
+
+    Door()
+    {
+        engine.add(FSM::Transition {closed, open, opened});
+        engine.add(FSM::Transition {opened, close, closed});
+        engine.add(FSM::Transition {closed, lock, locked});
+        engine.add(FSM::Transition {locked, unlock, closed});
+        for (int s : {closed, opened, locked})
+            engine.add(FSM::Transition {s, kick, broken});
+    }
+
+    // the messages of the actions, emptying the queue
+    std::vector<std::string> messages()
+    {
+        std::vector<std::string> result;
+        for (; !queue.empty(); queue.pop())
+            result.push_back(queue.front());
+        return result;
+    }
+};
+
+}
+
+
+// ----- tests
+
+// the counts, the indexes and the lookups by name
+TEST(fsmTables)
+{
+    Door door;
+    CHECK_EQ(door.engine.states(), 4);
+    CHECK_EQ(door.engine.events(), 5);
+    CHECK_EQ(door.engine.transitions(), 7);
+    CHECK_EQ(door.engine.stateIndex("locked"), door.locked);
+    CHECK_EQ(door.engine.stateIndex("ajar"), -1);
+    CHECK_EQ(door.engine.eventIndex("unlock"), door.unlock);
+    CHECK_EQ(door.engine.eventIndex("slam"), -1);
+    CHECK(door.engine.state("opened").has_value());
+    CHECK(!door.engine.event("slam").has_value());
+
+    // the same lookups once the FSM is frozen, through the perfect hash
+    CHECK(door.engine.finalize());
+    std::vector<std::string> names {"open", "close", "lock", "unlock", "kick"};
+    for (int i = 0; i < static_cast<int>(names.size()); ++i)
+        CHECK_EQ(door.engine.eventIndex(names[static_cast<std::size_t>(i)]), i);
+    CHECK_EQ(door.engine.eventIndex("slam"), -1);
+    CHECK_EQ(door.engine.eventIndex(""), -1);
+}
+
+// the transitions, with the actions of the states
+TEST(fsmTransitions)
+{
+    Door door;
+    CHECK(door.engine.start());
+    CHECK_EQ(door.engine.state(), std::string_view {"closed"});
+    CHECK(!door.engine.hasEnded());
+
+    CHECK(door.engine.update(door.open));
+    CHECK_EQ(door.engine.state(), std::string_view {"opened"});
+    CHECK(!door.engine.update(door.lock));
+    CHECK_EQ(door.engine.state(), std::string_view {"opened"});
+    CHECK(door.engine.update("close"));
+    CHECK(door.engine.update("lock"));
+    CHECK(!door.engine.update("slam"));
+    CHECK(!door.engine.update(-1));
+    CHECK(!door.engine.update(door.kick + 1));
+    CHECK_EQ(door.engine.state(), std::string_view {"locked"});
+    CHECK(door.messages() == std::vector<std::string>({"enter opened", "exit opened"}));
+
+    CHECK(door.engine.update(door.kick));
+    CHECK(door.engine.hasEnded());
+    CHECK(door.messages() == std::vector<std::string>({"enter broken"}));
+    CHECK(!door.engine.update(door.unlock));
+    CHECK(!door.engine.update("unlock"));
+}
+
+// a batch of events stops at the first one refused, or at the end state
+TEST(fsmRun)
+{
+    Door door;
+    CHECK(door.engine.start());
+    std::vector<int> events {door.lock, door.unlock, door.open, door.close, door.open, door.lock, door.close};
+    CHECK_EQ(door.engine.run(events), std::size_t {5});
+    CHECK_EQ(door.engine.state(), std::string_view {"opened"});
+    CHECK(door.messages() == std::vector<std::string>({"enter opened", "exit opened", "enter opened"}));
+
+    std::vector<int> ending {door.close, door.kick, door.open};
+    CHECK_EQ(door.engine.run(ending), std::size_t {2});
+    CHECK(door.engine.hasEnded());
+    CHECK_EQ(door.engine.state(), std::string_view {"broken"});
+    CHECK_EQ(door.engine.run(ending), std::size_t {0});
+
+    // a state added after the start thaws the FSM, the next update freezes it again
+    Door grown;
+    CHECK(grown.engine.start());
+    int jammed = grown.engine.add(FSM::State {"jammed", FSM::StateType::NORMAL_STATE, "", ""});
+    grown.engine.add(FSM::Transition {grown.closed, grown.lock, jammed});
+    CHECK(grown.engine.update(grown.lock));
+    CHECK_EQ(grown.engine.state(), std::string_view {"jammed"});
+}
+
+// can() before the start, toward negative states, and before and after the freeze
+TEST(fsmCan)
+{
+    Door door;
+    CHECK(!door.engine.can(door.opened));
+    CHECK(door.engine.cannot(door.opened));
+    CHECK(!door.engine.update(door.open));
+    std::vector<int> events {door.open};
+    CHECK_EQ(door.engine.run(events), std::size_t {0});
+
+    CHECK(door.engine.start());
+    for (bool frozen : {true, false}) {
+        if (!frozen)
+            door.engine.add(FSM::Event {"wave"});
+
+        CHECK(door.engine.can(door.opened));
+        CHECK(door.engine.can(door.locked));
+        CHECK(door.engine.can(door.broken));
+        CHECK(!door.engine.can(door.closed));
+        CHECK(!door.engine.can(-1));
+        CHECK(!door.engine.can(100));
+    }
+
+    // stop() moves to the end state, and start() back to the begin state
+    CHECK(door.engine.stop());
+    CHECK(door.engine.hasEnded());
+    CHECK(!door.engine.update(door.open));
+    CHECK(door.engine.start());
+    CHECK(door.engine.update(door.open));
+}
+
+// the FSM too large or too sparse for the matrix runs on the transition maps
+TEST(fsmSparse)
+{
+    for (int states : {3000, 40000}) {
+        FSM::UserQueue_T queue;
+        FSM::Engine engine {queue};
+        engine.add(FSM::State {"s0", FSM::StateType::BEGIN_STATE, "", ""});
+        for (int i = 1; i < states; ++i)
+            engine.add(FSM::State {"s" + std::to_string(i), FSM::StateType::NORMAL_STATE, "", ""});
+        int end = engine.add(FSM::State {"end", FSM::StateType::END_STATE, "enter end", ""});
+        for (int i = 0; i < 3000; ++i)
+            engine.add(FSM::Event {"e" + std::to_string(i)});
+        for (int i = 0; i + 1 < states; ++i)
+            engine.add(FSM::Transition {i, i % 3000, i + 1});
+
+        CHECK(!engine.finalize());
+        CHECK(engine.start());
+        CHECK(engine.can(1));
+        CHECK(!engine.can(2));
+        CHECK(!engine.update(1));
+        CHECK(!engine.update(-1));
+        CHECK(!engine.update(3000));
+        CHECK(engine.update(0));
+        CHECK(engine.update("e1"));
+        CHECK_EQ(engine.state(), std::string_view {"s2"});
+
+        std::vector<int> events {2, 3, 4, 4};
+        CHECK_EQ(engine.run(events), std::size_t {3});
+        CHECK_EQ(engine.state(), std::string_view {"s5"});
+
+        // an event added after the start thaws the FSM, it stays on the maps
+        int jump = engine.add(FSM::Event {"jump"});
+        engine.add(FSM::Transition {5, jump, end});
+        CHECK(engine.update(jump));
+        CHECK(engine.hasEnded());
+        CHECK(queue.size() == 1);
+    }
+}
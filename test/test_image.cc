@@ -0,0 +1,238 @@
+/*
+ * @file    test_image.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the dictionary images
+ */
+
+// ----- includes
+#include "test.h"
+#include "forth_vm.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <string_view>
+
+// ----- helpers
+namespace {
+
+// words of every kind, with their data
+constexpr std::string_view kDefinitions {
+    "VARIABLE COUNTER 41 COUNTER ! "
+    "100 CONSTANT HUNDRED "
+    ": ARRAY CREATE CELLS ALLOT DOES> SWAP CELLS + ; "
+    "3 ARRAY TABLE 7 1 TABLE ! "
+    ": SQ DUP * ; "
+    ": SUM 0 SWAP 0 DO I SQ + LOOP ; "
+    ": GREET .\" hello\" ; "
+    ": BUMP 1 COUNTER +! COUNTER @ ; "
+};
+
+constexpr std::string_view kUses {"BUMP HUNDRED 1 TABLE @ 4 SUM GREET"};
+
+// path of a scratch image
+std::string imagePath(std::string_view name)
+{
+    return (std::filesystem::temp_directory_path() / ("slforth_test_" + std::string {name} + ".img")).string();
+}
+
+/* run a script in a virtual machine, and collect its results
+ * Args:
+ *  forth  : the virtual machine
+ *  script : the source code
+ */
+ScriptResult runIn(ForthVM& forth, std::string_view script)
+{
+    std::ostringstream out;
+    std::ostringstream err;
+    forth.setOutput(out, err);
+    forth.run(script);
+    return {out.str(), err.str(), forth.stack()};
+}
+
+std::vector<char> readFile(const std::string& path)
+{
+    std::ifstream file {path, std::ios::binary};
+    return {std::istreambuf_iterator<char> {file}, std::istreambuf_iterator<char> {}};
+}
+
+void writeFile(const std::string& path, const std::vector<char>& bytes)
+{
+    std::ofstream file {path, std::ios::binary | std::ios::trunc};
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+}
+
+
+// ----- tests
+
+// the words, their data and the created words are the same once loaded
+TEST(imageRoundTrip)
+{
+    std::string path = imagePath("round_trip");
+
+    ForthVM saved;
+    runIn(saved, kDefinitions);
+    CHECK(saved.saveImage(path));
+    ScriptResult expected = runIn(saved, kUses);
+
+    ForthVM loaded;
+    CHECK(loaded.loadImage(path));
+    ScriptResult actual = runIn(loaded, kUses);
+
+    CHECK_EQ(actual.output, expected.output);
+    CHECK_EQ(actual.errors, std::string {});
+    CHECK(actual.stack == expected.stack);
+    CHECK(actual.stack == std::vector<Cell>({42, 100, 7, 14}));
+
+    // the words of the image are still extended after the load
+    CHECK(runIn(loaded, ": MORE SUM 1 + ; 3 MORE").stack.back() == 6);
+
+    std::filesystem::remove(path);
+}
+
+// the endless loops end in a branch, like the words created with DOES>,
+// they are still loaded
+TEST(imageRoundTripEndlessLoops)
+{
+    std::string path = imagePath("endless_loops");
+
+    ForthVM saved;
+    CHECK_EQ(runIn(saved, ": IDLE BEGIN AGAIN ; : SPIN 0 BEGIN AGAIN ; ").errors, std::string {});
+    CHECK(saved.saveImage(path));
+
+    ForthVM loaded;
+    std::ostringstream out;
+    std::ostringstream err;
+    loaded.setOutput(out, err);
+    CHECK(loaded.loadImage(path));
+    CHECK_EQ(err.str(), std::string {});
+    CHECK_EQ(runIn(loaded, "SEE IDLE SEE SPIN").errors, std::string {});
+
+    std::filesystem::remove(path);
+}
+
+// the files that are not images, or are damaged, are refused
+TEST(imageRejectsDamagedFiles)
+{
+    std::string path = imagePath("damaged");
+    ForthVM saved;
+    runIn(saved, kDefinitions);
+    CHECK(saved.saveImage(path));
+    std::vector<char> bytes = readFile(path);
+
+    ForthVM forth;
+    std::ostringstream out;
+    std::ostringstream err;
+    forth.setOutput(out, err);
+
+    CHECK(!forth.loadImage(imagePath("missing")));
+
+    std::vector<char> broken = bytes;
+    broken[0] ^= 1;
+    writeFile(path, broken);
+    CHECK(!forth.loadImage(path));
+
+    for (std::size_t size : {std::size_t {8}, bytes.size() / 2, bytes.size() - 1}) {
+        writeFile(path, std::vector<char>(bytes.begin(), bytes.begin() + static_cast<std::ptrdiff_t>(size)));
+        CHECK(!forth.loadImage(path));
+    }
+
+    // a refused image leaves the virtual machine as it was
+    CHECK(runIn(forth, "2 3 +").stack == std::vector<Cell>({5}));
+
+    std::filesystem::remove(path);
+}
+
+// every single byte change is either refused or gives a valid image
+TEST(imageVerifiesCode)
+{
+    std::string path = imagePath("flipped");
+    ForthVM saved;
+    runIn(saved, kDefinitions);
+    CHECK(saved.saveImage(path));
+    std::vector<char> bytes = readFile(path);
+
+    for (std::size_t i = 0; i < bytes.size(); ++i) {
+        std::vector<char> flipped = bytes;
+        flipped[i] = static_cast<char>(flipped[i] ^ 0x5A);
+        writeFile(path, flipped);
+
+        ForthVM forth;
+        std::ostringstream out;
+        std::ostringstream err;
+        forth.setOutput(out, err);
+        if (forth.loadImage(path))
+            runIn(forth, "SEE SQ SEE SUM SEE BUMP SEE GREET SEE ARRAY SEE TABLE");
+    }
+
+    std::filesystem::remove(path);
+}
+
+// a word returning from inside a loop is refused, it would return to the
+// loop parameters
+TEST(imageRejectsExitInLoop)
+{
+    std::string path = imagePath("exit_in_loop");
+    ForthVM saved;
+    runIn(saved, ": W 1 0 DO UNLOOP EXIT LOOP ; ");
+    CHECK(saved.saveImage(path));
+    std::vector<char> bytes = readFile(path);
+
+    ForthVM forth;
+    std::ostringstream out;
+    std::ostringstream err;
+    forth.setOutput(out, err);
+    CHECK(forth.loadImage(path));
+
+    // the UNLOOP before the EXIT turned into an EXIT
+    Cell sequence[3] = {static_cast<Cell>(Opcode::Do), static_cast<Cell>(Opcode::Unloop),
+                        static_cast<Cell>(Opcode::Exit)};
+    std::string_view pattern {reinterpret_cast<const char*>(sequence), sizeof(sequence)};
+    Cell exit = static_cast<Cell>(Opcode::Exit);
+    std::size_t patched {0};
+    for (auto found = std::string_view {bytes.data(), bytes.size()}.find(pattern); found != std::string_view::npos;
+         found = std::string_view {bytes.data(), bytes.size()}.find(pattern, found + 1)) {
+        std::memcpy(bytes.data() + found + sizeof(Cell), &exit, sizeof(Cell));
+        ++patched;
+    }
+    CHECK(patched > 0);
+    writeFile(path, bytes);
+    CHECK(!forth.loadImage(path));
+
+    std::filesystem::remove(path);
+}
+
+// a guard deeper than any stack is refused, the depths of the verifier
+// would overflow
+TEST(imageRejectsHugeGuard)
+{
+    std::string path = imagePath("huge_guard");
+    ForthVM saved;
+    runIn(saved, ": W DUP * 1 + ; ");
+    CHECK(saved.saveImage(path));
+    std::vector<char> bytes = readFile(path);
+
+    Cell sequence[2] = {static_cast<Cell>(Opcode::Guard), 1};
+    std::string_view pattern {reinterpret_cast<const char*>(sequence), sizeof(sequence)};
+    auto found = std::string_view {bytes.data(), bytes.size()}.find(pattern);
+    CHECK(found != std::string_view::npos);
+    if (found == std::string_view::npos)
+        return;
+
+    ForthVM forth;
+    std::ostringstream out;
+    std::ostringstream err;
+    forth.setOutput(out, err);
+    for (Cell depth : {Cell {2}, Cell {1 << 16}, Cell {(1 << 16) + 1}, std::numeric_limits<Cell>::max(), Cell {-1}}) {
+        std::memcpy(bytes.data() + found + sizeof(Cell), &depth, sizeof(Cell));
+        writeFile(path, bytes);
+        CHECK_EQ(forth.loadImage(path), (depth >= 2) && (depth <= (1 << 16)));
+    }
+
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,68 @@
+/*
+ * @file    test_inliner.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the inlining of the small words
+ */
+
+// ----- includes
+#include "test.h"
+
+// ----- helpers
+namespace {
+
+bool contains(const std::string& text, std::string_view part)
+{
+    return text.find(part) != std::string::npos;
+}
+
+// the optimized code of a word, as listed by SEE
+std::string optimized(std::string_view script)
+{
+    std::string output = runScript(script).output;
+    auto position = output.find("optimized:");
+    return (position == std::string::npos) ? std::string {} : output.substr(position);
+}
+
+}
+
+
+// ----- tests
+
+// the small words are copied in their callers, branches included
+TEST(inlinerCopiesSmallWords)
+{
+    std::string see = runScript(": SQ DUP * ; : F SQ 1 + ; SEE F").output;
+    CHECK(contains(see, "inlined: SQ"));
+    CHECK(!contains(optimized(": SQ DUP * ; : F SQ 1 + ; SEE F"), "Call"));
+    CHECK(runScript(": SQ DUP * ; : F SQ 1 + ; 3 F").stack == std::vector<Cell>({10}));
+
+    std::string script = ": ABS2 DUP 0 < IF NEGATE THEN ; : G ABS2 1 + ; ";
+    CHECK(!contains(optimized(script + "SEE G"), "Call"));
+    CHECK(runScript(script + "-5 G 5 G 0 G").stack == std::vector<Cell>({6, 6, 1}));
+}
+
+// a copy keeps the definition current when the caller was compiled
+TEST(inlinerKeepsCompileTimeDefinition)
+{
+    auto result = runScript(": SQ DUP * ; : F SQ ; : SQ DUP + ; 3 F 3 SQ");
+    CHECK(result.stack == std::vector<Cell>({9, 6}));
+}
+
+// the recursive words, the loops and the return stack stay calls
+TEST(inlinerLeavesOtherWords)
+{
+    CHECK(contains(optimized(": R DUP 0 > IF 1 - R THEN ; : G R ; SEE G"), "Call R"));
+    CHECK(contains(optimized(": L 3 0 DO LOOP ; : G L ; SEE G"), "Call L"));
+    CHECK(contains(optimized(": T >R R> ; : G T ; SEE G"), "Call T"));
+
+    CHECK(runScript(": R DUP 0 > IF 1 - R THEN ; : G R ; 5 G").stack == std::vector<Cell>({0}));
+}
+
+// the copies lose the guard of the word, the caller checks the depth
+TEST(inlinerKeepsStackChecks)
+{
+    CHECK(contains(runScript(": A 0 + ; : B A ; B").errors, "not enough values"));
+    CHECK(contains(runScript(": SQ DUP * ; : F SQ ; F").errors, "not enough values"));
+    CHECK(runScript(": SQ DUP * ; : F SQ ; 4 F").stack == std::vector<Cell>({16}));
+}
@@ -0,0 +1,37 @@
+/*
+ * @file    test_interpreter.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the inner interpreter dispatch
+ */
+
+// ----- includes
+#include "test.h"
+
+// ----- tests
+
+// the words give the same results dispatched from the outer interpreter
+// and from the threaded code of a definition
+TEST(interpreterDispatch)
+{
+    for (std::string_view words : {"7 3 + 7 3 - 7 3 * 7 3 / 7 3 MOD 7 NEGATE",
+                                   "1 2 DUP DROP SWAP OVER ROT",
+                                   "3 4 > 3 4 < 3 3 = 3 4 <> 0 0= -1 0< 1 0> 0 0<>",
+                                   "12 10 AND 12 10 OR 12 10 XOR 0 NOT",
+                                   "5 S>D 7 S>D D+ -3 S>D DNEGATE 6 7 3 */",
+                                   "HERE 3 , DUP @ 2 ROT +! HERE 1 CELLS - @"}) {
+        auto outer = runScript(words);
+        auto threaded = runScript(": W " + std::string {words} + " ; W");
+        CHECK_EQ(outer.errors, std::string {});
+        CHECK(!outer.stack.empty());
+        CHECK(outer.stack == threaded.stack);
+    }
+}
+
+// the calls return to their caller, from any depth
+TEST(interpreterCallsReturn)
+{
+    CHECK(runScript(": A 1 ; : B A 2 ; : C B A 3 ; C A").stack == std::vector<Cell>({1, 2, 1, 3, 1}));
+    CHECK(runScript(": DOWN DUP IF 1 - DOWN THEN ; 5000 DOWN").stack == std::vector<Cell>({0}));
+    CHECK(runScript(": E 1 EXIT 2 ; : F E 3 ; F").stack == std::vector<Cell>({1, 3}));
+}
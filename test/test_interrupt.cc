@@ -0,0 +1,44 @@
+/*
+ * @file    test_interrupt.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the interruption of a running VM
+ */
+
+// ----- includes
+#include "test.h"
+#include "forth_vm.h"
+
+#include <chrono>
+#include <thread>
+
+// ----- tests
+
+// an endless word stops on an interrupt from another thread, interpreted or native,
+// and the VM runs again once the interrupt is cleared
+TEST(interruptEndlessLoop)
+{
+    for (std::size_t threshold : {0, 1}) {
+        ForthVM forth;
+        forth.setJitThreshold(threshold);
+        std::ostringstream out;
+        std::ostringstream err;
+        forth.setOutput(out, err);
+        forth.run(": W BEGIN DUP UNTIL DROP ; 1 W 1 W");
+        CHECK_EQ(err.str(), std::string {});
+        forth.run("SEE W FLUSH");
+        CHECK_EQ(out.str().find(" native") != std::string::npos, threshold != 0);
+
+        std::thread watchdog {[&forth] {
+            std::this_thread::sleep_for(std::chrono::milliseconds {50});
+            forth.interrupt();
+        }};
+        forth.run("0 W");
+        watchdog.join();
+        CHECK(err.str().find("interrupted") != std::string::npos);
+
+        forth.clearInterrupt();
+        forth.run("1 2 +");
+        CHECK(!forth.stack().empty() && (forth.stack().back() == 3));
+    }
+}
@@ -0,0 +1,170 @@
+/*
+ * @file    test_jit.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Differential tests of the native code generator
+ */
+
+// ----- includes
+#include "test.h"
+#include "jit.h"
+
+#include <limits>
+#include <random>
+
+// ----- helpers
+namespace {
+
+// a program, its words are called again once they are native, from the
+// outer interpreter and from a definition
+struct Program {
+    const char* name;
+    std::string definitions;
+    std::string calls;
+};
+
+std::string cell(Cell value)
+{
+    return std::to_string(value);
+}
+
+/* the programs of the differential tests, with the extreme values of the
+ * cell width of the build
+ */
+std::vector<Program> programs()
+{
+    std::string max = cell(std::numeric_limits<Cell>::max());
+    std::string min = cell(std::numeric_limits<Cell>::min());
+
+    return {
+        {"arithmetic", ": W 3 * 7 + 2 - NEGATE ;", "5 W -9 W " + max + " W"},
+        {"wrap", ": W 1 + ;", max + " W " + min + " W"},
+        {"large", ": W " + max + " + " + min + " XOR ;", "1 W -1 W"},
+        {"division", ": W 7 / ; : M 7 MOD ;", "100 W -100 W 100 M -100 M"},
+        {"division-zero", ": W / ;", "1 2 7 0 W"},
+        {"division-overflow", ": W / ;", "1 2 " + min + " -1 W"},
+        {"modulo-overflow", ": W MOD ;", "1 2 " + min + " -1 W"},
+        {"compare", ": W OVER OVER > ROT ROT < ;", "1 2 W 2 1 W 3 3 W " + min + " " + max + " W"},
+        {"zero", ": W DUP 0= OVER 0< ROT 0> ;", "0 W -4 W 4 W"},
+        {"bits", ": W OVER OVER AND ROT ROT OR XOR NOT ;", "12 10 W -1 5 W"},
+        {"stack", ": W ROT SWAP OVER DROP DUP ;", "1 2 3 W"},
+        {"if", ": W DUP 0< IF NEGATE ELSE 1 + THEN ;", "-5 W 5 W 0 W"},
+        {"until", ": W 0 SWAP BEGIN SWAP 1 + SWAP 2 / DUP 0= UNTIL DROP ;", "1000 W 1 W " + max + " W"},
+        {"while", ": W 0 BEGIN OVER 0> WHILE 1 + SWAP 3 - SWAP REPEAT SWAP DROP ;", "10 W 0 W -3 W"},
+        {"loop", ": W 0 SWAP 0 DO I + LOOP ;", "10 W 1 W"},
+        {"qdo", ": W 0 SWAP 0 ?DO I + LOOP ;", "0 W 5 W"},
+        {"nested", ": W 0 4 0 DO 3 0 DO I J * + LOOP LOOP ;", "W"},
+        {"plusloop", ": W 0 SWAP 0 DO 1 + 3 +LOOP ;", "10 W 9 W 1 W"},
+        {"plusloop-down", ": W 0 -10 0 DO 1 + -3 +LOOP ;", "W"},
+        {"plusloop-edge", ": W 0 " + min + " " + max + " DO 1 + " + max + " +LOOP ;", "W"},
+        {"leave", ": W 0 100 0 DO I 5 = IF LEAVE THEN 1 + LOOP ;", "W"},
+        {"superinstructions", ": W DUP * 255 AND 0 5 0 DO I + LOOP + 3 + ;", "7 W -7 W " + max + " W"},
+        {"underflow", ": W + ;", "1 W 1 W"},
+    };
+}
+
+// the result of a program, in the interpreter or with the native code
+ScriptResult run(const Program& program, std::size_t threshold)
+{
+    std::string script = program.definitions + " " + program.calls + " " + program.calls + " : X " + program.calls +
+                         " ; X X";
+    return runScript(script, threshold);
+}
+
+// the cells of a stack, bottom first
+std::string stackOf(const ScriptResult& result)
+{
+    std::string cells;
+    for (Cell value : result.stack)
+        cells += "<" + cell(value) + ">";
+    return cells;
+}
+
+/* check a program gives the same results in the interpreter and with the
+ * native code
+ */
+void compare(const Program& program)
+{
+    ScriptResult interpreted = run(program, 0);
+    ScriptResult native = run(program, 1);
+
+    if ((interpreted.output != native.output) || (interpreted.errors != native.errors) ||
+        (interpreted.stack != native.stack)) {
+        std::ostringstream message;
+        message << program.name << " " << program.definitions << ": [" << interpreted.output
+                << interpreted.errors << stackOf(interpreted) << "] != [" << native.output << native.errors
+                << stackOf(native) << "]";
+        reportFailure(__FILE__, __LINE__, message.str());
+    }
+}
+
+// a random straight line word, with the depth kept between 1 and 6
+std::string randomWord(std::mt19937_64& random)
+{
+    static const char* kBinary[] = {"+", "-", "*", "/", "MOD", "AND", "OR", "XOR", ">", "<", "=", "<>"};
+    static const char* kUnary[] = {"NEGATE", "NOT", "0=", "0<", "0>", "0<>"};
+    static const char* kShuffle[] = {"DUP", "OVER", "SWAP", "ROT", "DROP"};
+    std::string literals[] = {"0", "1", "-1", "7", "-3", "255",
+                              cell(std::numeric_limits<Cell>::max()), cell(std::numeric_limits<Cell>::min())};
+
+    std::string word = ": W";
+    int depth {2};
+    for (int k = 0; k < 24; ++k) {
+        int choice = static_cast<int>(random() % 4);
+        if ((choice == 0) && (depth < 6)) {
+            word += " " + literals[random() % std::size(literals)];
+            ++depth;
+        } else if ((choice == 1) && (depth >= 2)) {
+            word += std::string {" "} + kBinary[random() % std::size(kBinary)];
+            --depth;
+        } else if (choice == 2) {
+            word += std::string {" "} + kUnary[random() % std::size(kUnary)];
+        } else if (depth >= 3) {
+            const char* shuffle = kShuffle[random() % std::size(kShuffle)];
+            word += std::string {" "} + shuffle;
+            depth += (std::string_view {shuffle} == "DUP" || std::string_view {shuffle} == "OVER") ? 1 :
+                     (std::string_view {shuffle} == "DROP") ? -1 : 0;
+        }
+    }
+    return word + " ;";
+}
+
+}
+
+
+// ----- tests
+
+// the control flow, the loops and the extreme values of the cell width
+TEST(jitMatchesInterpreter)
+{
+    for (const Program& program : programs())
+        compare(program);
+}
+
+// the words of the differential tests are native ones
+TEST(jitCompilesHotWords)
+{
+    if (!Jit::isSupported())
+        return;
+
+    for (std::string_view name : {"arithmetic", "division", "if", "until", "nested", "plusloop", "leave"}) {
+        for (const Program& program : programs()) {
+            if (program.name != name)
+                continue;
+            std::string output = runScript(program.definitions + " " + program.calls + " " + program.calls +
+                                           " SEE W", 1).output;
+            if (output.find(" native") == std::string::npos)
+                reportFailure(__FILE__, __LINE__, std::string {name} + " is not native");
+        }
+    }
+}
+
+// random straight line words on random operands
+TEST(jitMatchesInterpreterRandom)
+{
+    std::mt19937_64 random {10};
+    std::string max = cell(std::numeric_limits<Cell>::max());
+
+    for (int n = 0; n < 300; ++n)
+        compare({"random", randomWord(random), "3 -8 W 100 7 W " + max + " 2 W 0 0 W"});
+}
@@ -0,0 +1,73 @@
+/*
+ * @file    test_loops.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the compiled loops and of the return stack
+ */
+
+// ----- includes
+#include "test.h"
+
+#include <limits>
+
+// ----- helpers
+namespace {
+
+bool rejected(std::string_view definition)
+{
+    return runScript(definition).errors.find("unbalanced return stack") != std::string::npos;
+}
+
+}
+
+
+// ----- tests
+
+// the loops, their exits and the return stack words
+TEST(loopsCounted)
+{
+    CHECK_EQ(runScript(": N 3 0 DO 2 0 DO J . I . LOOP LOOP ; N").output, std::string {"0 0 0 1 1 0 1 1 2 0 2 1 "});
+    CHECK_EQ(runScript(": N 0 10 0 DO I + 3 +LOOP ; N .").output, std::string {"18 "});
+    CHECK_EQ(runScript(": N 0 0 ?DO I . LOOP 9 ; N .").output, std::string {"9 "});
+    CHECK_EQ(runScript(": N 10 0 DO I 3 = IF LEAVE THEN LOOP 7 ; N .").output, std::string {"7 "});
+    CHECK_EQ(runScript(": N 10 0 DO I 5 = IF I UNLOOP EXIT THEN LOOP 0 ; N .").output, std::string {"5 "});
+    CHECK_EQ(runScript(": N 3 >R R@ R> + ; N .").output, std::string {"6 "});
+    CHECK_EQ(runScript(": N IF >R ELSE >R THEN R> ; 1 2 N .").output, std::string {"1 "});
+}
+
+// +LOOP stops when the index crosses the limit, even far from it
+TEST(loopsPlusLoopBoundary)
+{
+    std::string extremes = std::to_string(std::numeric_limits<Cell>::max()) + " " +
+                           std::to_string(std::numeric_limits<Cell>::min());
+    CHECK_EQ(runScript(": N 0 " + extremes + " DO 1 + " + std::to_string(std::numeric_limits<Cell>::max()) +
+                       " +LOOP ; N .").output, std::string {"3 "});
+    CHECK_EQ(runScript(": N 0 0 10 DO 1 + -3 +LOOP ; N .").output, std::string {"4 "});
+}
+
+// LOOP wraps the index around past the largest cell
+TEST(loopsLoopWraps)
+{
+    constexpr auto kMax = std::numeric_limits<Cell>::max();
+    constexpr auto kMin = std::numeric_limits<Cell>::min();
+    auto result = runScript(": N " + std::to_string(kMin) + " " + std::to_string(kMax - 1) + " DO I LOOP ; N");
+    CHECK(result.stack == std::vector<Cell>({kMax - 1, kMax}));
+    CHECK_EQ(result.errors, std::string {});
+}
+
+// the definitions leaving cells on the return stack, or popping its loop
+// parameters, are refused instead of corrupting it
+TEST(loopsUnbalancedReturnStack)
+{
+    CHECK(rejected(": X 1 0 DO R> DROP R> DROP LOOP ;"));
+    CHECK(rejected(": X 1 0 DO EXIT LOOP ;"));
+    CHECK(rejected(": X 5 >R ;"));
+    CHECK(rejected(": X IF >R THEN R> ;"));
+    CHECK(rejected(": X R> DROP ;"));
+    CHECK(rejected(": X 10 0 DO >R LOOP ;"));
+    CHECK(rejected(": X 10 0 DO 1 >R LEAVE R> DROP LOOP ;"));
+
+    auto result = runScript(": Y 3 >R ; : Z Y ; Z 1 2 +");
+    CHECK(result.errors.find("Unknown word [Z]") != std::string::npos);
+    CHECK(result.stack == std::vector<Cell>({3}));
+}
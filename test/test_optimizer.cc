@@ -0,0 +1,135 @@
+/*
+ * @file    test_optimizer.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the peephole optimizer
+ */
+
+// ----- includes
+#include "test.h"
+
+#include <limits>
+
+// ----- helpers
+namespace {
+
+/* the optimized code of a word, as listed by SEE
+ * Args:
+ *  script : the script defining the word, followed by SEE
+ */
+std::string optimized(std::string_view script)
+{
+    std::string output = runScript(script).output;
+    auto position = output.find("optimized:");
+    return (position == std::string::npos) ? std::string {} : output.substr(position);
+}
+
+bool contains(const std::string& text, std::string_view part)
+{
+    return text.find(part) != std::string::npos;
+}
+
+}
+
+
+// ----- tests
+
+// constants are folded, and the literals merged with their operator
+TEST(optimizerFoldsLiterals)
+{
+    std::string code = optimized(": A 2 3 + 4 * ; SEE A");
+    CHECK(contains(code, "Literal 20"));
+    CHECK(!contains(code, "Add"));
+
+    code = optimized(": A 1 + 2 + 3 - ; SEE A");
+    CHECK(!contains(code, "LitAdd"));
+
+    code = optimized(": A 1 + 2 + ; SEE A");
+    CHECK(contains(code, "LitAdd 3"));
+
+    code = optimized(": A 255 AND ; SEE A");
+    CHECK(contains(code, "LitAnd 255"));
+
+    CHECK(runScript(": A 2 3 + 4 * ; A").stack == std::vector<Cell>({20}));
+    CHECK(runScript(": A 1 + 2 + 3 - ; 7 A").stack == std::vector<Cell>({7}));
+    CHECK(runScript(": A 255 AND ; 4660 A").stack == std::vector<Cell>({52}));
+}
+
+// the frequent pairs of the profiles become superinstructions
+TEST(optimizerSuperinstructions)
+{
+    CHECK(contains(optimized(": A DUP * ; SEE A"), "Square"));
+    CHECK(contains(optimized(": A OVER @ ; SEE A"), "OverFetch"));
+    CHECK(contains(optimized(": A 0 10 0 DO I + LOOP ; SEE A"), "IAdd"));
+    CHECK(contains(optimized(": A 4 0 DO I CELLS 64 + DROP LOOP ; SEE A"), "IndexCell 64"));
+    CHECK(contains(optimized(": A 0= IF 1 THEN ; SEE A"), "NonZeroBranch"));
+    CHECK(contains(optimized(": A DUP IF 1 THEN ; SEE A"), "DupZeroBranch"));
+
+    CHECK(runScript(": A DUP * ; -7 A").stack == std::vector<Cell>({49}));
+    auto fetched = runScript("VARIABLE V 42 V ! : A OVER @ ; 1 V 2 A").stack;
+    CHECK((fetched.size() == 4) && (fetched[0] == 1) && (fetched[2] == 2) && (fetched[3] == 42));
+    CHECK(runScript(": A 0 10 0 DO I + LOOP ; A").stack == std::vector<Cell>({45}));
+    CHECK(runScript(": A 0= IF 1 ELSE 2 THEN ; 0 A 5 A").stack == std::vector<Cell>({1, 2}));
+    CHECK(runScript(": A DUP IF 1 THEN ; 0 A 5 A").stack == std::vector<Cell>({0, 5, 1}));
+
+    auto cells = runScript("CREATE T 4 CELLS ALLOT : A 4 0 DO I I CELLS T + ! LOOP ; "
+                           ": B 0 4 0 DO I CELLS T + @ + LOOP ; A B");
+    CHECK(cells.stack == std::vector<Cell>({6}));
+}
+
+// the superinstructions wrap around as the instructions they replace
+TEST(optimizerSuperinstructionsWrap)
+{
+    constexpr Cell kMin {std::numeric_limits<Cell>::min()};
+    std::string max = std::to_string(std::numeric_limits<Cell>::max());
+    std::string min = std::to_string(kMin);
+    for (std::string argument : {max, min}) {
+        CHECK(runScript(": A 5 + ; " + argument + " A").stack == runScript(argument + " 5 +").stack);
+        CHECK(runScript(": A DUP * ; " + argument + " A").stack == runScript(argument + " DUP *").stack);
+    }
+    CHECK(contains(optimized(": A 5 + ; SEE A"), "LitAdd 5"));
+    CHECK(runScript(": A 5 + ; " + max + " A").stack == std::vector<Cell>({kMin + 4}));
+    CHECK(runScript(": A DUP * ; " + max + " A").stack == std::vector<Cell>({1}));
+    CHECK(runScript(": A 10 0 DO I + LOOP ; " + max + " A").stack == std::vector<Cell>({kMin + 44}));
+}
+
+// removing the instructions that only read the stack keeps its checks
+TEST(optimizerKeepsStackChecks)
+{
+    auto result = runScript(": A 0 + ; A");
+    CHECK(contains(result.errors, "not enough values"));
+
+    result = runScript(": A SWAP SWAP ; 1 A");
+    CHECK(contains(result.errors, "not enough values"));
+
+    result = runScript(": A SWAP SWAP ; 1 2 A");
+    CHECK(result.errors.empty());
+    CHECK(result.stack == std::vector<Cell>({1, 2}));
+}
+
+// the stack effect is inferred before the constant conditions are folded,
+// the branches they drop still have to balance
+TEST(optimizerKeepsDeadBranchEffects)
+{
+    auto result = runScript(": A 1 IF 1 ELSE 1 2 THEN ; SEE A A");
+    CHECK(contains(result.errors, "branches of [A] leave different stack depths"));
+    CHECK(contains(result.output, ": A\n"));
+    CHECK(result.stack == std::vector<Cell>({1}));
+
+    result = runScript(": B 0 IF DROP THEN 5 ; B");
+    CHECK(contains(result.errors, "branches of [B] leave different stack depths"));
+    CHECK(result.stack == std::vector<Cell>({5}));
+
+    // the branches are reported when the word is defined, not the loops
+    // growing the stack
+    CHECK(contains(runScript(": X IF 1 2 ELSE 3 THEN ;").errors, "branches of [X] leave different stack depths"));
+    result = runScript(": RANGE 0 DO I LOOP ; 3 RANGE");
+    CHECK(result.errors.empty());
+    CHECK(result.stack == std::vector<Cell>({0, 1, 2}));
+
+    result = runScript(": C 1 IF 1 ELSE 2 THEN ; SEE C C");
+    CHECK(result.errors.empty());
+    CHECK(contains(result.output, ": C ( 0 -- 1 )"));
+    CHECK(contains(optimized(": C 1 IF 1 ELSE 2 THEN ; SEE C"), "0\tLiteral 1\n    2\tExit"));
+    CHECK(result.stack == std::vector<Cell>({1}));
+}
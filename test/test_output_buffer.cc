@@ -0,0 +1,149 @@
+/*
+ * @file    test_output_buffer.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the buffered output of the words
+ */
+
+// ----- includes
+#include "test.h"
+#include "output_buffer.h"
+
+#include <limits>
+#include <streambuf>
+
+// ----- helpers
+namespace {
+
+// stream buffer keeping the size of every write it receives
+class Writes : public std::streambuf
+{
+public:
+    std::string text {};
+    std::vector<std::size_t> sizes {};
+
+protected:
+    std::streamsize xsputn(const char* data, std::streamsize count) override {
+        text.append(data, static_cast<std::size_t>(count));
+        sizes.push_back(static_cast<std::size_t>(count));
+        return count;
+    }
+
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            text.push_back(traits_type::to_char_type(c));
+            sizes.push_back(1);
+        }
+        return traits_type::not_eof(c);
+    }
+};
+
+constexpr std::size_t kCapacity {8192};
+
+}
+
+
+// ----- tests
+
+// the text is written once the buffer is full, in a single write
+TEST(outputBufferBoundary)
+{
+    Writes writes;
+    std::ostream stream {&writes};
+    {
+        OutputBuffer buffer {stream};
+        for (std::size_t i = 0; i < kCapacity; ++i)
+            buffer.put('a');
+        CHECK(writes.sizes.empty());
+
+        buffer.put('b');
+        CHECK(writes.sizes == std::vector<std::size_t>({kCapacity}));
+
+        // a text filling the buffer exactly stays in it
+        buffer.write(std::string(kCapacity - 1, 'c'));
+        CHECK_EQ(writes.sizes.size(), std::size_t {1});
+        buffer.write("d");
+        CHECK(writes.sizes == std::vector<std::size_t>({kCapacity, kCapacity}));
+    }
+    CHECK(writes.sizes == std::vector<std::size_t>({kCapacity, kCapacity, 1}));
+    CHECK_EQ(writes.text, std::string(kCapacity, 'a') + "b" + std::string(kCapacity - 1, 'c') + "d");
+}
+
+// the texts as large as the buffer go to the stream directly, after the
+// text gathered before them
+TEST(outputBufferLargeWrite)
+{
+    Writes writes;
+    std::ostream stream {&writes};
+    OutputBuffer buffer {stream};
+
+    buffer.write("head ");
+    buffer.write(std::string(kCapacity, 'x'));
+    CHECK(writes.sizes == std::vector<std::size_t>({5, kCapacity}));
+
+    buffer.write(std::string(3 * kCapacity, 'y'));
+    buffer.write(" tail");
+    CHECK(writes.sizes == std::vector<std::size_t>({5, kCapacity, 3 * kCapacity}));
+
+    buffer.flush();
+    CHECK_EQ(writes.text, "head " + std::string(kCapacity, 'x') + std::string(3 * kCapacity, 'y') + " tail");
+}
+
+// the numbers are written in the base, their letters in upper case
+TEST(outputBufferNumbers)
+{
+    Writes writes;
+    std::ostream stream {&writes};
+    OutputBuffer buffer {stream};
+
+    buffer.number(Cell {255}, 16);
+    buffer.number(Cell {-255}, 16);
+    buffer.number(Cell {35}, 36);
+    buffer.number(std::numeric_limits<Cell>::min(), 10);
+    buffer.number(Cell {-5}, 2);
+    buffer.flush();
+    CHECK_EQ(writes.text, "FF -FF Z " + std::to_string(std::numeric_limits<Cell>::min()) + " -101 ");
+
+    // the numbers are read in decimal, printed in hexadecimal
+    auto result = runScript("10 -171 255 HEX . . . DECIMAL 255 .");
+    CHECK_EQ(result.output, std::string {"FF -AB A 255 "});
+}
+
+// the double cells are converted by hand, the smallest one included
+TEST(outputBufferDoubleNumbers)
+{
+    Writes writes;
+    std::ostream stream {&writes};
+    OutputBuffer buffer {stream};
+
+    constexpr int kBits {2 * FORTH_CELL_BITS};
+    buffer.number(DoubleCell {0}, 10);
+    buffer.number(DoubleCell {-1}, 10);
+    buffer.number(static_cast<DoubleCell>(UDoubleCell {1} << (kBits - 1)), 2);
+    buffer.number(static_cast<DoubleCell>((UDoubleCell {1} << (kBits - 1)) - 1), 16);
+    buffer.flush();
+    CHECK_EQ(writes.text, "0 -1 -1" + std::string(kBits - 1, '0') + " 7" + std::string(kBits / 4 - 1, 'F') + " ");
+
+    // D. takes the high cell on top
+    auto result = runScript("0 1 D. -1 -1 D. 1 0 DNEGATE D. HEX 0 1 D. -2 0 D.");
+    std::string high = (FORTH_CELL_BITS == 64) ? "18446744073709551616" : "4294967296";
+    CHECK_EQ(result.output, high + " -1 -1 1" + std::string(FORTH_CELL_BITS / 4, '0') + " " +
+                            std::string(FORTH_CELL_BITS / 4 - 1, 'F') + "E ");
+    CHECK_EQ(result.errors, std::string {});
+}
+
+// a number written near the end of the buffer is written whole after it
+TEST(outputBufferNumberAtBoundary)
+{
+    Writes writes;
+    std::ostream stream {&writes};
+    OutputBuffer buffer {stream};
+
+    buffer.write(std::string(kCapacity - 3, '.'));
+    buffer.number(Cell {-123456}, 10);
+    CHECK(writes.sizes == std::vector<std::size_t>({kCapacity - 3}));
+    buffer.write(std::string(kCapacity - 8, '.'));
+    buffer.number(DoubleCell {-42}, 10);
+    buffer.flush();
+    CHECK_EQ(writes.text, std::string(kCapacity - 3, '.') + "-123456 " + std::string(kCapacity - 8, '.') + "-42 ");
+}
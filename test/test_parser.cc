@@ -0,0 +1,159 @@
+/*
+ * @file    test_parser.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the tokenizer, of the number lexer and of the input lines
+ */
+
+// ----- includes
+#include "test.h"
+#include "tokenizer.h"
+
+#include <limits>
+
+// ----- helpers
+namespace {
+
+// the tokens of an input, in order
+std::vector<std::string> tokens(std::string_view input)
+{
+    Tokenizer tokenizer;
+    tokenizer.parse(input);
+
+    std::vector<std::string> list;
+    while (auto token = tokenizer.next())
+        list.emplace_back(*token);
+    return list;
+}
+
+bool reportsUnknown(std::string_view script)
+{
+    return runScript(script).errors.find("Unknown word") != std::string::npos;
+}
+
+}
+
+
+// ----- tests
+
+// the tokens are separated by any white space, the input is not copied
+TEST(tokenizerSplitsWords)
+{
+    CHECK(tokens("").empty());
+    CHECK(tokens(" \t\n ").empty());
+    CHECK(tokens("  DUP\t* \n\n 12 ") == std::vector<std::string>({"DUP", "*", "12"}));
+
+    std::string input {"1 2 +"};
+    Tokenizer tokenizer;
+    tokenizer.parse(input);
+    auto first = tokenizer.next();
+    CHECK(first && (first->data() == input.data()));
+    CHECK(tokenizer.peek() && (*tokenizer.peek() == "2"));
+    CHECK(tokenizer.next() && tokenizer.next() && !tokenizer.next());
+}
+
+// the text up to a delimiter, and the rest of a line
+TEST(tokenizerParsesText)
+{
+    Tokenizer tokenizer;
+    tokenizer.parse(".\" hello  world\" DUP \\ comment\nDROP");
+    tokenizer.next();
+    auto text = tokenizer.parseUntil('"');
+    CHECK(text && (*text == "hello  world"));
+    CHECK(tokenizer.next() && tokenizer.next());
+    tokenizer.skipLine();
+    auto last = tokenizer.next();
+    CHECK(last && (*last == "DROP"));
+
+    tokenizer.parse(".\" no end");
+    tokenizer.next();
+    CHECK(!tokenizer.parseUntil('"'));
+    CHECK(!tokenizer.next());
+}
+
+// a script is scanned in place, whatever white space separates its tokens
+TEST(tokenizerRunsScripts)
+{
+    CHECK(runScript("\t: SQ\nDUP\r\n*\v;\f3 SQ").stack == std::vector<Cell>({9}));
+    CHECK_EQ(runScript(".\"  two  spaces \" 4 .").output, std::string {" two  spaces 4 "});
+    CHECK(runScript("1 2 +").stack == std::vector<Cell>({3}));
+
+    // only the white space separates the tokens
+    auto result = runScript("1 2+ 3");
+    CHECK(result.errors.find("Unknown word [2+]") != std::string::npos);
+    CHECK(result.stack == std::vector<Cell>({1, 3}));
+}
+
+// the numbers in the current base, with a sign and a base prefix
+TEST(parserNumbers)
+{
+    CHECK(runScript("0 42 -17 007").stack == std::vector<Cell>({0, 42, -17, 7}));
+    CHECK(runScript("$FF $ff #99 %101 -$10 $-10").stack == std::vector<Cell>({255, 255, 99, 5, -16, -16}));
+    CHECK(runScript("HEX FF 10 -A DECIMAL 10").stack == std::vector<Cell>({255, 16, -10, 10}));
+    CHECK(runScript("2 BASE ! 101 #7 DECIMAL").stack == std::vector<Cell>({5, 7}));
+    CHECK(runScript("36 BASE ! Z zz DECIMAL").stack == std::vector<Cell>({35, 1295}));
+
+    // a base out of the range 2..36 reads the numbers in decimal
+    CHECK(runScript("1 BASE ! 19 0 BASE ! 23").stack == std::vector<Cell>({19, 23}));
+}
+
+// the limits of the cell width, the larger numbers are not numbers
+TEST(parserLimits)
+{
+    constexpr auto kMax = std::numeric_limits<Cell>::max();
+    constexpr auto kMin = std::numeric_limits<Cell>::min();
+    constexpr auto kUnsigned = std::numeric_limits<std::make_unsigned_t<Cell>>::max();
+
+    std::string script = std::to_string(kMax) + " " + std::to_string(kMin) + " " + std::to_string(kUnsigned);
+    CHECK(runScript(script).stack == std::vector<Cell>({kMax, kMin, -1}));
+
+    CHECK(reportsUnknown(std::to_string(kUnsigned) + "0"));
+    CHECK(reportsUnknown("99999999999999999999999"));
+
+    // the negative numbers below the smallest cell, -4294967295 and
+    // -2147483649 with 32 bits cells
+    CHECK(runScript("-" + std::to_string(kUnsigned / 2 + 1)).stack == std::vector<Cell>({kMin}));
+    CHECK(reportsUnknown("-" + std::to_string(kUnsigned)));
+    CHECK(reportsUnknown("-" + std::to_string(kUnsigned / 2 + 2)));
+}
+
+// the tokens that only look like numbers are words
+TEST(parserRejectsMalformed)
+{
+    for (std::string_view token : {"12a", "$", "#", "%", "--5", "$-", "1-2", "%102", "$G", "0x10"})
+        CHECK(reportsUnknown(token));
+
+    CHECK(reportsUnknown("2 BASE ! 102"));
+    CHECK(runScript("HEX 12a").stack == std::vector<Cell>({0x12a}));
+}
+
+// the words are found before the numbers, whatever their spelling
+TEST(parserWordsBeforeNumbers)
+{
+    CHECK(runScript(": ADD + ; HEX 1 2 ADD DECIMAL").stack == std::vector<Cell>({3}));
+    CHECK(runScript("HEX : FACE 2 * ; : TWICE FACE FACE ; 5 TWICE DECIMAL").stack == std::vector<Cell>({20}));
+    CHECK(runScript("HEX : BEEF DUP IF 1 - BEEF THEN ; A BEEF DECIMAL").stack == std::vector<Cell>({0}));
+
+    // the other tokens are still read as numbers
+    CHECK(runScript(": ADD + ; HEX ADD0 DECIMAL").stack == std::vector<Cell>({0xADD0}));
+    CHECK_EQ(runScript(": ADD + ; HEX 1 2 ADD . DECIMAL").output, std::string {"3 "});
+}
+
+// the comments and the abandoned definitions go on over the next lines
+TEST(parserSpansLines)
+{
+    auto result = runLines({"1 ( a comment", "over two lines ) 2", "( closed ) 3"});
+    CHECK(result.stack == std::vector<Cell>({1, 2, 3}));
+    CHECK_EQ(result.errors, std::string {});
+
+    result = runLines({": SQ ( n", "-- n*n ) DUP * ;", "4 SQ"});
+    CHECK(result.stack == std::vector<Cell>({16}));
+    CHECK_EQ(result.errors, std::string {});
+
+    // the rest of the definition is skipped up to its semicolon
+    result = runLines({": BAD 1 UNKNOWN", "2 3 .", "4 ; 5", "BAD 6 ."});
+    CHECK(result.stack == std::vector<Cell>({5}));
+    CHECK_EQ(result.output, std::string {"6 "});
+    CHECK(result.errors.find("Unknown word [UNKNOWN]") != std::string::npos);
+    CHECK(result.errors.find("Unknown word [BAD]") != std::string::npos);
+}
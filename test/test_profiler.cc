@@ -0,0 +1,132 @@
+/*
+ * @file    test_profiler.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the execution profiler
+ */
+
+// ----- includes
+#include "test.h"
+#include "forth_vm.h"
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+// ----- helpers
+namespace {
+
+// SUMSQ is not inlined into MAIN, it holds a loop
+constexpr std::string_view kProgram {
+    ": SQ DUP * ; "
+    ": SUMSQ 0 SWAP 0 DO I SQ + LOOP ; "
+    ": MAIN 3 0 DO 10 SUMSQ DROP LOOP ; "
+};
+
+// profile of a script, and its collapsed stacks
+struct Profile {
+    std::string report {};
+    std::map<std::string, std::uint64_t> stacks {};
+};
+
+/* run a script with the profiler on, and read its reports
+ * Args:
+ *  script : the source code, starting the profiler itself if on is false
+ *  on     : true to profile from the start, as --profile does
+ */
+Profile profile(std::string_view script, bool on = true)
+{
+    std::string path = (std::filesystem::temp_directory_path() / "slforth_test_profile.folded").string();
+    std::filesystem::remove(path);
+
+    ForthVM forth;
+    std::ostringstream out;
+    std::ostringstream err;
+    forth.setOutput(out, err);
+    forth.setProfiling(on);
+    forth.run(script);
+    forth.writeProfile(path);
+
+    Profile result {err.str(), {}};
+    std::ifstream file {path};
+    std::string stack;
+    std::uint64_t cycles {0};
+    while (file >> stack >> cycles)
+        result.stacks[stack] = cycles;
+    std::filesystem::remove(path);
+    return result;
+}
+
+// calls counted for a word or a builtin of the report, 0 if not listed
+std::uint64_t calls(const std::string& report, std::string_view name)
+{
+    std::istringstream lines {report};
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields {line};
+        std::string first;
+        std::uint64_t count {0};
+        if ((fields >> first >> count) && (first == name))
+            return count;
+    }
+    return 0;
+}
+
+}
+
+
+// ----- tests
+
+// every word and builtin is counted at each of its executions
+TEST(profilerCounts)
+{
+    Profile result = profile(std::string {kProgram} + "MAIN");
+    CHECK(result.report.starts_with("----- profile (cycles)\n"));
+    CHECK_EQ(calls(result.report, "MAIN"), std::uint64_t {1});
+    CHECK_EQ(calls(result.report, "SUMSQ"), std::uint64_t {3});
+    CHECK_EQ(calls(result.report, "(Loop)"), std::uint64_t {33});
+    CHECK_EQ(calls(result.report, "+"), std::uint64_t {30});
+    CHECK_EQ(calls(result.report, "DROP"), std::uint64_t {3});
+
+    // SQ is inlined as a superinstruction, it is never called
+    CHECK_EQ(calls(result.report, "SQ"), std::uint64_t {0});
+    CHECK_EQ(calls(result.report, "(Square)"), std::uint64_t {30});
+}
+
+// the collapsed stacks hold a line per call path, with its cycles
+TEST(profilerCollapsedStacks)
+{
+    Profile result = profile(std::string {kProgram} + "MAIN 4 SUMSQ");
+    CHECK_EQ(result.stacks.size(), std::size_t {3});
+    CHECK(result.stacks.count("MAIN") && (result.stacks["MAIN"] > 0));
+    CHECK(result.stacks.count("MAIN;SUMSQ") && (result.stacks["MAIN;SUMSQ"] > 0));
+    CHECK(result.stacks.count("SUMSQ") && (result.stacks["SUMSQ"] > 0));
+}
+
+// the calls of a paused task are set aside, the other tasks and the main
+// program are not nested in them
+TEST(profilerTasks)
+{
+    Profile result = profile(": W 1 0 DO LOOP ; : T 1 0 DO PAUSE LOOP W ; : U T ; : M PAUSE W PAUSE ; "
+                             "' U SPAWN M");
+    CHECK_EQ(result.stacks.size(), std::size_t {4});
+    CHECK(result.stacks.count("M") && result.stacks.count("M;W"));
+    CHECK(result.stacks.count("T") && result.stacks.count("T;W"));
+    CHECK_EQ(calls(result.report, "T"), std::uint64_t {1});
+    CHECK_EQ(calls(result.report, "W"), std::uint64_t {2});
+}
+
+// only the code run between PROFILE-ON and PROFILE-OFF is profiled
+TEST(profilerOnOff)
+{
+    Profile result = profile(std::string {kProgram} + "MAIN PROFILE-ON 2 SUMSQ PROFILE-OFF MAIN", false);
+    CHECK_EQ(calls(result.report, "SUMSQ"), std::uint64_t {1});
+    CHECK_EQ(calls(result.report, "MAIN"), std::uint64_t {0});
+    CHECK_EQ(calls(result.report, "(Loop)"), std::uint64_t {2});
+    CHECK_EQ(result.stacks.size(), std::size_t {1});
+
+    // nothing is reported when nothing ran
+    result = profile("", true);
+    CHECK_EQ(result.report, std::string {});
+    CHECK(result.stacks.empty());
+}
@@ -0,0 +1,267 @@
+/*
+ * @file    test_server.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the protocol of the server
+ */
+
+// ----- includes
+#include "test.h"
+#include "server.h"
+
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <thread>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// ----- helpers
+namespace {
+
+// response of the server to a request
+struct Response {
+    std::string output {};
+    std::string errors {};
+    std::string stack {};
+};
+
+// a server on a scratch socket, run by a thread until the end of the test
+class Served
+{
+public:
+    explicit Served(std::chrono::milliseconds limit, std::size_t workers = 4) :
+        path_ {(std::filesystem::temp_directory_path() /
+                ("slforth_test_" + std::to_string(::getpid()) + ".sock")).string()}
+    {
+        ForthVM forth;
+        forth.run(": SQ DUP * ;");
+        server_ = std::make_unique<Server>(forth.snapshot(), workers);
+        server_->setJitThreshold(0);
+        server_->setTimeLimit(limit);
+        ready_ = server_->listen(path_);
+
+        // the thread inherits the mask, the termination only reaches the server
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGTERM);
+        ::pthread_sigmask(SIG_BLOCK, &signals, &mask_);
+        if (ready_)
+            thread_ = std::thread {[this]() { server_->run(); }};
+    }
+
+    ~Served()
+    {
+        if (thread_.joinable()) {
+            ::pthread_kill(thread_.native_handle(), SIGTERM);
+            thread_.join();
+        }
+        server_.reset();
+        ::pthread_sigmask(SIG_SETMASK, &mask_, nullptr);
+    }
+
+    Served(const Served&) = delete;
+    Served& operator=(const Served&) = delete;
+
+    bool ready() const { return ready_; }
+
+    // a new connection to the server, -1 if it failed
+    int connect() const
+    {
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path_.c_str(), path_.size() + 1);
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if ((fd >= 0) && (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+private:
+    std::string path_ {};
+    std::unique_ptr<Server> server_ {};
+    std::thread thread_ {};
+    sigset_t mask_ {};
+    bool ready_ {false};
+};
+
+bool sendAll(int fd, std::string_view data)
+{
+    while (!data.empty()) {
+        ssize_t count = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (count <= 0)
+            return false;
+        data.remove_prefix(static_cast<std::size_t>(count));
+    }
+    return true;
+}
+
+std::string request(std::string_view script)
+{
+    return std::to_string(script.size()) + "\n" + std::string {script};
+}
+
+// the next bytes of a connection, up to a size or to a delimiter
+std::optional<std::string> receive(int fd, std::size_t size, char delimiter = '\0')
+{
+    std::string data;
+    char c;
+    while ((delimiter != '\0') ? (data.empty() || (data.back() != delimiter)) : (data.size() < size)) {
+        if (::recv(fd, &c, 1, 0) != 1)
+            return std::nullopt;
+        data.push_back(c);
+    }
+    return data;
+}
+
+std::optional<Response> receiveResponse(int fd)
+{
+    auto header = receive(fd, 0, '\n');
+    if (!header)
+        return std::nullopt;
+
+    std::size_t output {0};
+    std::size_t errors {0};
+    std::size_t depth {0};
+    if (std::sscanf(header->c_str(), "%zu %zu %zu", &output, &errors, &depth) != 3)
+        return std::nullopt;
+
+    auto text = receive(fd, output + errors);
+    auto stack = receive(fd, 0, '\n');
+    if (!text || !stack)
+        return std::nullopt;
+    stack->pop_back();
+    return Response {text->substr(0, output), text->substr(output), *stack};
+}
+
+// the connection is closed by the server, without any response
+bool closedByServer(int fd)
+{
+    char c;
+    return ::recv(fd, &c, 1, 0) == 0;
+}
+
+}
+
+
+// ----- tests
+
+// the requests sent at once are answered in order, the slow ones included
+TEST(serverPipelinedRequests)
+{
+    Served served {std::chrono::milliseconds {5000}};
+    CHECK(served.ready());
+    int fd = served.connect();
+    CHECK(fd >= 0);
+
+    CHECK(sendAll(fd, request(": W 3000000 0 DO LOOP ; W 1") + request("2 SQ") + request("3 .") +
+                      request("4 UNKNOWN") + request("")));
+    std::vector<std::string> stacks {"1", "4", "", "4", ""};
+    for (const auto& stack : stacks) {
+        auto response = receiveResponse(fd);
+        CHECK(response.has_value());
+        if (response)
+            CHECK_EQ(response->stack, stack);
+    }
+
+    // the state does not leak from a request to the next one
+    CHECK(sendAll(fd, request("VARIABLE V 5 V ! V @") + request("V @")));
+    auto first = receiveResponse(fd);
+    auto second = receiveResponse(fd);
+    CHECK(first && second && (first->stack == "5") && (second->errors.find("Unknown word [V]") != std::string::npos));
+    ::close(fd);
+}
+
+// the tasks started by a request run before its response, also past the
+// end of its script
+TEST(serverTasks)
+{
+    Served served {std::chrono::milliseconds {200}};
+    int fd = served.connect();
+    CHECK(fd >= 0);
+
+    CHECK(sendAll(fd, request(": T 3 0 DO 65 EMIT PAUSE LOOP ; ' T SPAWN 66 EMIT 7") +
+                      request(": T BEGIN PAUSE AGAIN ; ' T SPAWN 8") + request("9")));
+    auto tasks = receiveResponse(fd);
+    CHECK(tasks && (tasks->output == "BAAA") && tasks->errors.empty() && (tasks->stack == "7"));
+    auto endless = receiveResponse(fd);
+    CHECK(endless && (endless->errors.find("interrupted") != std::string::npos) && (endless->stack == "8"));
+    auto next = receiveResponse(fd);
+    CHECK(next && next->output.empty() && next->errors.empty() && (next->stack == "9"));
+    ::close(fd);
+}
+
+// more requests than the server queues for a connection are answered all
+// the same, once the client reads the responses
+TEST(serverSaturatedConnection)
+{
+    Served served {std::chrono::milliseconds {5000}, 2};
+    int fd = served.connect();
+    CHECK(fd >= 0);
+
+    constexpr int kRequests {200};
+    std::string batch;
+    for (int i = 0; i < kRequests; ++i)
+        batch += request(std::to_string(i) + " DUP .");
+    CHECK(sendAll(fd, batch));
+
+    bool ordered {true};
+    for (int i = 0; (i < kRequests) && ordered; ++i) {
+        auto response = receiveResponse(fd);
+        ordered = response && (response->output == std::to_string(i) + " ") && (response->stack == std::to_string(i));
+    }
+    CHECK(ordered);
+    ::close(fd);
+}
+
+// the invalid headers close the connection
+TEST(serverHeaderErrors)
+{
+    Served served {std::chrono::milliseconds {5000}};
+    for (std::string_view header : {"abc\n1 2 +", "-3\n1 2", "\n", "99999999999\n", "1234567890123456789012345"}) {
+        int fd = served.connect();
+        CHECK(fd >= 0);
+        CHECK(sendAll(fd, header));
+        CHECK(closedByServer(fd));
+        ::close(fd);
+    }
+
+    // the requests before an invalid one are answered
+    int fd = served.connect();
+    CHECK(sendAll(fd, request("7") + "x\n"));
+    auto response = receiveResponse(fd);
+    CHECK(response && (response->stack == "7"));
+    CHECK(closedByServer(fd));
+    ::close(fd);
+}
+
+// the programs running too long, too deep or writing too much are stopped,
+// the next requests of the connection run normally
+TEST(serverLimits)
+{
+    Served served {std::chrono::milliseconds {200}};
+    int fd = served.connect();
+    CHECK(fd >= 0);
+
+    CHECK(sendAll(fd, request(": W BEGIN 0 UNTIL ; W") + request(": W BEGIN 1 AGAIN ; W") +
+                      request(": W BEGIN 65 EMIT AGAIN ; W") + request("KEY") + request("1 2 +")));
+
+    auto looping = receiveResponse(fd);
+    CHECK(looping && (looping->errors.find("interrupted") != std::string::npos));
+    auto deep = receiveResponse(fd);
+    CHECK(deep && (deep->errors.find("stack overflow") != std::string::npos));
+    auto writing = receiveResponse(fd);
+    CHECK(writing && (writing->errors.find("output limit reached") != std::string::npos) &&
+          (writing->output.size() == (std::size_t {1} << 20)));
+    auto key = receiveResponse(fd);
+    CHECK(key && (key->errors.find("KEY is not available") != std::string::npos));
+    auto sum = receiveResponse(fd);
+    CHECK(sum && (sum->stack == "3") && sum->errors.empty());
+    ::close(fd);
+}
@@ -0,0 +1,80 @@
+/*
+ * @file    test_snapshot.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the snapshots of the virtual machine
+ */
+
+// ----- includes
+#include "test.h"
+#include "forth_vm.h"
+
+// ----- helpers
+namespace {
+
+// run a script in a virtual machine, and collect its results
+ScriptResult runIn(ForthVM& forth, std::string_view script)
+{
+    std::ostringstream out;
+    std::ostringstream err;
+    forth.setOutput(out, err);
+    forth.run(script);
+    return {out.str(), err.str(), forth.stack()};
+}
+
+}
+
+
+// ----- tests
+
+// the words, the data and the stacks changed after a snapshot are undone
+TEST(snapshotRestoresState)
+{
+    ForthVM forth;
+    runIn(forth, "VARIABLE V 10 V ! : W V @ 1 + ; 1.5 7 8");
+    auto state = forth.snapshot();
+    CHECK(state != nullptr);
+
+    for (int round = 0; round < 3; ++round) {
+        ScriptResult changed = runIn(forth, "99 V ! : W 0 ; : X 5 ; W X F. 2.5 HERE 64 ALLOT DROP");
+        CHECK(changed.stack == std::vector<Cell>({7, 8, 0, 5}));
+        CHECK_EQ(changed.output, std::string {"1.5 "});
+
+        forth.restore(*state);
+        ScriptResult restored = runIn(forth, "W F.");
+        CHECK(restored.stack == std::vector<Cell>({7, 8, 11}));
+        CHECK_EQ(restored.output, std::string {"1.5 "});
+        CHECK(runIn(forth, "X").errors.find("Unknown word [X]") != std::string::npos);
+        forth.restore(*state);
+    }
+}
+
+// the other virtual machines start from a snapshot through its prelude
+TEST(snapshotSharedByWorkers)
+{
+    ForthVM forth;
+    runIn(forth, "VARIABLE V 3 V ! : W V @ 2 * ; 1 2");
+    auto state = forth.snapshot();
+
+    ForthVM worker {state->prelude};
+    worker.restore(*state);
+    CHECK(runIn(worker, "W").stack == std::vector<Cell>({1, 2, 6}));
+
+    // the changes of a worker stay in the worker
+    runIn(worker, "100 V ! : W 0 ;");
+    CHECK(runIn(forth, "W").stack == std::vector<Cell>({1, 2, 6}));
+    worker.restore(*state);
+    CHECK(runIn(worker, "W").stack == std::vector<Cell>({1, 2, 6}));
+}
+
+// a snapshot in the middle of a definition is refused
+TEST(snapshotRefusedInDefinition)
+{
+    ForthVM forth;
+    runIn(forth, ": W 1 ");
+    std::ostringstream out;
+    std::ostringstream err;
+    forth.setOutput(out, err);
+    CHECK(forth.snapshot() == nullptr);
+    CHECK(err.str().find("in a definition") != std::string::npos);
+}
@@ -0,0 +1,81 @@
+/*
+ * @file    test_tasks.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the cooperative tasks
+ */
+
+// ----- includes
+#include "test.h"
+#include "forth_vm.h"
+
+// ----- helpers
+namespace {
+
+// run a script and the tasks it started, as a file would
+ScriptResult runWithTasks(std::string_view script)
+{
+    ForthVM forth;
+    std::ostringstream out;
+    std::ostringstream err;
+    forth.setOutput(out, err);
+    forth.run(script);
+    forth.runTasks();
+    forth.run("FLUSH");
+    return {out.str(), err.str(), forth.stack()};
+}
+
+}
+
+
+// ----- tests
+
+// the tasks take turns at every PAUSE, the main program included
+TEST(tasksInterleave)
+{
+    auto result = runWithTasks(": T1 3 0 DO 65 EMIT PAUSE LOOP ; : T2 3 0 DO 66 EMIT PAUSE LOOP ; "
+                               "' T1 SPAWN ' T2 SPAWN 1 2 PAUSE 67 EMIT PAUSE 67 EMIT");
+    CHECK_EQ(result.output, std::string {"ABCABCAB"});
+    CHECK_EQ(result.errors, std::string {});
+    CHECK(result.stack == std::vector<Cell>({1, 2}));
+}
+
+// every task has its own stacks
+TEST(tasksOwnStacks)
+{
+    auto result = runWithTasks(": T 10 20 PAUSE + . ; : U 1.5 PAUSE F. ; ' T SPAWN ' U SPAWN 5 2.5 PAUSE F. .");
+    CHECK_EQ(result.output, std::string {"2.5 5 30 1.5 "});
+    CHECK(result.stack.empty());
+}
+
+// a task stopped by an error ends, the others go on
+TEST(tasksErrorEndsTask)
+{
+    auto result = runWithTasks(": T 1 2 + 0 / ; : U 68 EMIT PAUSE 68 EMIT ; ' T SPAWN ' U SPAWN");
+    CHECK_EQ(result.output, std::string {"DD"});
+    CHECK(result.errors.find("division by zero") != std::string::npos);
+
+    result = runWithTasks("12345 SPAWN");
+    CHECK(result.errors.find("invalid execution token") != std::string::npos);
+}
+
+// the tasks spawned by a task start at the next round
+TEST(tasksSpawnFromTask)
+{
+    auto result = runWithTasks(": CHILD 67 EMIT ; : PARENT 65 EMIT ' CHILD SPAWN PAUSE 66 EMIT ; ' PARENT SPAWN");
+    CHECK_EQ(result.output, std::string {"ABC"});
+}
+
+// the words created by a task while the main program is paused grow the
+// code space under it, the main program goes on in the new one
+TEST(tasksCreateWhilePaused)
+{
+    std::string script {": T 64 0 DO CREATE I , PAUSE LOOP ; : MAIN 0 64 0 DO PAUSE 1 + LOOP ; ' T SPAWN MAIN"};
+    for (int i = 0; i < 64; ++i)
+        script += " W" + std::to_string(i);
+    script += " W10 @ W63 @";
+
+    auto result = runWithTasks(script);
+    CHECK_EQ(result.errors, std::string {});
+    CHECK(result.stack == std::vector<Cell>({64, 10, 63}));
+}
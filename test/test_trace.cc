@@ -0,0 +1,129 @@
+/*
+ * @file    test_trace.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Tests of the event tracing
+ */
+
+// ----- includes
+#include "test.h"
+#include "forth_vm.h"
+
+#include <filesystem>
+#include <fstream>
+
+// ----- helpers
+namespace {
+
+/* run a script, and write the events it traced
+ * Args:
+ *  script : the source code
+ *  path   : the trace file to write
+ * Returns:
+ *  True if the trace has been written
+ */
+bool trace(std::string_view script, const std::string& path)
+{
+    ForthVM forth;
+    std::ostringstream out;
+    std::ostringstream err;
+    forth.setOutput(out, err);
+    forth.run(script);
+    return forth.writeTrace(path);
+}
+
+#ifdef FORTH_TRACE
+// value of a string field of a trace event, empty if it has none
+std::string field(const std::string& line, const std::string& name)
+{
+    std::string key = "\"" + name + "\":\"";
+    auto start = line.find(key);
+    if (start == std::string::npos)
+        return {};
+    start += key.size();
+    return line.substr(start, line.find('"', start) - start);
+}
+
+/* the events traced by a script, the stack depth counters aside
+ * Args:
+ *  script : the source code
+ */
+std::vector<std::string> events(std::string_view script)
+{
+    std::string path = (std::filesystem::temp_directory_path() / "slforth_test_trace.json").string();
+    CHECK(trace(script, path));
+
+    std::vector<std::string> list;
+    std::ifstream file {path};
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string phase = field(line, "ph");
+        if (phase == "B")
+            list.push_back("enter " + field(line, "name"));
+        else if (phase == "E")
+            list.push_back("exit");
+        else if (phase == "i")
+            list.push_back(field(line, "name"));
+    }
+    std::filesystem::remove(path);
+    return list;
+}
+#endif
+
+}
+
+
+// ----- tests
+
+#ifdef FORTH_TRACE
+
+// the calls, the conditional branches and the errors are traced in order,
+// the stack depth counters aside
+TEST(traceEvents)
+{
+    std::vector<std::string> expected {
+        "enter SIGN", "branch not taken", "exit",
+        "enter SIGN", "branch taken", "exit",
+        "error: division by zero",
+    };
+    CHECK(events(": SIGN 0< IF -1 ELSE 1 THEN ; -5 SIGN 5 SIGN 1 0 /") == expected);
+}
+
+// an error in a nested call closes every call it unwinds
+TEST(traceErrorUnwinds)
+{
+    std::vector<std::string> call {
+        "enter B", "enter A", "branch not taken", "enter A", "branch taken",
+        "error: division by zero", "exit", "exit", "exit",
+    };
+    std::vector<std::string> expected {call};
+    expected.insert(expected.end(), call.begin(), call.end());
+    CHECK(events(": A DUP IF 1 - A ELSE 0 / THEN ; : B A ; 1 B 1 B") == expected);
+}
+
+// the calls of a paused task are closed at the switch, and opened again
+// when it resumes
+TEST(traceTasks)
+{
+    std::vector<std::string> expected {
+        "enter M", "exit", "enter T", "exit",
+        "enter M", "enter W", "exit", "exit",
+        "enter T", "enter W", "exit", "exit",
+        "enter M", "exit",
+    };
+    CHECK(events(": W 1 0 DO LOOP ; : T 1 0 DO PAUSE LOOP W ; : U T ; : M PAUSE W PAUSE ; ' U SPAWN M") ==
+          expected);
+}
+
+#else
+
+// the builds without tracing refuse to write a trace
+TEST(traceNotCompiled)
+{
+    std::string path = (std::filesystem::temp_directory_path() / "slforth_test_trace.json").string();
+    std::filesystem::remove(path);
+    CHECK(!trace("1 2 +", path));
+    CHECK(!std::filesystem::exists(path));
+}
+
+#endif
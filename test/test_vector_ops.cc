@@ -0,0 +1,156 @@
+/*
+ * @file    test_vector_ops.cc
+ * @author  Sebastien LEGRAND
+ *
+ * @brief   Implementation / Cross-check of the vector kernels
+ */
+
+// ----- includes
+#include "test.h"
+#include "vector_ops.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+
+// ----- helpers
+namespace {
+
+// lengths around the vector widths, for the tails, and a long array
+constexpr std::size_t kLengths[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 1000};
+
+// byte offsets of the arrays, the kernels take unaligned addresses
+constexpr std::size_t kOffsets[] = {0, 1, 3};
+
+// cells at any byte address
+Cell cellAt(const std::vector<std::uint8_t>& bytes, std::size_t offset, std::size_t i)
+{
+    Cell value;
+    std::memcpy(&value, bytes.data() + offset + i * sizeof(Cell), sizeof(Cell));
+    return value;
+}
+
+/* random cells, with the extreme values mixed in
+ * Args:
+ *  random : the generator
+ *  n      : the number of cells
+ *  offset : the bytes before the first cell
+ */
+std::vector<std::uint8_t> randomCells(std::mt19937_64& random, std::size_t n, std::size_t offset)
+{
+    std::vector<std::uint8_t> bytes(offset + n * sizeof(Cell));
+    for (std::size_t i = 0; i < n; ++i) {
+        Cell value = static_cast<Cell>(random());
+        if (random() % 8 == 0)
+            value = (random() % 2) ? std::numeric_limits<Cell>::min() : std::numeric_limits<Cell>::max();
+        else if (random() % 4 == 0)
+            value = static_cast<Cell>(random() % 7) - 3;
+        std::memcpy(bytes.data() + offset + i * sizeof(Cell), &value, sizeof(Cell));
+    }
+    return bytes;
+}
+
+// random doubles, integers in a small range so that every order of the
+// additions gives the same sum
+std::vector<std::uint8_t> randomDoubles(std::mt19937_64& random, std::size_t n, std::size_t offset)
+{
+    std::vector<std::uint8_t> bytes(offset + n * sizeof(double));
+    for (std::size_t i = 0; i < n; ++i) {
+        double value = static_cast<double>(static_cast<int>(random() % 2001) - 1000) / 4;
+        std::memcpy(bytes.data() + offset + i * sizeof(double), &value, sizeof(double));
+    }
+    return bytes;
+}
+
+/* compare the kernels of an instruction set to the portable ones
+ * Args:
+ *  kernels : the kernels checked
+ *  scalar  : the reference kernels
+ */
+void crossCheck(const VectorKernels& kernels, const VectorKernels& scalar)
+{
+    std::mt19937_64 random {20};
+
+    for (std::size_t n : kLengths) {
+        for (std::size_t offset : kOffsets) {
+            auto a = randomCells(random, n, offset);
+            auto b = randomCells(random, n, offset);
+            const std::uint8_t* pa = a.data() + offset;
+            const std::uint8_t* pb = b.data() + offset;
+            Cell x = (n > 0) ? cellAt(a, offset, n / 2) : 5;
+
+            // reductions
+            CHECK_EQ(kernels.sum(pa, n), scalar.sum(pa, n));
+            CHECK_EQ(kernels.min(pa, n), scalar.min(pa, n));
+            CHECK_EQ(kernels.max(pa, n), scalar.max(pa, n));
+            CHECK_EQ(kernels.dot(pa, pb, n), scalar.dot(pa, pb, n));
+            CHECK_EQ(kernels.count(pa, n, x), scalar.count(pa, n, x));
+
+            // element wise, with the cells past the array left as they are
+            std::vector<std::uint8_t> expected(a.size() + sizeof(Cell), 0xA5);
+            std::vector<std::uint8_t> actual(a.size() + sizeof(Cell), 0xA5);
+
+            scalar.add(pa, pb, expected.data() + offset, n);
+            kernels.add(pa, pb, actual.data() + offset, n);
+            CHECK(actual == expected);
+
+            scalar.mul(pa, pb, expected.data() + offset, n);
+            kernels.mul(pa, pb, actual.data() + offset, n);
+            CHECK(actual == expected);
+
+            scalar.fill(expected.data() + offset, n, x);
+            kernels.fill(actual.data() + offset, n, x);
+            CHECK(actual == expected);
+
+            // doubles
+            auto fa = randomDoubles(random, n, offset);
+            auto fb = randomDoubles(random, n, offset);
+            const std::uint8_t* pfa = fa.data() + offset;
+            const std::uint8_t* pfb = fb.data() + offset;
+            CHECK_EQ(kernels.fsum(pfa, n), scalar.fsum(pfa, n));
+
+            std::vector<std::uint8_t> fexpected(fa.size() + sizeof(double), 0xA5);
+            std::vector<std::uint8_t> factual(fa.size() + sizeof(double), 0xA5);
+            scalar.fmul(pfa, pfb, fexpected.data() + offset, n);
+            kernels.fmul(pfa, pfb, factual.data() + offset, n);
+            CHECK(factual == fexpected);
+        }
+    }
+}
+
+}
+
+
+// ----- tests
+
+// every kernel set the processor runs gives the results of the portable one
+TEST(vectorKernelsCrossCheck)
+{
+    const auto& kernels = VectorKernels::supported();
+    const VectorKernels& scalar = *kernels.back();
+
+    for (const VectorKernels* set : kernels) {
+        std::cout << "  kernels " << set->name << "\n";
+        crossCheck(*set, scalar);
+    }
+}
+
+// the sums of doubles only differ by the order of the additions
+TEST(vectorKernelsFloatSum)
+{
+    const auto& kernels = VectorKernels::supported();
+    std::mt19937_64 random {24};
+    std::uniform_real_distribution<double> values {-1.0, 1.0};
+
+    for (std::size_t n : kLengths) {
+        std::vector<double> data(n);
+        for (double& value : data)
+            value = values(random);
+
+        auto bytes = reinterpret_cast<const std::uint8_t*>(data.data());
+        double expected = kernels.back()->fsum(bytes, n);
+        for (const VectorKernels* set : kernels)
+            CHECK(std::fabs(set->fsum(bytes, n) - expected) <= 1e-12 * static_cast<double>(n + 1));
+    }
+}